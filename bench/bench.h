@@ -0,0 +1,29 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __BENCH_BENCH_H__
+#define __BENCH_BENCH_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/* Monotonic time in seconds. */
+static inline double bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Keeps the compiler from optimizing away a computed value. */
+#define bench_use(x) __asm__ volatile("" : : "g"(x) : "memory")
+
+/* Cheap deterministic pseudo random numbers (xorshift64). */
+static inline uint64_t bench_rand(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+#endif
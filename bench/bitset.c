@@ -0,0 +1,68 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+
+#include <ds/bitset.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE unsigned char
+#define GENERIC_NAME ByteVec
+#define GENERIC_PREFIX byte_vec
+#include <ds/generic/vec.h>
+
+/* Intersecting two sets and counting the result, once with one byte per item
+ * and once with a bitset. */
+
+static size_t bytes_and_count(ByteVec a, const ByteVec b) {
+	size_t count = 0;
+	for (size_t i = 0; i < vec_len(a); i++) {
+		a[i] &= b[i];
+		count += a[i];
+	}
+	return count;
+}
+
+static size_t bits_and_count(Bitset *a, const Bitset *b) {
+	bitset_and(a, b);
+	return bitset_count(a);
+}
+
+int main() {
+	static const size_t sizes[] = { 1000, 100000, 10000000 };
+	printf("Nanoseconds per item\n");
+	printf("%10s %10s %10s\n", "n", "bytes", "bitset");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		size_t rounds = 100000000 / n;
+		ByteVec va = byte_vec(), vb = byte_vec();
+		Bitset ba = bitset(), bb = bitset();
+		ERROR_ASSERT(bitset_resize(&ba, n));
+		ERROR_ASSERT(bitset_resize(&bb, n));
+		uint64_t seed = 1;
+		for (size_t i = 0; i < n; i++) {
+			/* Both stay mostly set, so the intersection doesn't become empty. */
+			bool x = bench_rand(&seed) % 64 != 0, y = bench_rand(&seed) % 64 != 0;
+			ERROR_ASSERT(byte_vec_push(&va, x));
+			ERROR_ASSERT(byte_vec_push(&vb, y));
+			bitset_assign(&ba, i, x);
+			bitset_assign(&bb, i, y);
+		}
+		double t[2] = {0}, start;
+		for (size_t r = 0; r < rounds; r++) {
+			start = bench_now(); bench_use(bytes_and_count(va, vb)); t[0] += bench_now() - start;
+			start = bench_now(); bench_use(bits_and_count(&ba, &bb)); t[1] += bench_now() - start;
+		}
+		printf("%10zu", n);
+		for (size_t i = 0; i < 2; i++)
+			printf(" %10.3f", t[i] * 1e9 / ((double)n * rounds));
+		printf("\n");
+		byte_vec_term(va);
+		byte_vec_term(vb);
+		bitset_term(&ba);
+		bitset_term(&bb);
+	}
+}
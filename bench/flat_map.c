@@ -0,0 +1,89 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bench.h"
+
+#define GENERIC_KEY_TYPE int
+#define GENERIC_VALUE_TYPE int
+#define GENERIC_NAME IntIntMap
+#define GENERIC_PREFIX int_int_map
+#include <ds/generic/map.h>
+
+#define GENERIC_KEY_TYPE int
+#define GENERIC_VALUE_TYPE int
+#define GENERIC_NAME IntIntFlatMap
+#define GENERIC_PREFIX int_int_flat_map
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#include <ds/generic/flat_map.h>
+
+/* Building, looking up every key in random order, and summing all values, for
+ * map sizes typical of configuration data. */
+
+int main() {
+	static const size_t sizes[] = { 100, 1000, 10000 };
+	printf("Nanoseconds per item\n");
+	printf("%10s %10s %10s %10s %10s %10s %10s\n", "n", "map build", "flat build", "map get", "flat get", "map iter", "flat iter");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		size_t rounds = 10000000 / n;
+		IntIntFlatMapItem *src = malloc(sizeof(IntIntFlatMapItem) * n), *items = malloc(sizeof(IntIntFlatMapItem) * n);
+		int *keys = malloc(sizeof(int) * n);
+		uint64_t seed = 1;
+		for (size_t i = 0; i < n; i++) {
+			keys[i] = bench_rand(&seed) % (n * 8);
+			src[i] = (IntIntFlatMapItem){ .key = keys[i], .val = i };
+		}
+		double t[6] = {0}, start;
+		for (size_t r = 0; r < rounds; r++) {
+			IntIntMap hm = int_int_map();
+			IntIntFlatMap fm = int_int_flat_map();
+
+			start = bench_now();
+			for (size_t i = 0; i < n; i++)
+				ERROR_ASSERT(int_int_map_set(&hm, keys[i], i));
+			t[0] += bench_now() - start;
+			memcpy(items, src, sizeof(IntIntFlatMapItem) * n); /* _insert_batch sorts it */
+			start = bench_now();
+			ERROR_ASSERT(int_int_flat_map_insert_batch(&fm, items, n));
+			t[1] += bench_now() - start;
+
+			start = bench_now();
+			for (size_t i = 0; i < n; i++)
+				bench_use(*int_int_map_get(hm, keys[i]));
+			t[2] += bench_now() - start;
+			start = bench_now();
+			for (size_t i = 0; i < n; i++)
+				bench_use(*int_int_flat_map_get(&fm, keys[i]));
+			t[3] += bench_now() - start;
+
+			long long sum = 0;
+			start = bench_now();
+			IntIntMapItem *it = NULL;
+			while (int_int_map_it_next(hm, &it))
+				sum += it->val;
+			bench_use(sum);
+			t[4] += bench_now() - start;
+			sum = 0;
+			start = bench_now();
+			for (size_t i = 0; i < fm.len; i++)
+				sum += fm.vals[i];
+			bench_use(sum);
+			t[5] += bench_now() - start;
+
+			int_int_map_term(hm);
+			int_int_flat_map_term(&fm);
+		}
+		printf("%10zu", n);
+		for (size_t i = 0; i < 6; i++)
+			printf(" %10.3f", t[i] * 1e9 / ((double)n * rounds));
+		printf("\n");
+		free(src);
+		free(items);
+		free(keys);
+	}
+}
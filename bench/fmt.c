@@ -0,0 +1,131 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+#include "bench.h"
+
+/* Formatting into a buffer: a short log line, a metrics line which is mostly
+ * numbers, one with floating point numbers, and a line which is mostly literal text, strings and padding.
+ * "putc only" uses a context without write_func, as all contexts were before
+ * it existed. */
+
+#define SHORT_FORMAT "%s: request %d from %{str:p=8} took %zu us (%{uint:x,p=8,c='0'})\n"
+#define SHORT_PRINTF "%s: request %d from %8s took %zu us (%08x)\n"
+#define SHORT_ARGS "server", 12345, "client", (size_t)678, 0xbeefu
+
+#define NUM_FORMAT "cpu=%d mem=%zu rx=%llu tx=%llu id=%llx\n"
+#define NUM_PRINTF NUM_FORMAT
+#define NUM_ARGS -17, (size_t)123456789, 9876543210123ULL, 18446744073709551615ULL, 0xdeadbeefcafeULL
+
+/* printf has no shortest round-trip conversion; %.17g is what it takes to
+ * round-trip there. */
+#define FLOAT_FORMAT "t=%{double} lat=%f p99=%e ratio=%g\n"
+#define FLOAT_PRINTF "t=%.17g lat=%f p99=%e ratio=%g\n"
+#define FLOAT_ARGS 1666000123.4567, 0.0123456789, 98765.4321, 0.1 + 0.2
+
+#define LONG_FORMAT "The quick brown fox jumps over the lazy dog; %s. |%{str:p=40}|%{int:p=20}|\n"
+#define LONG_PRINTF "The quick brown fox jumps over the lazy dog; %s. |%40s|%20d|\n"
+#define LONG_ARGS "pack my box with five dozen liquor jugs", "right aligned", 42
+
+typedef struct PutcOnly {
+	char *buf;
+	size_t size, written;
+} PutcOnly;
+
+static void putc_only_func(FmtContext *ctx, char c) {
+	PutcOnly *p = ctx->ctx_data;
+	if (p->written < p->size - 1)
+		p->buf[p->written] = c;
+	p->written++;
+}
+
+#define RUN(_format, _printf, ...) { \
+	enum { ROUNDS = 1000000 }; \
+	char buf[256]; \
+	FmtCompiled *f; \
+	ERROR_ASSERT(fmt_compile(&f, _format)); \
+	size_t len = fmts(buf, sizeof(buf), _format, __VA_ARGS__); \
+	double t[4] = {0}, start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) { \
+		PutcOnly p = { .buf = buf, .size = sizeof(buf) }; \
+		FmtContext ctx = { .ctx_data = &p, .putc_func = putc_only_func }; \
+		fmtc(&ctx, _format, __VA_ARGS__); \
+		bench_use(p.written); \
+	} \
+	t[0] = bench_now() - start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) \
+		bench_use(fmts(buf, sizeof(buf), _format, __VA_ARGS__)); \
+	t[1] = bench_now() - start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) \
+		bench_use(fmts_compiled(buf, sizeof(buf), f, __VA_ARGS__)); \
+	t[2] = bench_now() - start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) \
+		bench_use(snprintf(buf, sizeof(buf), _printf, __VA_ARGS__)); \
+	t[3] = bench_now() - start; \
+	printf("%10zu", len); \
+	for (size_t i = 0; i < 4; i++) \
+		printf(" %10.1f", (double)len * ROUNDS / t[i] * 1e-6); \
+	printf("\n"); \
+	fmt_compiled_term(f); \
+}
+
+/* Formatting into a buffer of the right size: measuring with fmts() first,
+ * fmta(), and a reused FmtBuf. */
+#define RUN_ALLOC(_format, ...) { \
+	enum { ROUNDS = 1000000 }; \
+	double t[3] = {0}, start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) { \
+		size_t len = fmts(NULL, 0, _format, __VA_ARGS__); \
+		char *s = malloc(len + 1); \
+		fmts(s, len + 1, _format, __VA_ARGS__); \
+		bench_use(s[0]); \
+		free(s); \
+	} \
+	t[0] = bench_now() - start; \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) { \
+		char *s = fmta(NULL, _format, __VA_ARGS__); \
+		bench_use(s[0]); \
+		free(s); \
+	} \
+	t[1] = bench_now() - start; \
+	FmtBuf b = fmt_buf(); \
+	start = bench_now(); \
+	for (size_t r = 0; r < ROUNDS; r++) { \
+		fmtb_reset(&b); \
+		ERROR_ASSERT(fmtb(&b, _format, __VA_ARGS__)); \
+		bench_use(b.buf[0]); \
+	} \
+	t[2] = bench_now() - start; \
+	fmtb_term(&b); \
+	printf("%10zu", fmts(NULL, 0, _format, __VA_ARGS__)); \
+	for (size_t i = 0; i < 3; i++) \
+		printf(" %10.1f", t[i] * 1e9 / ROUNDS); \
+	printf("\n"); \
+}
+
+int main() {
+	fmt_init();
+	printf("Megabytes per second\n");
+	printf("%10s %10s %10s %10s %10s\n", "line len", "putc only", "fmts", "compiled", "snprintf");
+	RUN(SHORT_FORMAT, SHORT_PRINTF, SHORT_ARGS);
+	RUN(NUM_FORMAT, NUM_PRINTF, NUM_ARGS);
+	RUN(FLOAT_FORMAT, FLOAT_PRINTF, FLOAT_ARGS);
+	RUN(LONG_FORMAT, LONG_PRINTF, LONG_ARGS);
+	printf("\nNanoseconds per allocated line\n");
+	printf("%10s %10s %10s %10s\n", "line len", "two-pass", "fmta", "FmtBuf");
+	RUN_ALLOC(SHORT_FORMAT, SHORT_ARGS);
+	RUN_ALLOC(NUM_FORMAT, NUM_ARGS);
+	RUN_ALLOC(LONG_FORMAT, LONG_ARGS);
+	fmt_term();
+}
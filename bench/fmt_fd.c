@@ -0,0 +1,94 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ds/fmt.h>
+
+#include "bench.h"
+
+/* Bulk export to a file: fprintf() to a FILE with a buffer as large as
+ * FmtFd's, against fmtfd() copying everything into its buffer and fmtfd() in
+ * scatter mode. Rows are either short lines or lines carrying a large blob.
+ * Each case runs a few times and reports the fastest, as megabytes per
+ * second. */
+
+#define BUF_SIZE (64 * 1024)
+#define OUT_BYTES (256 * 1024 * 1024)
+#define REPEAT 3
+
+#define ROW_FORMAT "%zu,%s,%d,%s\n"
+
+static double run_file(const char *path, const char *blob, size_t rows) {
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL) {
+		perror("fopen");
+		exit(1);
+	}
+	setvbuf(fp, NULL, _IOFBF, BUF_SIZE);
+	double start = bench_now();
+	for (size_t i = 0; i < rows; i++)
+		fprintf(fp, ROW_FORMAT, i, "client", (int)(i % 1000), blob);
+	fclose(fp);
+	return bench_now() - start;
+}
+
+static double run_fd(const char *path, const char *blob, size_t rows, bool scatter) {
+	FILE *fp = fopen(path, "w");
+	if (fp == NULL) {
+		perror("fopen");
+		exit(1);
+	}
+	FmtFd out;
+	ERROR_ASSERT(fmt_fd_init(&out, fileno(fp), BUF_SIZE, scatter));
+	double start = bench_now();
+	for (size_t i = 0; i < rows; i++)
+		fmtfd(&out, ROW_FORMAT, i, "client", (int)(i % 1000), blob);
+	ERROR_ASSERT(fmt_fd_term(&out));
+	fclose(fp);
+	return bench_now() - start;
+}
+
+static void run(const char *path, size_t blob_len) {
+	char *blob = malloc(blob_len + 1);
+	memset(blob, 'x', blob_len);
+	blob[blob_len] = 0;
+	size_t row_len = snprintf(NULL, 0, ROW_FORMAT, (size_t)0, "client", 0, blob);
+	size_t rows = OUT_BYTES / row_len;
+	double t[3] = {0};
+	for (size_t r = 0; r < REPEAT; r++) {
+		double res[3] = { run_file(path, blob, rows), run_fd(path, blob, rows, false), run_fd(path, blob, rows, true) };
+		for (size_t i = 0; i < 3; i++) {
+			if (r == 0 || res[i] < t[i])
+				t[i] = res[i];
+		}
+	}
+	printf("%10zu", blob_len);
+	for (size_t i = 0; i < 3; i++)
+		printf(" %10.1f", (double)row_len * rows / t[i] * 1e-6);
+	printf("\n");
+	free(blob);
+}
+
+int main() {
+	fmt_init();
+	char path[] = "/tmp/ds_fmt_fd_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	printf("Megabytes per second\n");
+	printf("%10s %10s %10s %10s\n", "blob len", "fprintf", "fmtfd", "scatter");
+	run(path, 16);
+	run(path, 4096);
+	run(path, 32 * 1024);
+	run(path, 64 * 1024);
+	run(path, 1024 * 1024);
+	unlink(path);
+	fmt_term();
+}
@@ -0,0 +1,85 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include <ds/fmt.h>
+
+#include "bench.h"
+
+/* Formatting from several threads at once, with and without another thread
+ * registering new types all the time. Readers only mark their own slot and
+ * load the published registry, so registering shouldn't slow them down, and with a lock the
+ * slowest call would show every time a reader waited for the writer (with
+ * fewer CPUs than threads, preemption shows there too). */
+
+#define ROUNDS 200000
+#define MAX_THREADS 4
+#define REGISTRATIONS 500
+
+typedef struct Reader {
+	pthread_t thread;
+	double time, max_call;
+} Reader;
+
+static _Atomic bool registering_done;
+
+static void *reader_run(void *arg) {
+	Reader *r = arg;
+	char buf[128];
+	double start = bench_now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		double call_start = bench_now();
+		bench_use(fmts(buf, sizeof(buf), "%{str}: %{int} %{uint:x} %{size_t}", "reader", (int)i, (unsigned)i, i));
+		double t = bench_now() - call_start;
+		if (t > r->max_call)
+			r->max_call = t;
+	}
+	r->time = bench_now() - start;
+	return NULL;
+}
+
+static FmtPrintFuncRet print_nothing(FmtContext *ctx, FmtAttrs *attrs, va_list v) {
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static void *writer_run(void *arg) {
+	size_t *n = arg;
+	while (!atomic_load(&registering_done) && *n < REGISTRATIONS) {
+		char name[32];
+		snprintf(name, sizeof(name), "Type%zu", (*n)++);
+		fmt_register(name, print_nothing);
+	}
+	return NULL;
+}
+
+int main() {
+	fmt_init();
+	printf("%10s %10s %14s %14s %14s\n", "threads", "writer", "ns per call", "max call us", "registrations");
+	for (size_t n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+		for (int with_writer = 0; with_writer <= 1; with_writer++) {
+			Reader readers[MAX_THREADS] = {0};
+			pthread_t writer;
+			size_t n_registered = 0;
+			atomic_store(&registering_done, false);
+			if (with_writer)
+				pthread_create(&writer, NULL, writer_run, &n_registered);
+			for (size_t i = 0; i < n_threads; i++)
+				pthread_create(&readers[i].thread, NULL, reader_run, &readers[i]);
+			double time = 0, max_call = 0;
+			for (size_t i = 0; i < n_threads; i++) {
+				pthread_join(readers[i].thread, NULL);
+				time += readers[i].time;
+				if (readers[i].max_call > max_call)
+					max_call = readers[i].max_call;
+			}
+			atomic_store(&registering_done, true);
+			if (with_writer)
+				pthread_join(writer, NULL);
+			printf("%10zu %10s %14.1f %14.1f %14zu\n", n_threads, with_writer ? "yes" : "no", time * 1e9 / ((double)ROUNDS * n_threads), max_call * 1e6, n_registered);
+		}
+	}
+	fmt_term();
+}
@@ -0,0 +1,73 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec
+#define GENERIC_PREFIX int_vec
+#include <ds/generic/vec.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntHeap2
+#define GENERIC_PREFIX int_heap2
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_HEAP_ARITY 2
+#include <ds/generic/heap.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntHeap4
+#define GENERIC_PREFIX int_heap4
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#include <ds/generic/heap.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntHeap8
+#define GENERIC_PREFIX int_heap8
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_HEAP_ARITY 8
+#include <ds/generic/heap.h>
+
+/* Nanoseconds per item for pushing n random items, popping all of them, and
+ * heapifying n random items. */
+#define BENCH_HEAP(pfx, n, t) { \
+	IntVec h = int_vec(); \
+	uint64_t seed = 1; \
+	double start = bench_now(); \
+	for (size_t i = 0; i < n; i++) \
+		ERROR_ASSERT(pfx##_push(&h, (int)bench_rand(&seed))); \
+	t[0] = (bench_now() - start) * 1e9 / n; \
+	start = bench_now(); \
+	for (size_t i = 0; i < n; i++) \
+		bench_use(pfx##_pop(h)); \
+	t[1] = (bench_now() - start) * 1e9 / n; \
+	for (size_t i = 0; i < n; i++) \
+		ERROR_ASSERT(int_vec_push(&h, (int)bench_rand(&seed))); \
+	start = bench_now(); \
+	pfx##_heapify(h); \
+	t[2] = (bench_now() - start) * 1e9 / n; \
+	int_vec_term(h); \
+}
+
+int main() {
+	static const size_t sizes[] = { 1000, 1000000, 10000000 };
+	printf("Nanoseconds per item\n");
+	printf("%10s %6s %8s %8s %8s\n", "n", "arity", "push", "pop", "heapify");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		double t[3];
+		BENCH_HEAP(int_heap2, n, t);
+		printf("%10zu %6d %8.2f %8.2f %8.2f\n", n, 2, t[0], t[1], t[2]);
+		BENCH_HEAP(int_heap4, n, t);
+		printf("%10zu %6d %8.2f %8.2f %8.2f\n", n, 4, t[0], t[1], t[2]);
+		BENCH_HEAP(int_heap8, n, t);
+		printf("%10zu %6d %8.2f %8.2f %8.2f\n", n, 8, t[0], t[1], t[2]);
+	}
+}
@@ -0,0 +1,120 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ds/fmt.h>
+#include <ds/log.h>
+
+#include "bench.h"
+
+/* Latency of a single log call, as seen by the logging thread: log_fmt()
+ * against formatting with fmts() and calling write(2) right away. Latencies go
+ * into power of 2 buckets of nanoseconds; the percentiles are bucket upper
+ * bounds. */
+
+#define ROUNDS 200000
+#define MAX_THREADS 4
+#define N_BUCKETS 40
+
+typedef enum Mode {
+	ModeSync,
+	ModeBlock,
+	ModeDrop,
+	ModeCount,
+} Mode;
+
+static const char *mode_names[ModeCount] = { "write(2)", "log block", "log drop" };
+
+typedef struct Thread {
+	pthread_t thread;
+	Mode mode;
+	Logger *l;
+	int fd;
+	size_t buckets[N_BUCKETS];
+	double max_call;
+} Thread;
+
+static void *thread_run(void *arg) {
+	Thread *t = arg;
+	char buf[256];
+	for (size_t i = 0; i < ROUNDS; i++) {
+		double start = bench_now();
+		if (t->mode == ModeSync) {
+			size_t n = fmts(buf, sizeof(buf), "request %zu from %s took %d us\n", i, "10.0.0.1", (int)(i % 1000));
+			bench_use(write(t->fd, buf, n));
+		} else
+			log_fmt(t->l, "request %zu from %s took %d us\n", i, "10.0.0.1", (int)(i % 1000));
+		double time = bench_now() - start;
+		size_t ns = time * 1e9, bucket = 0;
+		while (bucket < N_BUCKETS - 1 && ns >> bucket != 0)
+			bucket++;
+		t->buckets[bucket]++;
+		if (time > t->max_call)
+			t->max_call = time;
+	}
+	return NULL;
+}
+
+/* Upper bound in ns of the bucket containing the given fraction of calls. */
+static size_t percentile(const size_t *buckets, size_t total, double frac) {
+	size_t n = 0;
+	for (size_t i = 0; i < N_BUCKETS; i++) {
+		n += buckets[i];
+		if (n >= frac * total)
+			return (size_t)1 << i;
+	}
+	return (size_t)1 << (N_BUCKETS - 1);
+}
+
+int main() {
+	fmt_init();
+	char path[] = "/tmp/ds_log_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	printf("%10s %10s %10s %10s %10s %10s %10s\n", "mode", "threads", "p50 ns", "p99 ns", "p99.9 ns", "max us", "dropped");
+	for (Mode mode = 0; mode < ModeCount; mode++) {
+		for (size_t n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+			Logger l;
+			if (mode != ModeSync)
+				ERROR_ASSERT(logger_init(&l, path, mode == ModeBlock ? LogOverflowBlock : LogOverflowDrop, 0));
+			Thread threads[MAX_THREADS] = {0};
+			for (size_t i = 0; i < n_threads; i++) {
+				threads[i] = (Thread){ .mode = mode, .l = &l, .fd = fd };
+				pthread_create(&threads[i].thread, NULL, thread_run, &threads[i]);
+			}
+			size_t buckets[N_BUCKETS] = {0};
+			double max_call = 0;
+			for (size_t i = 0; i < n_threads; i++) {
+				pthread_join(threads[i].thread, NULL);
+				for (size_t j = 0; j < N_BUCKETS; j++)
+					buckets[j] += threads[i].buckets[j];
+				if (threads[i].max_call > max_call)
+					max_call = threads[i].max_call;
+			}
+			size_t dropped = 0;
+			if (mode != ModeSync) {
+				dropped = logger_dropped(&l);
+				logger_term(&l);
+			}
+			size_t total = ROUNDS * n_threads;
+			printf("%10s %10zu %10zu %10zu %10zu %10.1f %10zu\n", mode_names[mode], n_threads,
+					percentile(buckets, total, 0.5), percentile(buckets, total, 0.99), percentile(buckets, total, 0.999),
+					max_call * 1e6, dropped);
+			if (ftruncate(fd, 0) != 0) {
+				perror("ftruncate");
+				return 1;
+			}
+		}
+	}
+	close(fd);
+	unlink(path);
+	fmt_term();
+}
@@ -0,0 +1,172 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE uint64_t
+#define GENERIC_NAME U64Spsc
+#define GENERIC_PREFIX u64_spsc
+#include <ds/generic/spsc.h>
+
+#define GENERIC_TYPE uint64_t
+#define GENERIC_NAME U64Mpmc
+#define GENERIC_PREFIX u64_mpmc
+#include <ds/generic/mpmc.h>
+
+#define GENERIC_TYPE uint64_t
+#define GENERIC_NAME U64Deque
+#define GENERIC_PREFIX u64_deque
+#include <ds/generic/deque.h>
+
+#define N_ITEMS 2000000
+#define MAX_THREADS 64
+#define BATCH 32
+
+/* Every configuration moves N_ITEMS items in total from the producers to the
+ * consumers; half of the threads produce and half consume (a single thread
+ * does both, alternating). The baseline is a deque guarded by a mutex. */
+
+typedef enum Kind {
+	KindMutex,
+	KindMpmc,
+	KindMpmcBatch,
+	KindSpsc,
+	KindSpscBatch,
+} Kind;
+
+static Kind kind;
+static size_t n_producers, n_consumers;
+static U64Spsc spsc;
+static U64Mpmc mpmc;
+static U64Deque deque;
+static pthread_mutex_t deque_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic size_t n_consumed;
+
+static size_t push(const uint64_t *items, size_t n) {
+	switch (kind) {
+	case KindMutex:
+		pthread_mutex_lock(&deque_mutex);
+		if (u64_deque_len(&deque) >= 1024)
+			n = 0;
+		else
+			ERROR_ASSERT(u64_deque_push_back_n(&deque, items, n));
+		pthread_mutex_unlock(&deque_mutex);
+		return n;
+	case KindMpmc:      return u64_mpmc_try_push(&mpmc, items[0]);
+	case KindMpmcBatch: return u64_mpmc_try_push_n(&mpmc, items, n);
+	case KindSpsc:      return u64_spsc_try_push(&spsc, items[0]);
+	case KindSpscBatch: return u64_spsc_try_push_n(&spsc, items, n);
+	}
+	return 0;
+}
+
+static size_t pop(uint64_t *dst, size_t n) {
+	switch (kind) {
+	case KindMutex:
+		pthread_mutex_lock(&deque_mutex);
+		n = u64_deque_pop_front_n(&deque, dst, n);
+		pthread_mutex_unlock(&deque_mutex);
+		return n;
+	case KindMpmc:      return u64_mpmc_try_pop(&mpmc, dst);
+	case KindMpmcBatch: return u64_mpmc_try_pop_n(&mpmc, dst, n);
+	case KindSpsc:      return u64_spsc_try_pop(&spsc, dst);
+	case KindSpscBatch: return u64_spsc_try_pop_n(&spsc, dst, n);
+	}
+	return 0;
+}
+
+static bool batched() {
+	return kind == KindMutex || kind == KindMpmcBatch || kind == KindSpscBatch;
+}
+
+static void *producer(void *arg) {
+	(void)arg;
+	uint64_t items[BATCH] = {0};
+	size_t n = N_ITEMS / n_producers;
+	for (size_t done = 0; done < n;) {
+		size_t want = batched() ? (n - done < BATCH ? n - done : BATCH) : 1;
+		size_t pushed = push(items, want);
+		if (pushed == 0)
+			sched_yield();
+		done += pushed;
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg) {
+	(void)arg;
+	uint64_t items[BATCH];
+	size_t total = N_ITEMS / n_producers * n_producers;
+	while (atomic_load_explicit(&n_consumed, memory_order_relaxed) < total) {
+		size_t n = pop(items, batched() ? BATCH : 1);
+		if (n == 0)
+			sched_yield();
+		else
+			atomic_fetch_add_explicit(&n_consumed, n, memory_order_relaxed);
+	}
+	return NULL;
+}
+
+/* Single thread: push a batch, then pop it again. */
+static void *alternate(void *arg) {
+	(void)arg;
+	uint64_t items[BATCH] = {0};
+	size_t step = batched() ? BATCH : 1;
+	for (size_t done = 0; done < N_ITEMS; done += step) {
+		push(items, step);
+		pop(items, step);
+	}
+	return NULL;
+}
+
+/* Returns millions of items per second. */
+static double run(Kind k, size_t nthreads) {
+	kind = k;
+	n_producers = nthreads == 1 ? 1 : nthreads / 2;
+	n_consumers = nthreads == 1 ? 0 : nthreads - n_producers;
+	atomic_store(&n_consumed, 0);
+	ERROR_ASSERT(u64_spsc(&spsc, 1024));
+	ERROR_ASSERT(u64_mpmc(&mpmc, 1024));
+	deque = u64_deque();
+	pthread_t threads[MAX_THREADS];
+	double start = bench_now();
+	if (nthreads == 1)
+		alternate(NULL);
+	else {
+		for (size_t i = 0; i < n_producers; i++)
+			pthread_create(&threads[i], NULL, producer, NULL);
+		for (size_t i = 0; i < n_consumers; i++)
+			pthread_create(&threads[n_producers + i], NULL, consumer, NULL);
+		for (size_t i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
+	}
+	double t = bench_now() - start;
+	u64_spsc_term(&spsc);
+	u64_mpmc_term(&mpmc);
+	u64_deque_term(&deque);
+	return N_ITEMS / t * 1e-6;
+}
+
+int main() {
+	static const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+	printf("Million items per second\n");
+	printf("%8s %10s %10s %10s %10s %10s\n", "threads", "mutex", "mpmc", "mpmc(32)", "spsc", "spsc(32)");
+	for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); i++) {
+		size_t n = thread_counts[i];
+		printf("%8zu %10.2f %10.2f %10.2f", n, run(KindMutex, n), run(KindMpmc, n), run(KindMpmcBatch, n));
+		/* SPSC only allows one producer and one consumer. */
+		if (n <= 2)
+			printf(" %10.2f %10.2f\n", run(KindSpsc, n), run(KindSpscBatch, n));
+		else
+			printf(" %10s %10s\n", "-", "-");
+	}
+}
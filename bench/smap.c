@@ -0,0 +1,88 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ds/fmt.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntMap
+#define GENERIC_PREFIX int_map
+#include <ds/generic/smap.h>
+
+#define N_KEYS 4096
+
+/* Byte-at-a-time FNV-1a, which smap used before switching to CRC32C. */
+static uint32_t fnv1a32(const void *data, size_t n) {
+	uint32_t res = 2166136261u;
+	for (size_t i = 0; i < n; i++) {
+		res ^= ((uint8_t*)data)[i];
+		res *= 16777619u;
+	}
+	return res;
+}
+
+static uint32_t crc32c_sw(const void *data, size_t n) {
+	return _hash_fmix32(_crc32c_sw(0, data, n));
+}
+
+static double hash_throughput(uint32_t (*hash)(const void *, size_t), char **keys, size_t key_len) {
+	size_t rounds = (64 << 20) / (key_len * N_KEYS) + 1;
+	uint32_t acc = 0;
+	double start = bench_now();
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < N_KEYS; i++)
+			acc += hash(keys[i], key_len);
+	}
+	double secs = bench_now() - start;
+	bench_use(acc);
+	return (double)(rounds * N_KEYS * key_len) / secs / (1 << 20);
+}
+
+static double lookup_rate(char **keys) {
+	IntMap m = int_map();
+	for (size_t i = 0; i < N_KEYS; i++)
+		ERROR_ASSERT(int_map_set(&m, keys[i], (int)i));
+	size_t rounds = 256;
+	int acc = 0;
+	double start = bench_now();
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < N_KEYS; i++)
+			acc += *int_map_get(m, keys[i]);
+	}
+	double secs = bench_now() - start;
+	bench_use(acc);
+	int_map_term(m);
+	return (double)(rounds * N_KEYS) / secs / 1e6;
+}
+
+int main() {
+	static const size_t lens[] = { 4, 8, 16, 32, 64, 128, 256, 512 };
+	uint64_t rng = 0x9e3779b97f4a7c15ull;
+	char **keys = malloc(sizeof(char *) * N_KEYS);
+
+	printf("%8s %14s %14s %14s %14s\n", "key len", "fnv1a MiB/s", "crc32c-sw MiB/s", "crc32c MiB/s", "get M/s");
+	for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); l++) {
+		size_t len = lens[l];
+		for (size_t i = 0; i < N_KEYS; i++) {
+			keys[i] = malloc(len + 1);
+			/* Shared prefix, like URLs or file paths. */
+			for (size_t j = 0; j < len; j++)
+				keys[i][j] = j + 8 < len ? '/' + j % 64 : 'a' + bench_rand(&rng) % 26;
+			keys[i][len] = 0;
+		}
+		printf("%8zu %14.0f %14.0f %14.0f %14.1f\n", len,
+				hash_throughput(fnv1a32, keys, len),
+				hash_throughput(crc32c_sw, keys, len),
+				hash_throughput(_hash_bytes, keys, len),
+				lookup_rate(keys));
+		for (size_t i = 0; i < N_KEYS; i++)
+			free(keys[i]);
+	}
+	free(keys);
+}
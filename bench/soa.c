@@ -0,0 +1,94 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+
+#include "bench.h"
+
+typedef struct Particle {
+	int id;
+	float x, y, z;
+	float vx, vy, vz;
+	double mass;
+} Particle;
+
+#define GENERIC_TYPE Particle
+#define GENERIC_NAME ParticleVec
+#define GENERIC_PREFIX particle_vec
+#include <ds/generic/vec.h>
+
+#define GENERIC_NAME Particles
+#define GENERIC_PREFIX particles
+#define GENERIC_FIELDS(X) \
+	X(int, id) \
+	X(float, x) \
+	X(float, y) \
+	X(float, z) \
+	X(float, vx) \
+	X(float, vy) \
+	X(float, vz) \
+	X(double, mass)
+#include <ds/generic/soa.h>
+
+/* Two typical passes which only touch a few fields: summing one field, and
+ * moving every particle along x by its velocity. */
+
+static float aos_sum_x(const ParticleVec v) {
+	float sum = 0.f;
+	for (size_t i = 0; i < vec_len(v); i++)
+		sum += v[i].x;
+	return sum;
+}
+
+static void aos_step(ParticleVec v, float dt) {
+	for (size_t i = 0; i < vec_len(v); i++)
+		v[i].x += v[i].vx * dt;
+}
+
+static float soa_sum_x(Particles *p) {
+	const float *x = particles_x(p);
+	float sum = 0.f;
+	for (size_t i = 0; i < particles_len(p); i++)
+		sum += x[i];
+	return sum;
+}
+
+static void soa_step(Particles *p, float dt) {
+	float *restrict x = particles_x(p);
+	const float *restrict vx = particles_vx(p);
+	for (size_t i = 0; i < particles_len(p); i++)
+		x[i] += vx[i] * dt;
+}
+
+int main() {
+	static const size_t sizes[] = { 1000, 100000, 10000000 };
+	printf("Nanoseconds per item\n");
+	printf("%10s %10s %10s %10s %10s\n", "n", "aos sum", "soa sum", "aos step", "soa step");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		size_t rounds = 100000000 / n;
+		ParticleVec aos = particle_vec();
+		Particles soa = particles();
+		uint64_t seed = 1;
+		for (size_t i = 0; i < n; i++) {
+			Particle p = { .id = i, .x = bench_rand(&seed) % 1000, .vx = 1.f, .mass = 1.0 };
+			ERROR_ASSERT(particle_vec_push(&aos, p));
+			ERROR_ASSERT(particles_push(&soa, (ParticlesRow){ .id = p.id, .x = p.x, .vx = p.vx, .mass = p.mass }));
+		}
+		double t[4] = {0}, start;
+		for (size_t r = 0; r < rounds; r++) {
+			start = bench_now(); bench_use(aos_sum_x(aos));  t[0] += bench_now() - start;
+			start = bench_now(); bench_use(soa_sum_x(&soa)); t[1] += bench_now() - start;
+			start = bench_now(); aos_step(aos, 0.01f);       t[2] += bench_now() - start;
+			start = bench_now(); soa_step(&soa, 0.01f);      t[3] += bench_now() - start;
+		}
+		printf("%10zu", n);
+		for (size_t i = 0; i < 4; i++)
+			printf(" %10.3f", t[i] * 1e9 / ((double)n * rounds));
+		printf("\n");
+		particle_vec_term(aos);
+		particles_term(&soa);
+	}
+}
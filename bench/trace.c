@@ -0,0 +1,70 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ds/fmt.h>
+#include <ds/trace.h>
+
+#include "bench.h"
+
+/* trace_fmt() against formatting the same events as text into a buffer which
+ * is written out in 64 KiB chunks: time per event and bytes per event in the
+ * file. The binary form saves the literal text and the cost of formatting;
+ * numbers take 16 bytes each (size and value), so short formats with many
+ * arguments gain little. */
+
+#define ROUNDS 1000000
+
+static size_t file_size(const char *path) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		perror("stat");
+		exit(1);
+	}
+	return st.st_size;
+}
+
+int main() {
+	fmt_init();
+	char path[] = "/tmp/ds_trace_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+
+	FmtBuf b = fmt_buf();
+	double start = bench_now();
+	for (size_t i = 0; i < ROUNDS; i++) {
+		ERROR_ASSERT(fmtb(&b, "GET /api/v1/items/%zu from %s finished with status %d after %zu us (cache %s)\n", i, "10.0.0.1", 200, i % 997, i % 3 ? "hit" : "miss"));
+		if (b.len >= 64 * 1024) {
+			bench_use(write(fd, b.buf, b.len));
+			fmtb_reset(&b);
+		}
+	}
+	bench_use(write(fd, b.buf, b.len));
+	double text_time = bench_now() - start;
+	size_t text_size = file_size(path);
+	fmtb_term(&b);
+	close(fd);
+
+	Trace t;
+	ERROR_ASSERT(trace_open(&t, path));
+	start = bench_now();
+	for (size_t i = 0; i < ROUNDS; i++)
+		trace_fmt(&t, "GET /api/v1/items/%zu from %s finished with status %d after %zu us (cache %s)\n", i, "10.0.0.1", 200, i % 997, i % 3 ? "hit" : "miss");
+	ERROR_ASSERT(trace_flush(&t));
+	double trace_time = bench_now() - start;
+	ERROR_ASSERT(trace_close(&t));
+	size_t trace_size = file_size(path);
+
+	printf("%10s %14s %14s\n", "", "ns per event", "bytes/event");
+	printf("%10s %14.1f %14.1f\n", "text", text_time * 1e9 / ROUNDS, (double)text_size / ROUNDS);
+	printf("%10s %14.1f %14.1f\n", "trace", trace_time * 1e9 / ROUNDS, (double)trace_size / ROUNDS);
+	unlink(path);
+	fmt_term();
+}
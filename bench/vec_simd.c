@@ -0,0 +1,81 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec
+#define GENERIC_PREFIX int_vec
+#define GENERIC_SIMD i32
+#include <ds/generic/vec.h>
+
+/* The scalar loops are compiled with -O2, which (with GCC 12 and newer)
+ * auto-vectorizes count and sum for the baseline target but not find. */
+static size_t scalar_find(const int *data, size_t n, int x) {
+	for (size_t i = 0; i < n; i++) {
+		if (data[i] == x)
+			return i;
+	}
+	return n;
+}
+
+static size_t scalar_count_eq(const int *data, size_t n, int x) {
+	size_t res = 0;
+	for (size_t i = 0; i < n; i++)
+		res += data[i] == x;
+	return res;
+}
+
+static int scalar_min(const int *data, size_t n) {
+	int res = data[0];
+	for (size_t i = 1; i < n; i++) {
+		if (data[i] < res)
+			res = data[i];
+	}
+	return res;
+}
+
+static long long scalar_sum(const int *data, size_t n) {
+	long long res = 0;
+	for (size_t i = 0; i < n; i++)
+		res += data[i];
+	return res;
+}
+
+int main() {
+	static const size_t sizes[] = { 1000, 100000, 10000000, 100000000 };
+	printf("%10s %9s %9s %9s %9s %9s %9s %9s %9s\n", "n",
+		"find", "simd", "count", "simd", "min", "simd", "sum", "simd");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		size_t rounds = n >= 100000000 ? 3 : 100000000 / n;
+		IntVec v = int_vec();
+		ERROR_ASSERT(int_vec_resize(&v, n, 0));
+		uint64_t seed = 1;
+		for (size_t i = 0; i < n; i++)
+			v[i] = (int)(bench_rand(&seed) % 1000) + 1; /* never 0, so find scans everything */
+		double t[8] = {0};
+		for (size_t r = 0; r < rounds; r++) {
+			double start;
+			start = bench_now(); bench_use(scalar_find(v, n, 0));      t[0] += bench_now() - start;
+			start = bench_now(); bench_use(int_vec_find(v, 0));        t[1] += bench_now() - start;
+			start = bench_now(); bench_use(scalar_count_eq(v, n, 42)); t[2] += bench_now() - start;
+			start = bench_now(); bench_use(int_vec_count_eq(v, 42));   t[3] += bench_now() - start;
+			start = bench_now(); bench_use(scalar_min(v, n));          t[4] += bench_now() - start;
+			start = bench_now(); bench_use(int_vec_min(v));            t[5] += bench_now() - start;
+			start = bench_now(); bench_use(scalar_sum(v, n));          t[6] += bench_now() - start;
+			start = bench_now(); bench_use(int_vec_sum(v));            t[7] += bench_now() - start;
+		}
+		/* Items per nanosecond. */
+		printf("%10zu", n);
+		for (size_t i = 0; i < 8; i++)
+			printf(" %9.3f", (double)n * rounds / (t[i] * 1e9));
+		printf("\n");
+		int_vec_term(v);
+	}
+}
@@ -0,0 +1,75 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec
+#define GENERIC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_RADIX_KEY(_itm) vec_radix_key_i32(_itm)
+#include <ds/generic/vec.h>
+
+static int cmp_int(const void *a, const void *b) {
+	return (*(int *)a > *(int *)b) - (*(int *)a < *(int *)b);
+}
+
+static void fill(IntVec v, size_t n, uint64_t seed) {
+	for (size_t i = 0; i < n; i++)
+		v[i] = (int)bench_rand(&seed);
+}
+
+int main() {
+	static const size_t sizes[] = { 1000, 100000, 10000000 };
+	ThreadPool pool2, pool4;
+	ERROR_ASSERT(thread_pool_init(&pool2, 2));
+	ERROR_ASSERT(thread_pool_init(&pool4, 4));
+	printf("%10s %10s %10s %10s %10s %10s\n", "n", "qsort", "sort", "radix", "par(2)", "par(4)");
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		size_t n = sizes[s];
+		size_t rounds = 10000000 / n;
+		IntVec v = int_vec();
+		ERROR_ASSERT(int_vec_resize(&v, n, 0));
+		double t[5] = {0};
+		for (size_t r = 0; r < rounds; r++) {
+			double start;
+			fill(v, n, r + 1);
+			start = bench_now();
+			qsort(v, n, sizeof(int), cmp_int);
+			t[0] += bench_now() - start;
+
+			fill(v, n, r + 1);
+			start = bench_now();
+			int_vec_sort(v);
+			t[1] += bench_now() - start;
+
+			fill(v, n, r + 1);
+			start = bench_now();
+			ERROR_ASSERT(int_vec_radix_sort(v));
+			t[2] += bench_now() - start;
+
+			fill(v, n, r + 1);
+			start = bench_now();
+			ERROR_ASSERT(int_vec_sort_parallel(v, &pool2));
+			t[3] += bench_now() - start;
+
+			fill(v, n, r + 1);
+			start = bench_now();
+			ERROR_ASSERT(int_vec_sort_parallel(v, &pool4));
+			t[4] += bench_now() - start;
+		}
+		/* Milliseconds per sort. */
+		printf("%10zu", n);
+		for (size_t i = 0; i < 5; i++)
+			printf(" %10.3f", t[i] * 1e3 / rounds);
+		printf("\n");
+		int_vec_term(v);
+	}
+	thread_pool_term(&pool2);
+	thread_pool_term(&pool4);
+}
@@ -0,0 +1,85 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_BITSET_H__
+#define __DS_BITSET_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ds/error.h>
+
+/* A growable vector of bits, packed 64 to a word. Counting and the set
+ * operations work on whole words (32 bytes at a time with AVX2, picked at
+ * runtime like in ds/simd.h), and counting uses the CPU's popcount
+ * instruction where available.
+ *
+ * Bits past the length are always 0, so binary operations between bitsets
+ * of different lengths treat the shorter one as padded with zeros; the
+ * result keeps dst's length.
+
+Example Usage:
+
+Bitset b = bitset();
+TRY(bitset_resize(&b, 1000), );
+bitset_set(&b, 42);
+for (size_t i = bitset_next_set_bit(&b, 0); i < bitset_len(&b); i = bitset_next_set_bit(&b, i + 1))
+	fmt("%zu\n", i);
+bitset_term(&b);
+
+// Printing (takes a pointer, prints the bits from index 0 as 0s and 1s):
+bitset_fmt_register();
+fmt("%{Bitset}", &b);
+
+*/
+
+typedef struct Bitset {
+	uint64_t *words;
+	size_t len; /* in bits */
+	size_t cap; /* in words */
+} Bitset;
+
+Bitset bitset();
+void bitset_term(Bitset *b);
+void bitset_fmt_register();
+static inline size_t bitset_len(const Bitset *b) { return b->len; }
+/* Changes the length to n bits; new bits are 0. */
+Error bitset_resize(Bitset *b, size_t n);
+Error bitset_push(Bitset *b, bool bit);
+static inline bool bitset_test(const Bitset *b, size_t i) { return (b->words[i / 64] >> (i % 64)) & 1; }
+static inline void bitset_set(Bitset *b, size_t i) { b->words[i / 64] |= (uint64_t)1 << (i % 64); }
+static inline void bitset_clear(Bitset *b, size_t i) { b->words[i / 64] &= ~((uint64_t)1 << (i % 64)); }
+static inline void bitset_assign(Bitset *b, size_t i, bool bit) {
+	b->words[i / 64] = (b->words[i / 64] & ~((uint64_t)1 << (i % 64))) | ((uint64_t)bit << (i % 64));
+}
+/* Sets every bit to bit. */
+void bitset_fill(Bitset *b, bool bit);
+/* Number of set bits. */
+size_t bitset_count(const Bitset *b);
+/* dst = dst OP src */
+void bitset_and(Bitset *dst, const Bitset *src);
+void bitset_or(Bitset *dst, const Bitset *src);
+void bitset_xor(Bitset *dst, const Bitset *src);
+/* dst = dst & ~src */
+void bitset_andnot(Bitset *dst, const Bitset *src);
+/* Index of the first set bit at or after i, or bitset_len() if there is none. */
+size_t bitset_next_set_bit(const Bitset *b, size_t i);
+
+/* Index for rank and select queries on a bitset, using one 64-bit count per
+ * 512 bits (12.5% extra memory). It is a snapshot: modifying the bitset
+ * afterwards requires building it again. */
+typedef struct BitsetRank {
+	uint64_t *blocks; /* number of set bits before each block */
+	size_t n_blocks;
+} BitsetRank;
+
+Error bitset_rank_build(BitsetRank *r, const Bitset *b);
+void bitset_rank_term(BitsetRank *r);
+/* Number of set bits before index i (i may be bitset_len()); O(1). */
+size_t bitset_rank(const BitsetRank *r, const Bitset *b, size_t i);
+/* Index of the set bit with rank k (so the first one for k = 0), or
+ * bitset_len() if there are at most k set bits; O(log n). */
+size_t bitset_select(const BitsetRank *r, const Bitset *b, size_t k);
+
+#endif
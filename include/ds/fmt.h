@@ -5,8 +5,11 @@
 #define __DS_FMT_H__
 
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include <ds/error.h>
 
@@ -18,21 +21,35 @@
  *
  * putc_func is the fundamental function which "writes" a char in whatever
  * way the context requires.
- * ctx_data serves as input, output or both to putc_func.
+ * write_func is optional and writes n chars at once; without it, putc_func is
+ * called for each char. Runs of literal text, strings, numbers and padding are
+ * written with it, so it saves an indirect call per char.
+ * ctx_data serves as input, output or both to putc_func and write_func.
  *
  * For example, in the fmt functions which write to string buffers, ctx_data
  * holds the buffer, its size and how many bytes were written so far. */
 typedef struct FmtContext {
 	void *ctx_data;
 	void (*putc_func)(struct FmtContext *restrict ctx, char c);
+	void (*write_func)(struct FmtContext *restrict ctx, const char *restrict buf, size_t n);
 } FmtContext;
 
+/* Writes n chars to ctx; use this in print functions. */
+static inline void fmt_write(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	if (ctx->write_func != NULL)
+		ctx->write_func(ctx, buf, n);
+	else {
+		for (size_t i = 0; i < n; i++)
+			ctx->putc_func(ctx, buf[i]);
+	}
+}
+
 /* FmtAttrs holds attributes that are passed like additional parameters to a
  * print function. Which attributes are valid is entirely dependent on the
  * print function and the type being printed.
  *
- * len is the number of attributes, names contains the attribute names and
- * vals contains the attribute values (default is -1 if no value is given).
+ * len is the number of attributes, ids contains the attribute IDs and vals
+ * contains the attribute values (default is -1 if no value is given).
  *
  * For example, when printing an integer, you could use: %{int:p=4,c='0'}, where
  * p is the width, the rest of which is filled in by c. Resulting in an integer
@@ -40,13 +57,40 @@ typedef struct FmtContext {
  * integer or char values, or no value at all (e.g. %{int:X} just sets the "X"
  * attribute with a default value of -1).
  *
+ * Floating point numbers (%{double}) are printed with the fewest digits which
+ * parse back to the same value. %{double:prec=3} prints 3 digits after the
+ * decimal point instead, and the attributes e, f and g select the notation of
+ * printf's %e, %f and %g, including its default precision of 6.
+ *
+ * Attribute names are interned: format strings are parsed into FmtAttrIds,
+ * which print functions switch on. The builtin attributes have fixed IDs;
+ * custom print functions get IDs for theirs from fmt_attr_register(), up
+ * front, since a format string using an unknown attribute name fails to parse.
+ *
  * When creating a custom print function, you have to iterate over the FmtAttrs
  * manually. See src/ds/fmt.c for reference examples.
  * */
+typedef uint16_t FmtAttrId;
+
+enum {
+	FmtAttrPad = 1,  /* p */
+	FmtAttrPadChar,  /* c */
+	FmtAttrHex,      /* x */
+	FmtAttrHexUpper, /* X */
+	FmtAttrOctal,    /* o */
+	FmtAttrBase,     /* b */
+	FmtAttrFixed,    /* f */
+	FmtAttrExp,      /* e */
+	FmtAttrGeneral,  /* g */
+	FmtAttrPrec,     /* prec */
+	FmtAttrDestroy,  /* destroy */
+	FmtAttrBuiltinEnd,
+};
+
 typedef struct FmtAttrs {
-	size_t len;
-	char   names[FMT_MAX_ATTRS][FMT_MAX_ATTR_LEN];
-	int    vals[FMT_MAX_ATTRS]; /* number/char value */
+	size_t    len;
+	FmtAttrId ids[FMT_MAX_ATTRS];
+	int       vals[FMT_MAX_ATTRS]; /* number/char value */
 } FmtAttrs;
 
 /* FmtPrintFuncRet is the return value of a print function. It can either
@@ -66,8 +110,20 @@ typedef struct FmtPrintFuncRet {
  * type so fmt functions can output it. */
 typedef FmtPrintFuncRet (*FmtPrintFunc)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v);
 
-/* Add a formatter for your custom types. See src/ds/fmt.c for some examples. */
-void fmt_register(const char *keyword, FmtPrintFunc print_func);
+/* Returns the ID of an attribute name, registering it if it's new. Like
+ * fmt_register(), this copies the registry, so do it up front. */
+FmtAttrId fmt_attr_register(const char *restrict name);
+/* The name of a registered attribute. */
+const char *fmt_attr_name(FmtAttrId id);
+
+/* Add a formatter for your custom types. See src/ds/fmt.c for some examples.
+ *
+ * Formatting is safe from any number of threads, and never waits for another
+ * thread, not even while one registers: readers of the registry only write to
+ * a slot of their own. Registering copies the whole registry, so do it up
+ * front rather than in a loop. fmt_init() and fmt_term() must not run
+ * concurrently with anything else. */
+void fmt_register(const char *restrict keyword, FmtPrintFunc print_func);
 
 void _fmtv(const char *restrict file, size_t line, const char *restrict format, va_list args);
 void _fmt(const char *restrict file, size_t line, const char *restrict format, ...);
@@ -86,6 +142,206 @@ void _fmtc(const char *restrict file, size_t line, FmtContext *ctx, const char *
 #define fmtcv(ctx, format, ...) _fmtcv(__FILE__, __LINE__, ctx, format, ##__VA_ARGS__)
 #define fmtc(ctx, format, ...) _fmtc(__FILE__, __LINE__, ctx, format, ##__VA_ARGS__)
 
+/* A growable string to format into. After any successful fmtb call, buf is
+ * null terminated and len is its length without the terminator. Reuse an
+ * FmtBuf with fmtb_reset() to keep its memory; once it has grown large enough,
+ * formatting into it doesn't allocate at all. */
+typedef struct FmtBuf {
+	char *buf;
+	size_t len, cap;
+} FmtBuf;
+
+static inline FmtBuf fmt_buf() { return (FmtBuf){0}; }
+void fmtb_term(FmtBuf *b);
+/* Empties b, keeping its memory. */
+static inline void fmtb_reset(FmtBuf *b) {
+	b->len = 0;
+	if (b->buf != NULL)
+		b->buf[0] = 0;
+}
+Error _fmtb_reserve_slow(FmtBuf *b, size_t additional);
+/* Makes sure additional chars (and the terminator) fit without growing. */
+static inline Error fmtb_reserve(FmtBuf *b, size_t additional) {
+	if (b->buf != NULL && b->len + additional < b->cap)
+		return OK();
+	return _fmtb_reserve_slow(b, additional);
+}
+/* Appends n chars of s. */
+static inline Error fmtb_append(FmtBuf *restrict b, const char *restrict s, size_t n) {
+	TRY(fmtb_reserve(b, n), );
+	memcpy(b->buf + b->len, s, n);
+	b->len += n;
+	b->buf[b->len] = 0;
+	return OK();
+}
+
+char *_fmtav(const char *restrict file, size_t line, size_t *restrict out_len, const char *restrict format, va_list args);
+char *_fmta(const char *restrict file, size_t line, size_t *restrict out_len, const char *restrict format, ...);
+Error _fmtbv(const char *restrict file, size_t line, FmtBuf *restrict b, const char *restrict format, va_list args);
+Error _fmtb(const char *restrict file, size_t line, FmtBuf *restrict b, const char *restrict format, ...);
+
+/* Format to a new string, which must be freed. Returns NULL if out of memory;
+ * sets *out_len to the length, unless out_len is NULL. Unlike measuring with
+ * fmts(NULL, 0, ...) first, this formats only once. */
+#define fmtav(out_len, format, ...) _fmtav(__FILE__, __LINE__, out_len, format, ##__VA_ARGS__)
+#define fmta(out_len, format, ...) _fmta(__FILE__, __LINE__, out_len, format, ##__VA_ARGS__)
+/* Format, appending to an FmtBuf. If out of memory, nothing is appended. */
+#define fmtbv(b, format, ...) _fmtbv(__FILE__, __LINE__, b, format, ##__VA_ARGS__)
+#define fmtb(b, format, ...) _fmtb(__FILE__, __LINE__, b, format, ##__VA_ARGS__)
+
+/* A format string parsed ahead of time by fmt_compile(). Printing with it
+ * skips parsing the format and looking up the print functions, which is most
+ * of the cost of a call with few arguments.
+ *
+ * The print functions are looked up when compiling, so later calls to
+ * fmt_register() don't affect it. A compiled format can be used by several
+ * threads at once, as long as the print functions it calls don't modify their
+ * attrs (none of the builtin ones do). */
+typedef struct FmtCompiled FmtCompiled;
+
+/* Returns the same errors fmtc() would for format; format may be freed
+ * afterwards. */
+Error fmt_compile(FmtCompiled **res, const char *restrict format);
+void fmt_compiled_term(FmtCompiled *f);
+
+void _fmt_compiledv(const char *restrict file, size_t line, const FmtCompiled *restrict f, va_list args);
+void _fmt_compiled(const char *restrict file, size_t line, const FmtCompiled *restrict f, ...);
+size_t _fmts_compiledv(const char *restrict file, size_t line, char *restrict buf, size_t size, const FmtCompiled *restrict f, va_list args);
+size_t _fmts_compiled(const char *restrict file, size_t line, char *restrict buf, size_t size, const FmtCompiled *restrict f, ...);
+void _fmtc_compiledv(const char *restrict file, size_t line, FmtContext *ctx, const FmtCompiled *restrict f, va_list args);
+void _fmtc_compiled(const char *restrict file, size_t line, FmtContext *ctx, const FmtCompiled *restrict f, ...);
+char *_fmta_compiledv(const char *restrict file, size_t line, size_t *restrict out_len, const FmtCompiled *restrict f, va_list args);
+char *_fmta_compiled(const char *restrict file, size_t line, size_t *restrict out_len, const FmtCompiled *restrict f, ...);
+Error _fmtb_compiledv(const char *restrict file, size_t line, FmtBuf *restrict b, const FmtCompiled *restrict f, va_list args);
+Error _fmtb_compiled(const char *restrict file, size_t line, FmtBuf *restrict b, const FmtCompiled *restrict f, ...);
+
+/* Like the functions above, but with a compiled format. */
+#define fmt_compiledv(f, ...) _fmt_compiledv(__FILE__, __LINE__, f, ##__VA_ARGS__)
+#define fmt_compiled(f, ...) _fmt_compiled(__FILE__, __LINE__, f, ##__VA_ARGS__)
+#define fmts_compiledv(buf, size, f, ...) _fmts_compiledv(__FILE__, __LINE__, buf, size, f, ##__VA_ARGS__)
+#define fmts_compiled(buf, size, f, ...) _fmts_compiled(__FILE__, __LINE__, buf, size, f, ##__VA_ARGS__)
+#define fmtc_compiledv(ctx, f, ...) _fmtc_compiledv(__FILE__, __LINE__, ctx, f, ##__VA_ARGS__)
+#define fmtc_compiled(ctx, f, ...) _fmtc_compiled(__FILE__, __LINE__, ctx, f, ##__VA_ARGS__)
+#define fmta_compiledv(out_len, f, ...) _fmta_compiledv(__FILE__, __LINE__, out_len, f, ##__VA_ARGS__)
+#define fmta_compiled(out_len, f, ...) _fmta_compiled(__FILE__, __LINE__, out_len, f, ##__VA_ARGS__)
+#define fmtb_compiledv(b, f, ...) _fmtb_compiledv(__FILE__, __LINE__, b, f, ##__VA_ARGS__)
+#define fmtb_compiled(b, f, ...) _fmtb_compiled(__FILE__, __LINE__, b, f, ##__VA_ARGS__)
+
+/* A format compiled on first use, for macros like log_fmt() which take a
+ * format string but want to print it compiled: each call site declares a
+ * static FmtSite. Sites are numbered from 0 in the order they are compiled,
+ * e.g. to refer to their format in a file. fmt_term() frees the compiled
+ * formats of all sites and resets them, so nothing may still use them then. */
+typedef struct FmtSite {
+	_Atomic(FmtCompiled *) f;
+	uint32_t id;
+	struct FmtSite *next; /* all compiled sites */
+} FmtSite;
+
+FmtCompiled *_fmt_site_compile(const char *restrict file, size_t line, FmtSite *site, const char *restrict format);
+static inline FmtCompiled *_fmt_site_get(const char *restrict file, size_t line, FmtSite *site, const char *restrict format) {
+	FmtCompiled *f = atomic_load_explicit(&site->f, memory_order_acquire);
+	if (f == NULL)
+		f = _fmt_site_compile(file, line, site, format);
+	return f;
+}
+
+/* Returns the compiled format of site, compiling format on the first call.
+ * Like fmtc(), this fails fatally if the format is invalid. */
+#define fmt_site_get(site, format) _fmt_site_get(__FILE__, __LINE__, site, format)
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/uio.h>
+#define FMT_FD_SUPPORT
+#endif
+
+#ifdef FMT_FD_SUPPORT
+
+#define FMT_FD_DEFAULT_BUF_SIZE (64 * 1024)
+/* Strings at least this long are written from where they are in scatter mode. */
+#define FMT_FD_SCATTER_MIN (32 * 1024)
+#define FMT_FD_MAX_IOVECS  32
+
+/* Buffered output to a file descriptor, for writing out large amounts of text.
+ * Output collects in a page aligned buffer, which is only written, with a
+ * single write() or writev(), once it is full or on fmt_fd_flush(); unlike
+ * FILE, there's no locking or per char call into libc.
+ *
+ * In scatter mode, fmtfd() doesn't copy string arguments of at least
+ * FMT_FD_SCATTER_MIN chars (printed with plain %s) into the buffer, but
+ * passes them to writev() as they are. Since they're only valid during the
+ * call, a call which printed any such string ends with a writev() of
+ * everything so far.
+ *
+ * Write errors don't stop formatting; the first one is kept in write_errno
+ * and reported by fmt_fd_flush(). */
+typedef struct FmtFd {
+	int fd;
+	bool scatter;
+	int write_errno;
+	char *buf;
+	size_t len, cap;
+	size_t seg_start; /* start of the chars in buf which aren't in iov yet */
+	struct iovec iov[FMT_FD_MAX_IOVECS]; /* pending writes, in order */
+	size_t n_iov;
+} FmtFd;
+
+/* buf_size is rounded up to whole pages; 0 means FMT_FD_DEFAULT_BUF_SIZE.
+ * out doesn't own fd. */
+Error fmt_fd_init(FmtFd *out, int fd, size_t buf_size, bool scatter);
+/* Flushes and frees the buffer; out can't be used anymore, even on error. */
+Error fmt_fd_term(FmtFd *out);
+/* Writes everything buffered so far. Fails if a write failed since the last
+ * flush. */
+Error fmt_fd_flush(FmtFd *out);
+/* A context which writes to out, e.g. for fmtc() or fmtc_captured(). It
+ * always copies. */
+FmtContext fmt_fd_context(FmtFd *out);
+/* Writes n bytes as they are. */
+void fmt_fd_write(FmtFd *restrict out, const void *restrict buf, size_t n);
+
+void _fmtfdv(const char *restrict file, size_t line, FmtFd *restrict out, const char *restrict format, va_list args);
+void _fmtfd(const char *restrict file, size_t line, FmtFd *restrict out, const char *restrict format, ...);
+void _fmtfd_compiledv(const char *restrict file, size_t line, FmtFd *restrict out, const FmtCompiled *restrict f, va_list args);
+void _fmtfd_compiled(const char *restrict file, size_t line, FmtFd *restrict out, const FmtCompiled *restrict f, ...);
+
+/* Format to a buffered file descriptor. */
+#define fmtfdv(out, format, ...) _fmtfdv(__FILE__, __LINE__, out, format, ##__VA_ARGS__)
+#define fmtfd(out, format, ...) _fmtfd(__FILE__, __LINE__, out, format, ##__VA_ARGS__)
+#define fmtfd_compiledv(out, f, ...) _fmtfd_compiledv(__FILE__, __LINE__, out, f, ##__VA_ARGS__)
+#define fmtfd_compiled(out, f, ...) _fmtfd_compiled(__FILE__, __LINE__, out, f, ##__VA_ARGS__)
+
+#endif
+
+/* Deferred formatting, e.g. for logging from another thread: the arguments of
+ * a compiled format are captured now and printed later. Arguments are copied
+ * by value, except that strings are copied whole and errors are captured as
+ * text.
+ *
+ * Custom types can only be captured once they have a capture function, which
+ * copies its argument out of v, e.g. with fmtb_append(). print_captured then
+ * prints the copy, getting a const void * to it (8 byte aligned) as its only
+ * argument. The copy can't own any resources, since it may never be printed.
+ * The builtin types all have capture functions. */
+typedef Error (*FmtCaptureFunc)(FmtBuf *restrict out, FmtAttrs *restrict attrs, va_list v);
+/* keyword must already be registered. Like fmt_register(), this only affects
+ * formats compiled afterwards. */
+void fmt_register_capture(const char *restrict keyword, FmtCaptureFunc capture, FmtPrintFunc print_captured);
+
+/* Appends the captured arguments to out. Fails (appending nothing) if f prints
+ * a type without a capture function. */
+Error fmt_compiled_capturev(FmtBuf *restrict out, const FmtCompiled *restrict f, va_list args);
+Error fmt_compiled_capture(FmtBuf *restrict out, const FmtCompiled *restrict f, ...);
+/* Whether captured arguments of f lie within size bytes, checking every
+ * argument, including string terminators and the sizes of custom types. Use
+ * it before printing captured arguments which may be corrupt, e.g. read from a
+ * file; the contents of a custom type's copy still aren't checked. */
+bool fmt_captured_fits(const FmtCompiled *restrict f, const void *restrict captured, size_t size);
+/* Prints f with captured arguments, which must start 8 byte aligned. */
+Error fmtc_captured(FmtContext *restrict ctx, const FmtCompiled *restrict f, const void *restrict captured);
+/* Appends f with captured arguments to b. */
+Error fmtb_captured(FmtBuf *restrict b, const FmtCompiled *restrict f, const void *restrict captured);
+
 void fmt_init();
 void fmt_term();
 
@@ -0,0 +1,262 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A double-ended queue stored in a ring buffer whose capacity is always a
+ * power of two. Pushing and popping at either end is O(1), so unlike a vec it
+ * can be used as a FIFO queue. Like svec.h, the deque is a struct and
+ * functions which may modify it take a pointer.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntDeque      // Name of the resulting deque type
+#define GENERIC_PREFIX int_deque   // Prefix for functions
+#include "deque.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+// Printing (takes a pointer):
+fmt("%{IntDeque}", &d);
+
+*/
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+typedef struct NAME {
+	TYPE *data;
+	size_t cap; /* 0 or a power of two */
+	size_t head; /* index of the front item in data */
+	size_t len;
+} NAME;
+
+VARDECL(_Atomic(const char *), __val_fmt);
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME *d);
+FUNCDECL(void, _fmt_register)(const char *val_fmt);
+static inline FUNCDEF(size_t, _len)(const NAME *d) { return d->len; }
+static inline FUNCDEF(size_t, _cap)(const NAME *d) { return d->cap; }
+/* Item idx counted from the front. */
+static inline FUNCDEF(TYPE *, _at)(NAME *d, size_t idx) { return &d->data[(d->head + idx) & (d->cap - 1)]; }
+static inline FUNCDEF(TYPE *, _front)(NAME *d) { return FUNC(_at)(d, 0); }
+static inline FUNCDEF(TYPE *, _back)(NAME *d) { return FUNC(_at)(d, d->len - 1); }
+FUNCDECL(Error, _fit)(NAME *d, size_t new_minimum_cap);
+FUNCDECL(Error, _push_back)(NAME *d, TYPE val);
+FUNCDECL(Error, _push_front)(NAME *d, TYPE val);
+FUNCDECL(TYPE, _pop_back)(NAME *d);
+FUNCDECL(TYPE, _pop_front)(NAME *d);
+/* Bulk versions; each copies with at most two memcpy() calls. items[0] ends
+ * up at the front for _push_front_n, just as for _push_back_n. */
+FUNCDECL(Error, _push_back_n)(NAME *d, const TYPE *items, size_t n);
+FUNCDECL(Error, _push_front_n)(NAME *d, const TYPE *items, size_t n);
+/* Remove up to n items and return how many were removed. If dst isn't NULL,
+ * the items are moved there in deque order (so they are not terminated);
+ * otherwise they are terminated with GENERIC_TERM_ITEM. */
+FUNCDECL(size_t, _pop_front_n)(NAME *d, TYPE *dst, size_t n);
+FUNCDECL(size_t, _pop_back_n)(NAME *d, TYPE *dst, size_t n);
+FUNCDECL(void, _clear)(NAME *d);
+
+#ifdef GENERIC_IMPL
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
+
+static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	NAME *d = va_arg(v, NAME *);
+	ctx->putc_func(ctx, '{');
+	for (size_t i = 0; i < d->len; i++) {
+		if (i != 0)
+			fmtc(ctx, ", ");
+		fmtc(ctx, VAR(__val_fmt), *FUNC(_at)(d, i));
+	}
+	ctx->putc_func(ctx, '}');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+/* Copies n items from items into the deque starting at position idx (counted
+ * from the front), which must already be within the capacity. */
+static FUNCDEF(void, __copy_in)(NAME *d, size_t idx, const TYPE *items, size_t n) {
+	size_t start = (d->head + idx) & (d->cap - 1);
+	size_t first = d->cap - start < n ? d->cap - start : n;
+	memcpy(d->data + start, items, sizeof(TYPE) * first);
+	memcpy(d->data, items + first, sizeof(TYPE) * (n - first));
+}
+
+/* The inverse of __copy_in. */
+static FUNCDEF(void, __copy_out)(const NAME *d, size_t idx, TYPE *dst, size_t n) {
+	size_t start = (d->head + idx) & (d->cap - 1);
+	size_t first = d->cap - start < n ? d->cap - start : n;
+	memcpy(dst, d->data + start, sizeof(TYPE) * first);
+	memcpy(dst + first, d->data, sizeof(TYPE) * (n - first));
+}
+
+FUNCDEF(NAME, )() {
+	return (NAME){0};
+}
+
+FUNCDEF(void, _term)(NAME *d) {
+	for (size_t i = 0; i < d->len; i++) {
+		GENERIC_TERM_ITEM((*FUNC(_at)(d, i)));
+	}
+	free(d->data);
+}
+
+FUNCDEF(void, _fmt_register)(const char *val_fmt) {
+	VAR(__val_fmt) = val_fmt;
+	fmt_register(NAME_STR, FUNC(__print_func));
+}
+
+FUNCDEF(Error, _fit)(NAME *d, size_t new_minimum_cap) {
+	size_t min = new_minimum_cap < d->len ? d->len : new_minimum_cap;
+	size_t new_cap = 0;
+	if (min != 0) {
+		new_cap = 1;
+		while (new_cap < min)
+			new_cap *= 2;
+	}
+	if (new_cap == d->cap)
+		return OK();
+	if (new_cap > d->cap) {
+		TYPE *new_data = realloc(d->data, sizeof(TYPE) * new_cap);
+		if (new_data == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		d->data = new_data;
+		if (d->head + d->len > d->cap) {
+			/* The items wrap around the old end; since the capacity at
+			 * least doubled, either part fits behind it, so move the
+			 * shorter one. */
+			size_t n_head = d->cap - d->head, n_wrapped = d->len - n_head;
+			if (n_wrapped <= n_head) {
+				memcpy(d->data + d->cap, d->data, sizeof(TYPE) * n_wrapped);
+			} else {
+				memcpy(d->data + new_cap - n_head, d->data + d->head, sizeof(TYPE) * n_head);
+				d->head = new_cap - n_head;
+			}
+		}
+	} else {
+		TYPE *new_data = NULL;
+		if (new_cap != 0) {
+			new_data = malloc(sizeof(TYPE) * new_cap);
+			if (new_data == NULL)
+				return ERROR_OUT_OF_MEMORY();
+			FUNC(__copy_out)(d, 0, new_data, d->len);
+		}
+		free(d->data);
+		d->data = new_data;
+		d->head = 0;
+	}
+	d->cap = new_cap;
+	return OK();
+}
+
+static FUNCDEF(Error, __reserve)(NAME *d, size_t additional) {
+	size_t needed = d->len + additional;
+	if (needed <= d->cap)
+		return OK();
+	size_t new_cap = d->cap == 0 ? 8 : d->cap * 2;
+	return FUNC(_fit)(d, new_cap < needed ? needed : new_cap);
+}
+
+FUNCDEF(Error, _push_back)(NAME *d, TYPE val) {
+	TRY(FUNC(__reserve)(d, 1), );
+	d->data[(d->head + d->len++) & (d->cap - 1)] = val;
+	return OK();
+}
+
+FUNCDEF(Error, _push_front)(NAME *d, TYPE val) {
+	TRY(FUNC(__reserve)(d, 1), );
+	d->head = (d->head - 1) & (d->cap - 1);
+	d->data[d->head] = val;
+	d->len++;
+	return OK();
+}
+
+FUNCDEF(TYPE, _pop_back)(NAME *d) {
+	TYPE val = *FUNC(_back)(d);
+	GENERIC_TERM_ITEM((val));
+	d->len--;
+	return val;
+}
+
+FUNCDEF(TYPE, _pop_front)(NAME *d) {
+	TYPE val = d->data[d->head];
+	GENERIC_TERM_ITEM((val));
+	d->head = (d->head + 1) & (d->cap - 1);
+	d->len--;
+	return val;
+}
+
+FUNCDEF(Error, _push_back_n)(NAME *d, const TYPE *items, size_t n) {
+	if (n == 0)
+		return OK();
+	TRY(FUNC(__reserve)(d, n), );
+	FUNC(__copy_in)(d, d->len, items, n);
+	d->len += n;
+	return OK();
+}
+
+FUNCDEF(Error, _push_front_n)(NAME *d, const TYPE *items, size_t n) {
+	if (n == 0)
+		return OK();
+	TRY(FUNC(__reserve)(d, n), );
+	d->head = (d->head - n) & (d->cap - 1);
+	d->len += n;
+	FUNC(__copy_in)(d, 0, items, n);
+	return OK();
+}
+
+FUNCDEF(size_t, _pop_front_n)(NAME *d, TYPE *dst, size_t n) {
+	if (n > d->len)
+		n = d->len;
+	if (n == 0)
+		return 0;
+	if (dst != NULL)
+		FUNC(__copy_out)(d, 0, dst, n);
+	else {
+		for (size_t i = 0; i < n; i++) {
+			GENERIC_TERM_ITEM((*FUNC(_at)(d, i)));
+		}
+	}
+	d->head = (d->head + n) & (d->cap - 1);
+	d->len -= n;
+	return n;
+}
+
+FUNCDEF(size_t, _pop_back_n)(NAME *d, TYPE *dst, size_t n) {
+	if (n > d->len)
+		n = d->len;
+	if (n == 0)
+		return 0;
+	if (dst != NULL)
+		FUNC(__copy_out)(d, d->len - n, dst, n);
+	else {
+		for (size_t i = d->len - n; i < d->len; i++) {
+			GENERIC_TERM_ITEM((*FUNC(_at)(d, i)));
+		}
+	}
+	d->len -= n;
+	return n;
+}
+
+FUNCDEF(void, _clear)(NAME *d) {
+	FUNC(_pop_front_n)(d, NULL, d->len);
+	d->head = 0;
+}
+
+#endif
+
+#include "../internal/generic/end.h"
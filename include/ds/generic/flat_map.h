@@ -0,0 +1,274 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* An ordered map stored as two sorted arrays, one of keys and one of values.
+ * Compared to map.h, it uses no memory besides the keys and values
+ * themselves, iterates in key order over contiguous memory, and lookups are a
+ * branchless binary search over the keys only. Inserting or deleting a single
+ * key moves everything after it, so build larger maps with _insert_batch,
+ * which merges a whole batch in one pass.
+ *
+ * The items are m->keys[i] and m->vals[i] for i < m->len, in ascending key
+ * order.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_KEY_TYPE int            // Key type
+#define GENERIC_VALUE_TYPE int          // Value type
+#define GENERIC_NAME IntIntFlatMap      // Name of the resulting map type
+#define GENERIC_PREFIX int_int_flat_map // Prefix for functions
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b))) // Key comparison
+#include "flat_map.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+// Printing (takes a pointer):
+int_int_flat_map_fmt_register("%d", "%d");
+fmt("%{IntIntFlatMap}", &m);
+
+Optional configuration (define before including flat_map.h):
+
+// Terminates a value when it is removed.
+#define GENERIC_TERM_ITEM(_val) free(_val)
+
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#ifndef GENERIC_CMP
+#error GENERIC_CMP must be defined before including flat_map.h
+#endif
+
+#define GENERIC_REQUIRE_VALUE_TYPE
+#define GENERIC_REQUIRE_KEY_TYPE
+#include "../internal/generic/begin.h"
+
+#define ITEM_TYPE GENERIC_CONCAT(NAME, Item)
+
+typedef struct NAME {
+	KTYPE *keys;
+	VTYPE *vals;
+	size_t len, cap;
+} NAME;
+
+/* A key-value pair for _insert_batch. */
+typedef struct ITEM_TYPE {
+	KTYPE key;
+	VTYPE val;
+} ITEM_TYPE;
+
+VARDECL(_Atomic(const char *), __key_fmt);
+VARDECL(_Atomic(const char *), __val_fmt);
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME *m);
+FUNCDECL(void, _fmt_register)(const char *key_fmt, const char *val_fmt);
+static inline FUNCDEF(size_t, _len)(const NAME *m) { return m->len; }
+/* Index of the first key not less than key (m->len if there is none). */
+FUNCDECL(size_t, _lower_bound)(const NAME *m, KTYPE key);
+FUNCDECL(VTYPE *, _get)(const NAME *m, KTYPE key);
+/* Like in map.h, a replaced value isn't terminated. */
+FUNCDECL(Error, _set)(NAME *m, KTYPE key, VTYPE val);
+FUNCDECL(bool, _del)(NAME *m, KTYPE key);
+FUNCDECL(Error, _reserve)(NAME *m, size_t additional);
+/* Sets all n items, reordering the items array. Costs O(n log n + len)
+ * instead of the O(n * len) of n calls to _set. If a key occurs more than
+ * once in items, the last occurrence wins; as with _set, replaced values
+ * (including those of earlier occurrences) aren't terminated. */
+FUNCDECL(Error, _insert_batch)(NAME *m, ITEM_TYPE *items, size_t n);
+
+#ifdef GENERIC_IMPL
+VARDEF(_Atomic(const char *), __key_fmt) = NULL;
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
+
+#include <stdlib.h>
+#include <string.h>
+
+static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	NAME *m = va_arg(v, NAME *);
+	ctx->putc_func(ctx, '{');
+	for (size_t i = 0; i < m->len; i++) {
+		if (i != 0)
+			fmtc(ctx, ", ");
+		fmtc(ctx, VAR(__key_fmt), m->keys[i]);
+		fmtc(ctx, ": ");
+		fmtc(ctx, VAR(__val_fmt), m->vals[i]);
+	}
+	ctx->putc_func(ctx, '}');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+FUNCDEF(NAME, )() {
+	return (NAME){0};
+}
+
+FUNCDEF(void, _term)(NAME *m) {
+	for (size_t i = 0; i < m->len; i++) {
+		GENERIC_TERM_ITEM((m->vals[i]));
+	}
+	free(m->keys);
+	free(m->vals);
+}
+
+FUNCDEF(void, _fmt_register)(const char *key_fmt, const char *val_fmt) {
+	VAR(__key_fmt) = key_fmt;
+	VAR(__val_fmt) = val_fmt;
+	fmt_register(NAME_STR, FUNC(__print_func));
+}
+
+FUNCDEF(size_t, _lower_bound)(const NAME *m, KTYPE key) {
+	if (m->len == 0)
+		return 0;
+	/* The answer is always within [base, base + n]; the ternary compiles to a
+	 * conditional move, so the loop has no unpredictable branches. */
+	const KTYPE *base = m->keys;
+	size_t n = m->len;
+	while (n > 1) {
+		size_t half = n / 2;
+		base = GENERIC_CMP(base[half], key) < 0 ? base + half : base;
+		n -= half;
+	}
+	return (size_t)(base - m->keys) + (GENERIC_CMP(*base, key) < 0);
+}
+
+FUNCDEF(VTYPE *, _get)(const NAME *m, KTYPE key) {
+	size_t i = FUNC(_lower_bound)(m, key);
+	if (i == m->len || GENERIC_CMP(m->keys[i], key) != 0)
+		return NULL;
+	return &m->vals[i];
+}
+
+FUNCDEF(Error, _reserve)(NAME *m, size_t additional) {
+	size_t needed = m->len + additional;
+	if (needed <= m->cap)
+		return OK();
+	size_t new_cap = m->cap == 0 ? 8 : m->cap * 2;
+	if (new_cap < needed)
+		new_cap = needed;
+	KTYPE *keys = realloc(m->keys, sizeof(KTYPE) * new_cap);
+	if (keys == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	m->keys = keys;
+	VTYPE *vals = realloc(m->vals, sizeof(VTYPE) * new_cap);
+	if (vals == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	m->vals = vals;
+	m->cap = new_cap;
+	return OK();
+}
+
+FUNCDEF(Error, _set)(NAME *m, KTYPE key, VTYPE val) {
+	size_t i = FUNC(_lower_bound)(m, key);
+	if (i < m->len && GENERIC_CMP(m->keys[i], key) == 0) {
+		m->vals[i] = val;
+		return OK();
+	}
+	TRY(FUNC(_reserve)(m, 1), );
+	memmove(m->keys + i + 1, m->keys + i, sizeof(KTYPE) * (m->len - i));
+	memmove(m->vals + i + 1, m->vals + i, sizeof(VTYPE) * (m->len - i));
+	m->keys[i] = key;
+	m->vals[i] = val;
+	m->len++;
+	return OK();
+}
+
+FUNCDEF(bool, _del)(NAME *m, KTYPE key) {
+	size_t i = FUNC(_lower_bound)(m, key);
+	if (i == m->len || GENERIC_CMP(m->keys[i], key) != 0)
+		return false;
+	GENERIC_TERM_ITEM((m->vals[i]));
+	m->len--;
+	memmove(m->keys + i, m->keys + i + 1, sizeof(KTYPE) * (m->len - i));
+	memmove(m->vals + i, m->vals + i + 1, sizeof(VTYPE) * (m->len - i));
+	return true;
+}
+
+/* Stable merge sort of the batch by key, so the last of several equal keys
+ * stays last. */
+static FUNCDEF(void, __sort_items)(ITEM_TYPE *a, ITEM_TYPE *tmp, size_t n) {
+	if (n <= 16) {
+		for (size_t i = 1; i < n; i++) {
+			ITEM_TYPE x = a[i];
+			size_t j = i;
+			for (; j > 0 && GENERIC_CMP(a[j - 1].key, x.key) > 0; j--)
+				a[j] = a[j - 1];
+			a[j] = x;
+		}
+		return;
+	}
+	size_t mid = n / 2;
+	FUNC(__sort_items)(a, tmp, mid);
+	FUNC(__sort_items)(a + mid, tmp, n - mid);
+	if (GENERIC_CMP(a[mid - 1].key, a[mid].key) <= 0)
+		return;
+	memcpy(tmp, a, sizeof(ITEM_TYPE) * mid);
+	size_t i = 0, j = mid, k = 0;
+	while (i < mid && j < n)
+		a[k++] = GENERIC_CMP(a[j].key, tmp[i].key) < 0 ? a[j++] : tmp[i++];
+	while (i < mid)
+		a[k++] = tmp[i++];
+}
+
+FUNCDEF(Error, _insert_batch)(NAME *m, ITEM_TYPE *items, size_t n) {
+	if (n == 0)
+		return OK();
+	ITEM_TYPE *tmp = malloc(sizeof(ITEM_TYPE) * (n / 2 + 1));
+	if (tmp == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	FUNC(__sort_items)(items, tmp, n);
+	free(tmp);
+	/* Drop all but the last of equal keys. */
+	size_t nb = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (nb != 0 && GENERIC_CMP(items[nb - 1].key, items[i].key) == 0)
+			items[nb - 1] = items[i];
+		else
+			items[nb++] = items[i];
+	}
+	/* Count the keys which are already in the map, so we know the final
+	 * length. */
+	size_t dups = 0;
+	for (size_t i = 0, j = 0; i < m->len && j < nb;) {
+		int cmp = GENERIC_CMP(m->keys[i], items[j].key);
+		dups += cmp == 0;
+		i += cmp <= 0;
+		j += cmp >= 0;
+	}
+	TRY(FUNC(_reserve)(m, nb - dups), );
+	/* Merge from the back, so no item is overwritten before it's moved. */
+	size_t i = m->len, j = nb, k = m->len + nb - dups;
+	m->len = k;
+	while (j > 0) {
+		int cmp = i == 0 ? -1 : GENERIC_CMP(m->keys[i - 1], items[j - 1].key);
+		k--;
+		if (cmp > 0) {
+			i--;
+			m->keys[k] = m->keys[i];
+			m->vals[k] = m->vals[i];
+		} else {
+			i -= cmp == 0;
+			j--;
+			m->keys[k] = items[j].key;
+			m->vals[k] = items[j].val;
+		}
+	}
+	return OK();
+}
+
+#endif
+
+#undef ITEM_TYPE
+
+#include "../internal/generic/end.h"
@@ -0,0 +1,180 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A d-ary min-heap (priority queue) stored in a vector from vec.h. The heap
+ * is the vector itself, so vec_len(), the vector's own functions and
+ * indexing all work on it; h[0] is the smallest item according to
+ * GENERIC_CMP (swap the arguments for a max-heap).
+ *
+ * With the default arity of 4, the children of an item are adjacent and
+ * usually share a cache line, and the tree is half as deep as a binary
+ * heap's, so pushing and heapifying touch half as many levels (see
+ * bench/heap.c).
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec
+#define GENERIC_PREFIX int_vec
+#include "vec.h"
+
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntHeap       // Name of the resulting heap type
+#define GENERIC_PREFIX int_heap    // Prefix for functions
+#define GENERIC_VEC_PREFIX int_vec // Prefix of a vector of the same item type
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#include "heap.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+Optional configuration (define before including heap.h):
+
+// Number of children per item (default: 4).
+#define GENERIC_HEAP_ARITY 2
+
+*/
+
+#include <stddef.h>
+
+#include <ds/error.h>
+
+#ifndef GENERIC_VEC_PREFIX
+#error GENERIC_VEC_PREFIX must be defined before including heap.h
+#endif
+#ifndef GENERIC_CMP
+#error GENERIC_CMP must be defined before including heap.h
+#endif
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+#ifdef GENERIC_HEAP_ARITY
+#define ARITY GENERIC_HEAP_ARITY
+#else
+#define ARITY 4
+#endif
+#define VEC(name) GENERIC_CONCAT(GENERIC_VEC_PREFIX, name)
+
+typedef TYPE *NAME;
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME h);
+static inline FUNCDEF(size_t, _len)(const NAME h) { return vec_len((const void*)h); }
+/* Smallest item; the heap must not be empty. */
+static inline FUNCDEF(TYPE *, _peek)(NAME h) { return &h[0]; }
+FUNCDECL(Error, _push)(NAME *h, TYPE val);
+/* Removes and returns the smallest item; the heap must not be empty. Like
+ * vec.h's _pop, this terminates the item. */
+FUNCDECL(TYPE, _pop)(NAME h);
+/* Replaces the smallest item with val and returns it; cheaper than a _pop
+ * followed by a _push. The item is not terminated. */
+FUNCDECL(TYPE, _replace_top)(NAME h, TYPE val);
+/* Turns an arbitrarily ordered vector into a heap in O(n). */
+FUNCDECL(void, _heapify)(NAME h);
+/* Appends the k greatest of the n items in src to the empty heap *dst, using
+ * O(k) memory. Popping them afterwards yields them in ascending order. */
+FUNCDECL(Error, _top_k)(NAME *dst, const TYPE *src, size_t n, size_t k);
+
+#ifdef GENERIC_IMPL
+/* Both sift functions move a "hole" instead of swapping items, so each level
+ * costs one copy. */
+
+static FUNCDEF(void, __sift_up)(NAME h, size_t i) {
+	TYPE val = h[i];
+	while (i > 0) {
+		size_t parent = (i - 1) / ARITY;
+		if (GENERIC_CMP(val, h[parent]) >= 0)
+			break;
+		h[i] = h[parent];
+		i = parent;
+	}
+	h[i] = val;
+}
+
+static FUNCDEF(void, __sift_down)(NAME h, size_t i, size_t len) {
+	TYPE val = h[i];
+	for (;;) {
+		size_t first = i * ARITY + 1;
+		if (first >= len)
+			break;
+		size_t end = first + ARITY < len ? first + ARITY : len;
+		size_t min = first;
+		for (size_t c = first + 1; c < end; c++) {
+			if (GENERIC_CMP(h[c], h[min]) < 0)
+				min = c;
+		}
+		if (GENERIC_CMP(h[min], val) >= 0)
+			break;
+		h[i] = h[min];
+		i = min;
+	}
+	h[i] = val;
+}
+
+FUNCDEF(NAME, )() {
+	return VEC()();
+}
+
+FUNCDEF(void, _term)(NAME h) {
+	VEC(_term)(h);
+}
+
+FUNCDEF(Error, _push)(NAME *h, TYPE val) {
+	TRY(VEC(_push)(h, val), );
+	FUNC(__sift_up)(*h, vec_len(*h) - 1);
+	return OK();
+}
+
+FUNCDEF(TYPE, _pop)(NAME h) {
+	size_t len = vec_len(h);
+	TYPE top = h[0];
+	h[0] = h[len - 1];
+	h[len - 1] = top;
+	VEC(_pop)(h);
+	if (len > 2)
+		FUNC(__sift_down)(h, 0, len - 1);
+	return top;
+}
+
+FUNCDEF(TYPE, _replace_top)(NAME h, TYPE val) {
+	TYPE top = h[0];
+	h[0] = val;
+	FUNC(__sift_down)(h, 0, vec_len(h));
+	return top;
+}
+
+FUNCDEF(void, _heapify)(NAME h) {
+	size_t len = vec_len(h);
+	if (len < 2)
+		return;
+	for (size_t i = (len - 2) / ARITY + 1; i-- > 0;)
+		FUNC(__sift_down)(h, i, len);
+}
+
+FUNCDEF(Error, _top_k)(NAME *dst, const TYPE *src, size_t n, size_t k) {
+	if (k > n)
+		k = n;
+	if (k == 0)
+		return OK();
+	TRY(VEC(_extend)(dst, src, k), );
+	FUNC(_heapify)(*dst);
+	for (size_t i = k; i < n; i++) {
+		if (GENERIC_CMP(src[i], (*dst)[0]) > 0)
+			FUNC(_replace_top)(*dst, src[i]);
+	}
+	return OK();
+}
+
+#endif
+
+#undef ARITY
+#undef VEC
+#ifdef GENERIC_HEAP_ARITY
+#undef GENERIC_HEAP_ARITY
+#endif
+#undef GENERIC_VEC_PREFIX
+
+#include "../internal/generic/end.h"
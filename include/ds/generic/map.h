@@ -16,6 +16,7 @@
 
 */
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 
@@ -42,8 +43,8 @@ typedef struct NAME {
 	size_t cap, len;
 } NAME;
 
-VARDECL(const char *, __val_fmt);
-VARDECL(const char *, __key_fmt);
+VARDECL(_Atomic(const char *), __val_fmt);
+VARDECL(_Atomic(const char *), __key_fmt);
 
 FUNCDECL(NAME, )();
 FUNCDECL(void, _term)(NAME m);
@@ -53,10 +54,14 @@ FUNCDECL(Error, _set)(NAME *m, KTYPE key, VTYPE val);
 FUNCDECL(bool, _del)(NAME m, KTYPE key);
 FUNCDECL(Error, _rehash)(NAME *m, size_t new_minimum_cap);
 FUNCDECL(bool, _it_next)(NAME m, ITEM_TYPE **restrict it);
+/* Like _it_next, but only visits the items in part (counting from 0) of
+ * nparts equally sized slot ranges, so iteration can be split up between
+ * threads. Start with *it == NULL, as for _it_next. */
+FUNCDECL(bool, _it_range)(NAME m, size_t part, size_t nparts, ITEM_TYPE **restrict it);
 
 #ifdef GENERIC_IMPL
-VARDEF(const char *, __val_fmt) = NULL;
-VARDEF(const char *, __key_fmt) = NULL;
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
+VARDEF(_Atomic(const char *), __key_fmt) = NULL;
 
 #include <assert.h>
 #include <stdint.h>
@@ -80,6 +85,11 @@ static size_t _pow_of_2_from_minimum(size_t n) {
 	return n + 1;
 }
 
+#endif
+
+/* Not shared with smap.h, which hashes differently. */
+#ifndef _GENERIC_MAP_FNV1A_ONCE
+#define _GENERIC_MAP_FNV1A_ONCE
 static uint32_t _fnv1a32(const void *data, size_t n) {
 	uint32_t res = 2166136261u;
 	for (size_t i = 0; i < n; i++) {
@@ -209,6 +219,13 @@ FUNCDEF(bool, _it_next)(NAME m, ITEM_TYPE **restrict it) {
 	while (*it < m.data + m.cap && (*it)->state != OCCUPIED) { (*it)++; }
 	return *it < m.data + m.cap;
 }
+
+FUNCDEF(bool, _it_range)(NAME m, size_t part, size_t nparts, ITEM_TYPE **restrict it) {
+	ITEM_TYPE *end = m.data + m.cap * (part + 1) / nparts;
+	*it == NULL ? *it = m.data + m.cap * part / nparts : (*it)++;
+	while (*it < end && (*it)->state != OCCUPIED) { (*it)++; }
+	return *it < end;
+}
 #endif
 
 #undef ITEM_TYPE
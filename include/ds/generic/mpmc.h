@@ -0,0 +1,196 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A bounded lock-free queue for any number of producer and consumer threads,
+ * after Dmitry Vyukov's bounded MPMC queue. The capacity is rounded up to a
+ * power of two and never changes.
+ *
+ * Every slot carries a sequence number which tells whether it is ready to be
+ * written or read for a given position, so a push or pop only needs a single
+ * compare-and-swap on the shared position. The producer and consumer
+ * positions live on separate cache lines.
+ *
+ * The struct is aligned to 64 bytes; use aligned_alloc() to put it on the
+ * heap.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntMpmc       // Name of the resulting queue type
+#define GENERIC_PREFIX int_mpmc    // Prefix for functions
+#include "mpmc.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+IntMpmc q;
+TRY(int_mpmc(&q, 1024), );
+// any producer:
+while (!int_mpmc_try_push(&q, 42));
+// any consumer:
+int x;
+while (!int_mpmc_try_pop(&q, &x));
+
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ds/error.h>
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+#define CELL GENERIC_CONCAT(NAME, Cell)
+
+typedef struct CELL {
+	_Atomic size_t seq;
+	TYPE val;
+} CELL;
+
+typedef struct NAME {
+	_Alignas(64) _Atomic size_t push_pos;
+	_Alignas(64) _Atomic size_t pop_pos;
+	/* Shared, read-only */
+	_Alignas(64) size_t mask;
+	CELL *cells;
+} NAME;
+
+/* Initializes an empty queue with room for at least min_cap items. */
+FUNCDECL(Error, )(NAME *q, size_t min_cap);
+/* Terminates the remaining items; no thread may use the queue anymore. */
+FUNCDECL(void, _term)(NAME *q);
+static inline FUNCDEF(size_t, _cap)(const NAME *q) { return q->mask + 1; }
+/* Returns false if the queue is full. */
+FUNCDECL(bool, _try_push)(NAME *q, TYPE val);
+/* Pushes up to n items as one contiguous run (other producers' items don't
+ * end up in between) and returns how many, which is as many as there is room
+ * for right away. */
+FUNCDECL(size_t, _try_push_n)(NAME *q, const TYPE *items, size_t n);
+/* Returns false if the queue is empty. */
+FUNCDECL(bool, _try_pop)(NAME *q, TYPE *out);
+/* Pops up to n consecutive items into dst and returns how many, which is as
+ * many as are ready right away. */
+FUNCDECL(size_t, _try_pop_n)(NAME *q, TYPE *dst, size_t n);
+
+#ifdef GENERIC_IMPL
+FUNCDEF(Error, )(NAME *q, size_t min_cap) {
+	size_t cap = 2; /* a single cell can't tell "written" from "free for the next round" */
+	while (cap < min_cap)
+		cap *= 2;
+	CELL *cells = malloc(sizeof(CELL) * cap);
+	if (cells == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	for (size_t i = 0; i < cap; i++)
+		atomic_init(&cells[i].seq, i);
+	atomic_init(&q->push_pos, 0);
+	atomic_init(&q->pop_pos, 0);
+	q->mask = cap - 1;
+	q->cells = cells;
+	return OK();
+}
+
+FUNCDEF(void, _term)(NAME *q) {
+	size_t head = atomic_load_explicit(&q->pop_pos, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->push_pos, memory_order_relaxed);
+	for (size_t i = head; i != tail; i++) {
+		GENERIC_TERM_ITEM((q->cells[i & q->mask].val));
+	}
+	free(q->cells);
+}
+
+/* A cell at position pos is free for writing when its seq is pos, and holds
+ * an item when its seq is pos + 1. Reading it sets seq to pos + cap, which is
+ * the next position mapping to the same cell.
+ *
+ * The batch versions claim the run of cells from the shared position on which
+ * are already ready, so they never wait for a thread on the other side which
+ * has claimed a cell but not yet finished with it. */
+
+/* Claims up to *n positions and returns the first one. *n is set to the
+ * number claimed, which is 0 if there wasn't room (or an item) for even one. */
+static FUNCDEF(size_t, __claim)(NAME *q, _Atomic size_t *pos_ptr, size_t *n, size_t seq_offset) {
+	size_t pos = atomic_load_explicit(pos_ptr, memory_order_relaxed);
+	for (;;) {
+		size_t ready = 0;
+		intptr_t dif = 0;
+		while (ready < *n) {
+			CELL *cell = &q->cells[(pos + ready) & q->mask];
+			size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+			dif = (intptr_t)seq - (intptr_t)(pos + ready + seq_offset);
+			if (dif != 0)
+				break;
+			ready++;
+		}
+		if (ready != 0) {
+			/* Only we can claim these cells while pos is unchanged, so
+			 * they stay ready. */
+			if (atomic_compare_exchange_weak_explicit(pos_ptr, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed)) {
+				*n = ready;
+				return pos;
+			}
+		} else if (dif <= 0) {
+			/* Full (or empty), or nothing was asked for. */
+			*n = 0;
+			return pos;
+		} else
+			pos = atomic_load_explicit(pos_ptr, memory_order_relaxed);
+	}
+}
+
+FUNCDEF(bool, _try_push)(NAME *q, TYPE val) {
+	size_t n = 1;
+	size_t pos = FUNC(__claim)(q, &q->push_pos, &n, 0);
+	if (n == 0)
+		return false;
+	CELL *cell = &q->cells[pos & q->mask];
+	cell->val = val;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return true;
+}
+
+FUNCDEF(size_t, _try_push_n)(NAME *q, const TYPE *items, size_t n) {
+	if (n > q->mask + 1)
+		n = q->mask + 1;
+	size_t start = FUNC(__claim)(q, &q->push_pos, &n, 0);
+	for (size_t i = 0; i < n; i++) {
+		CELL *cell = &q->cells[(start + i) & q->mask];
+		cell->val = items[i];
+		atomic_store_explicit(&cell->seq, start + i + 1, memory_order_release);
+	}
+	return n;
+}
+
+FUNCDEF(bool, _try_pop)(NAME *q, TYPE *out) {
+	size_t n = 1;
+	size_t pos = FUNC(__claim)(q, &q->pop_pos, &n, 1);
+	if (n == 0)
+		return false;
+	CELL *cell = &q->cells[pos & q->mask];
+	*out = cell->val;
+	atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+	return true;
+}
+
+FUNCDEF(size_t, _try_pop_n)(NAME *q, TYPE *dst, size_t n) {
+	if (n > q->mask + 1)
+		n = q->mask + 1;
+	size_t start = FUNC(__claim)(q, &q->pop_pos, &n, 1);
+	for (size_t i = 0; i < n; i++) {
+		CELL *cell = &q->cells[(start + i) & q->mask];
+		dst[i] = cell->val;
+		atomic_store_explicit(&cell->seq, start + i + q->mask + 1, memory_order_release);
+	}
+	return n;
+}
+
+#endif
+
+#undef CELL
+
+#include "../internal/generic/end.h"
@@ -0,0 +1,163 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A segmented vector stores its items in blocks which double in size, and
+ * never moves an item once it has been pushed: growing only allocates a new
+ * block. Pointers to items therefore stay valid until the item is popped or
+ * the vector is terminated, even if the struct itself is moved.
+ *
+ * Block b holds SEGVEC_FIRST_BLOCK << b items, so the block containing an
+ * index is found with a single bit scan.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntSegVec     // Name of the resulting vector type
+#define GENERIC_PREFIX int_segvec  // Prefix for functions
+#include "segvec.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+// Printing (takes a pointer):
+fmt("%{IntSegVec}", &v);
+
+*/
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+#ifndef _GENERIC_SEGVEC_ONCE
+#define _GENERIC_SEGVEC_ONCE
+/* Number of items in the first block; must be a power of two. */
+#define SEGVEC_FIRST_BLOCK_SHIFT 4
+#define SEGVEC_FIRST_BLOCK ((size_t)1 << SEGVEC_FIRST_BLOCK_SHIFT)
+/* One less than would fit in a size_t, so the end of the last block does too. */
+#define SEGVEC_MAX_BLOCKS (sizeof(size_t) * 8 - SEGVEC_FIRST_BLOCK_SHIFT - 1)
+
+static inline size_t _segvec_block_of(size_t idx) {
+	size_t x = idx + SEGVEC_FIRST_BLOCK;
+	return (sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(x)) - SEGVEC_FIRST_BLOCK_SHIFT;
+}
+
+/* Index of the first item of block b. */
+static inline size_t _segvec_block_start(size_t b) {
+	return (SEGVEC_FIRST_BLOCK << b) - SEGVEC_FIRST_BLOCK;
+}
+#endif
+
+typedef struct NAME {
+	size_t len;
+	size_t n_blocks;
+	TYPE *blocks[SEGVEC_MAX_BLOCKS];
+} NAME;
+
+VARDECL(_Atomic(const char *), __val_fmt);
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME *v);
+FUNCDECL(void, _fmt_register)(const char *val_fmt);
+static inline FUNCDEF(size_t, _len)(const NAME *v) { return v->len; }
+static inline FUNCDEF(size_t, _cap)(const NAME *v) { return _segvec_block_start(v->n_blocks); }
+static inline FUNCDEF(TYPE *, _at)(NAME *v, size_t idx) {
+	size_t b = _segvec_block_of(idx);
+	return &v->blocks[b][idx - _segvec_block_start(b)];
+}
+static inline FUNCDEF(TYPE *, _back)(NAME *v) { return FUNC(_at)(v, v->len - 1); }
+/* Block b and the number of items in it, for scanning the items block by
+ * block; returns NULL past the last used block. */
+static inline FUNCDEF(TYPE *, _block)(NAME *v, size_t b, size_t *n) {
+	size_t start = _segvec_block_start(b);
+	if (b >= v->n_blocks || start >= v->len)
+		return NULL;
+	size_t size = SEGVEC_FIRST_BLOCK << b;
+	*n = v->len - start < size ? v->len - start : size;
+	return v->blocks[b];
+}
+FUNCDECL(Error, _reserve)(NAME *v, size_t additional);
+FUNCDECL(Error, _push)(NAME *v, TYPE val);
+FUNCDECL(TYPE, _pop)(NAME *v);
+/* Frees blocks which hold no items. */
+FUNCDECL(void, _shrink_to_fit)(NAME *v);
+
+#ifdef GENERIC_IMPL
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
+
+static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	NAME *vec = va_arg(v, NAME *);
+	ctx->putc_func(ctx, '{');
+	for (size_t i = 0; i < vec->len; i++) {
+		if (i != 0)
+			fmtc(ctx, ", ");
+		fmtc(ctx, VAR(__val_fmt), *FUNC(_at)(vec, i));
+	}
+	ctx->putc_func(ctx, '}');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+FUNCDEF(NAME, )() {
+	return (NAME){0};
+}
+
+FUNCDEF(void, _term)(NAME *v) {
+	for (size_t i = 0; i < v->len; i++) {
+		GENERIC_TERM_ITEM((*FUNC(_at)(v, i)));
+	}
+	for (size_t b = 0; b < v->n_blocks; b++)
+		free(v->blocks[b]);
+}
+
+FUNCDEF(void, _fmt_register)(const char *val_fmt) {
+	VAR(__val_fmt) = val_fmt;
+	fmt_register(NAME_STR, FUNC(__print_func));
+}
+
+FUNCDEF(Error, _reserve)(NAME *v, size_t additional) {
+	size_t needed = v->len + additional;
+	while (_segvec_block_start(v->n_blocks) < needed) {
+		if (v->n_blocks == SEGVEC_MAX_BLOCKS)
+			return ERROR_OUT_OF_MEMORY();
+		TYPE *block = malloc(sizeof(TYPE) * (SEGVEC_FIRST_BLOCK << v->n_blocks));
+		if (block == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		v->blocks[v->n_blocks++] = block;
+	}
+	return OK();
+}
+
+FUNCDEF(Error, _push)(NAME *v, TYPE val) {
+	if (v->len == _segvec_block_start(v->n_blocks))
+		TRY(FUNC(_reserve)(v, 1), );
+	*FUNC(_at)(v, v->len++) = val;
+	return OK();
+}
+
+FUNCDEF(TYPE, _pop)(NAME *v) {
+	TYPE val = *FUNC(_back)(v);
+	GENERIC_TERM_ITEM((val));
+	v->len--;
+	return val;
+}
+
+FUNCDEF(void, _shrink_to_fit)(NAME *v) {
+	while (v->n_blocks > 0 && _segvec_block_start(v->n_blocks - 1) >= v->len)
+		free(v->blocks[--v->n_blocks]);
+}
+
+#endif
+
+#include "../internal/generic/end.h"
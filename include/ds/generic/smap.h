@@ -1,12 +1,14 @@
 // Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
 // SPDX license identifier: MIT
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 
 #include <ds/error.h>
 #include <ds/fmt.h>
 #include <ds/string.h>
+#include <ds/internal/hash.h>
 
 /* Example Usage:
 
@@ -29,6 +31,8 @@
 
 typedef struct ITEM_TYPE {
 	char *key;
+	size_t key_len;
+	uint32_t hash; /* cached so lookups and rehashing rarely have to touch the key */
 	TYPE val;
 } ITEM_TYPE;
 
@@ -37,7 +41,7 @@ typedef struct NAME {
 	size_t cap, len;
 } NAME;
 
-VARDECL(const char *, __val_fmt);
+VARDECL(_Atomic(const char *), __val_fmt);
 
 FUNCDECL(NAME, )();
 FUNCDECL(void, _term)(NAME m);
@@ -47,9 +51,13 @@ FUNCDECL(Error, _set)(NAME *m, const char *key, TYPE val);
 FUNCDECL(bool, _del)(NAME m, const char *key);
 FUNCDECL(Error, _rehash)(NAME *m, size_t new_minimum_cap);
 FUNCDECL(bool, _it_next)(NAME m, ITEM_TYPE **restrict it);
+/* Like _it_next, but only visits the items in part (counting from 0) of
+ * nparts equally sized slot ranges, so iteration can be split up between
+ * threads. Start with *it == NULL, as for _it_next. */
+FUNCDECL(bool, _it_range)(NAME m, size_t part, size_t nparts, ITEM_TYPE **restrict it);
 
 #ifdef GENERIC_IMPL
-VARDEF(const char *, __val_fmt) = NULL;
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
 
 #include <assert.h>
 #include <stdint.h>
@@ -72,15 +80,6 @@ static size_t _pow_of_2_from_minimum(size_t n) {
 #endif
 	return n + 1;
 }
-
-static uint32_t _fnv1a32(const void *data, size_t n) {
-	uint32_t res = 2166136261u;
-	for (size_t i = 0; i < n; i++) {
-		res ^= ((uint8_t*)data)[i];
-		res *= 16777619u;
-	}
-	return res;
-}
 #endif
 
 static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
@@ -121,10 +120,21 @@ FUNCDEF(void, _fmt_register)(const char *val_fmt) {
 	fmt_register(NAME_STR, FUNC(__print_func));
 }
 
+/* Compares the cheap stuff (hash, length) first so a full key comparison
+ * almost only ever happens for the key we are actually looking for. memcmp()
+ * with a known length compares whole words at a time. */
+static inline FUNCDEF(bool, __key_eq)(const ITEM_TYPE *itm, const char *key, size_t key_len, uint32_t hash) {
+	return itm->key != TOMBSTONE && itm->hash == hash && itm->key_len == key_len && memcmp(itm->key, key, key_len) == 0;
+}
+
 FUNCDEF(TYPE *, _get)(NAME m, const char *key) {
-	size_t i = _fnv1a32(key, strlen(key)) & (m.cap - 1);
+	if (m.cap == 0)
+		return NULL;
+	size_t key_len = strlen(key);
+	uint32_t hash = _hash_bytes(key, key_len);
+	size_t i = hash & (m.cap - 1);
 	while (m.data[i].key) {
-		if (m.data[i].key != TOMBSTONE && strcmp(m.data[i].key, key) == 0)
+		if (FUNC(__key_eq)(&m.data[i], key, key_len, hash))
 			return &m.data[i].val;
 		i = (i + 1) % m.cap;
 	}
@@ -135,16 +145,20 @@ FUNCDEF(Error, _set)(NAME *m, const char *key, TYPE val) {
 	if (m->cap == 0 || (float)m->len / (float)m->cap > 0.7f)
 		TRY(FUNC(_rehash)(m, m->cap == 0 ? 8 : m->cap * 2), );
 
-	size_t i = _fnv1a32(key, strlen(key)) & (m->cap - 1);
+	size_t key_len = strlen(key);
+	uint32_t hash = _hash_bytes(key, key_len);
+	size_t i = hash & (m->cap - 1);
 	while (m->data[i].key) {
 		if (m->data[i].key == TOMBSTONE) {
 			char *new_key = strdup(key);
 			if (new_key == NULL)
 				return ERROR_OUT_OF_MEMORY();
 			m->data[i].key = new_key;
+			m->data[i].key_len = key_len;
+			m->data[i].hash = hash;
 			m->data[i].val = val;
 			return OK();
-		} else if (strcmp(m->data[i].key, key) == 0) {
+		} else if (FUNC(__key_eq)(&m->data[i], key, key_len, hash)) {
 			m->data[i].val = val;
 			return OK();
 		}
@@ -154,15 +168,21 @@ FUNCDEF(Error, _set)(NAME *m, const char *key, TYPE val) {
 	if (new_key == NULL)
 		return ERROR_OUT_OF_MEMORY();
 	m->data[i].key = new_key;
+	m->data[i].key_len = key_len;
+	m->data[i].hash = hash;
 	m->data[i].val = val;
 	m->len++;
 	return OK();
 }
 
 FUNCDEF(bool, _del)(NAME m, const char *key) {
-	size_t i = _fnv1a32(key, strlen(key)) & (m.cap - 1);
+	if (m.cap == 0)
+		return false;
+	size_t key_len = strlen(key);
+	uint32_t hash = _hash_bytes(key, key_len);
+	size_t i = hash & (m.cap - 1);
 	while (m.data[i].key) {
-		if (m.data[i].key != TOMBSTONE && strcmp(m.data[i].key, key) == 0) {
+		if (FUNC(__key_eq)(&m.data[i], key, key_len, hash)) {
 			GENERIC_TERM_ITEM((m.data[i].val));
 			free(m.data[i].key);
 			m.data[i].key = TOMBSTONE;
@@ -187,10 +207,9 @@ FUNCDEF(Error, _rehash)(NAME *m, size_t new_minimum_cap) {
 
 	for (size_t i = 0; i < m->cap; i++) {
 		if (m->data[i].key && m->data[i].key != TOMBSTONE) {
-			size_t j = _fnv1a32(m->data[i].key, strlen(m->data[i].key)) & (new_m.cap - 1);
+			size_t j = m->data[i].hash & (new_m.cap - 1);
 			while (new_m.data[j].key) { j = (j + 1) % new_m.cap; }
-			new_m.data[j].key = m->data[i].key;
-			new_m.data[j].val = m->data[i].val;
+			new_m.data[j] = m->data[i];
 			new_m.len++;
 		}
 	}
@@ -205,6 +224,13 @@ FUNCDEF(bool, _it_next)(NAME m, ITEM_TYPE **restrict it) {
 	while (*it < m.data + m.cap && (!(*it)->key || (*it)->key == TOMBSTONE)) { (*it)++; }
 	return *it < m.data + m.cap;
 }
+
+FUNCDEF(bool, _it_range)(NAME m, size_t part, size_t nparts, ITEM_TYPE **restrict it) {
+	ITEM_TYPE *end = m.data + m.cap * (part + 1) / nparts;
+	*it == NULL ? *it = m.data + m.cap * part / nparts : (*it)++;
+	while (*it < end && (!(*it)->key || (*it)->key == TOMBSTONE)) { (*it)++; }
+	return *it < end;
+}
 #endif
 
 #undef ITEM_TYPE
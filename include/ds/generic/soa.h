@@ -0,0 +1,222 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A struct-of-arrays vector: instead of one array of structs, it keeps one
+ * array ("column") per field, all sharing the same length and capacity. A
+ * loop which only reads one field then only pulls that field into the cache,
+ * and the compiler can vectorize it.
+ *
+ * The fields are given as an X-macro. NAME has one pointer member per field,
+ * and NAME##Row is the corresponding plain struct, used to push and get whole
+ * rows. All columns live in a single allocation, each starting on a 64 byte
+ * boundary; the _<field>() accessors tell the compiler so.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_NAME Particles     // Name of the resulting vector type
+#define GENERIC_PREFIX particles   // Prefix for functions
+#define GENERIC_FIELDS(X) \
+	X(int, id) \
+	X(float, x) \
+	X(float, y)
+#include "soa.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+Particles p = particles();
+TRY(particles_push(&p, (ParticlesRow){ .id = 1, .x = 2.f, .y = 3.f }), );
+float *x = particles_x(&p); // same as p.x
+for (size_t i = 0; i < particles_len(&p); i++)
+	x[i] *= 2.f;
+
+// Printing (takes a pointer; the format gets each row's fields in order, and
+// may leave out trailing ones):
+particles_fmt_register("#%d");
+fmt("%{Particles}", &p);
+
+Optional configuration (define before including soa.h):
+
+// Terminates a row (takes a NAME##Row) when it is removed.
+#define GENERIC_TERM_ITEM(_row) free_row(_row)
+
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#ifndef GENERIC_FIELDS
+#error GENERIC_FIELDS must be defined before including soa.h
+#endif
+
+#include "../internal/generic/begin.h"
+
+#ifndef _GENERIC_SOA_ONCE
+#define _GENERIC_SOA_ONCE
+/* Alignment of every column. */
+#define SOA_ALIGN 64
+#endif
+
+#define ROW GENERIC_CONCAT(NAME, Row)
+
+#define SOA_COLUMN(_type, _name) _type *_name;
+#define SOA_FIELD(_type, _name) _type _name;
+typedef struct NAME {
+	size_t len, cap;
+	GENERIC_FIELDS(SOA_COLUMN)
+} NAME;
+
+typedef struct ROW {
+	GENERIC_FIELDS(SOA_FIELD)
+} ROW;
+#undef SOA_COLUMN
+#undef SOA_FIELD
+
+VARDECL(_Atomic(const char *), __row_fmt);
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME *v);
+FUNCDECL(void, _fmt_register)(const char *row_fmt);
+static inline FUNCDEF(size_t, _len)(const NAME *v) { return v->len; }
+static inline FUNCDEF(size_t, _cap)(const NAME *v) { return v->cap; }
+#define SOA_ACCESSOR(_type, _name) \
+	static inline FUNCDEF(_type *, GENERIC_CONCAT(_, _name))(NAME *v) { return __builtin_assume_aligned(v->_name, SOA_ALIGN); }
+GENERIC_FIELDS(SOA_ACCESSOR)
+#undef SOA_ACCESSOR
+FUNCDECL(Error, _fit)(NAME *v, size_t new_minimum_cap);
+FUNCDECL(Error, _reserve)(NAME *v, size_t additional);
+FUNCDECL(Error, _push)(NAME *v, ROW row);
+FUNCDECL(ROW, _pop)(NAME *v);
+FUNCDECL(ROW, _get)(const NAME *v, size_t idx);
+FUNCDECL(void, _set)(NAME *v, size_t idx, ROW row);
+/* Removes row idx by moving the last row into its place. */
+FUNCDECL(ROW, _swap_del)(NAME *v, size_t idx);
+
+#ifdef GENERIC_IMPL
+VARDEF(_Atomic(const char *), __row_fmt) = NULL;
+
+#define SOA_GET(_type, _name) ._name = v->_name[idx],
+#define SOA_SET(_type, _name) v->_name[idx] = row._name;
+#define SOA_FMT_ARG(_type, _name) , v->_name[i]
+
+static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list args) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	NAME *v = va_arg(args, NAME *);
+	ctx->putc_func(ctx, '{');
+	for (size_t i = 0; i < v->len; i++) {
+		if (i != 0)
+			fmtc(ctx, ", ");
+		fmtc(ctx, VAR(__row_fmt) GENERIC_FIELDS(SOA_FMT_ARG));
+	}
+	ctx->putc_func(ctx, '}');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+FUNCDEF(NAME, )() {
+	return (NAME){0};
+}
+
+/* The first column owns the allocation. */
+#define SOA_FIRST_COLUMN(_type, _name) if (block == NULL) block = v->_name;
+
+FUNCDEF(void, _term)(NAME *v) {
+	for (size_t i = 0; i < v->len; i++) {
+		GENERIC_TERM_ITEM((FUNC(_get)(v, i)));
+	}
+	void *block = NULL;
+	GENERIC_FIELDS(SOA_FIRST_COLUMN)
+	free(block);
+}
+
+FUNCDEF(void, _fmt_register)(const char *row_fmt) {
+	VAR(__row_fmt) = row_fmt;
+	fmt_register(NAME_STR, FUNC(__print_func));
+}
+
+#define SOA_COLUMN_SIZE(_type, _name) \
+	size += (sizeof(_type) * new_cap + SOA_ALIGN - 1) / SOA_ALIGN * SOA_ALIGN;
+#define SOA_MOVE_COLUMN(_type, _name) \
+	new_v._name = (_type *)pos; \
+	if (v->len != 0) \
+		memcpy(new_v._name, v->_name, sizeof(_type) * v->len); \
+	pos += (sizeof(_type) * new_cap + SOA_ALIGN - 1) / SOA_ALIGN * SOA_ALIGN;
+
+FUNCDEF(Error, _fit)(NAME *v, size_t new_minimum_cap) {
+	size_t new_cap = new_minimum_cap < v->len ? v->len : new_minimum_cap;
+	if (new_cap == v->cap)
+		return OK();
+	NAME new_v = { .len = v->len, .cap = new_cap };
+	if (new_cap != 0) {
+		size_t size = 0;
+		GENERIC_FIELDS(SOA_COLUMN_SIZE)
+		char *block = aligned_alloc(SOA_ALIGN, size);
+		if (block == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		char *pos = block;
+		GENERIC_FIELDS(SOA_MOVE_COLUMN)
+	}
+	void *block = NULL;
+	GENERIC_FIELDS(SOA_FIRST_COLUMN)
+	free(block);
+	*v = new_v;
+	return OK();
+}
+
+#undef SOA_FIRST_COLUMN
+#undef SOA_COLUMN_SIZE
+#undef SOA_MOVE_COLUMN
+
+FUNCDEF(Error, _reserve)(NAME *v, size_t additional) {
+	size_t needed = v->len + additional;
+	if (needed <= v->cap)
+		return OK();
+	size_t new_cap = v->cap == 0 ? 8 : v->cap * 2;
+	return FUNC(_fit)(v, new_cap < needed ? needed : new_cap);
+}
+
+FUNCDEF(Error, _push)(NAME *v, ROW row) {
+	TRY(FUNC(_reserve)(v, 1), );
+	FUNC(_set)(v, v->len++, row);
+	return OK();
+}
+
+FUNCDEF(ROW, _pop)(NAME *v) {
+	ROW row = FUNC(_get)(v, v->len - 1);
+	GENERIC_TERM_ITEM((row));
+	v->len--;
+	return row;
+}
+
+FUNCDEF(ROW, _get)(const NAME *v, size_t idx) {
+	return (ROW){ GENERIC_FIELDS(SOA_GET) };
+}
+
+FUNCDEF(void, _set)(NAME *v, size_t idx, ROW row) {
+	GENERIC_FIELDS(SOA_SET)
+}
+
+FUNCDEF(ROW, _swap_del)(NAME *v, size_t idx) {
+	ROW row = FUNC(_get)(v, idx);
+	GENERIC_TERM_ITEM((row));
+	FUNC(_set)(v, idx, FUNC(_get)(v, --v->len));
+	return row;
+}
+
+#undef SOA_GET
+#undef SOA_SET
+#undef SOA_FMT_ARG
+#endif
+
+#undef ROW
+#undef GENERIC_FIELDS
+
+#include "../internal/generic/end.h"
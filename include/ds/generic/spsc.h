@@ -0,0 +1,165 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A bounded lock-free queue for exactly one producer thread and one consumer
+ * thread. The capacity is rounded up to a power of two and never changes.
+ *
+ * The producer and consumer positions live on separate cache lines, and each
+ * side keeps a cached copy of the other side's position, so the shared lines
+ * are only touched when the queue looks full (or empty).
+ *
+ * The struct is aligned to 64 bytes; use aligned_alloc() to put it on the
+ * heap.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntSpsc       // Name of the resulting queue type
+#define GENERIC_PREFIX int_spsc    // Prefix for functions
+#include "spsc.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+IntSpsc q;
+TRY(int_spsc(&q, 1024), );
+// producer:
+while (!int_spsc_try_push(&q, 42));
+// consumer:
+int x;
+while (!int_spsc_try_pop(&q, &x));
+
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/error.h>
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+typedef struct NAME {
+	/* Consumer side */
+	_Alignas(64) _Atomic size_t head;
+	size_t tail_cache;
+	/* Producer side */
+	_Alignas(64) _Atomic size_t tail;
+	size_t head_cache;
+	/* Shared, read-only */
+	_Alignas(64) size_t mask;
+	TYPE *data;
+} NAME;
+
+/* Initializes an empty queue with room for at least min_cap items. */
+FUNCDECL(Error, )(NAME *q, size_t min_cap);
+/* Terminates the remaining items; neither side may use the queue anymore. */
+FUNCDECL(void, _term)(NAME *q);
+static inline FUNCDEF(size_t, _cap)(const NAME *q) { return q->mask + 1; }
+/* Producer only. Returns false if the queue is full. */
+FUNCDECL(bool, _try_push)(NAME *q, TYPE val);
+/* Producer only. Pushes as many of the n items as fit and returns how many. */
+FUNCDECL(size_t, _try_push_n)(NAME *q, const TYPE *items, size_t n);
+/* Consumer only. Returns false if the queue is empty. */
+FUNCDECL(bool, _try_pop)(NAME *q, TYPE *out);
+/* Consumer only. Pops up to n items into dst and returns how many. */
+FUNCDECL(size_t, _try_pop_n)(NAME *q, TYPE *dst, size_t n);
+
+#ifdef GENERIC_IMPL
+FUNCDEF(Error, )(NAME *q, size_t min_cap) {
+	size_t cap = 1;
+	while (cap < min_cap)
+		cap *= 2;
+	TYPE *data = malloc(sizeof(TYPE) * cap);
+	if (data == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	q->tail_cache = 0;
+	q->head_cache = 0;
+	q->mask = cap - 1;
+	q->data = data;
+	return OK();
+}
+
+FUNCDEF(void, _term)(NAME *q) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	for (size_t i = head; i != tail; i++) {
+		GENERIC_TERM_ITEM((q->data[i & q->mask]));
+	}
+	free(q->data);
+}
+
+/* Positions only ever increase; the index into data is pos & mask. */
+
+FUNCDEF(size_t, _try_push_n)(NAME *q, const TYPE *items, size_t n) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	size_t cap = q->mask + 1;
+	if (tail + n - q->head_cache > cap) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		size_t space = cap - (tail - q->head_cache);
+		if (n > space)
+			n = space;
+	}
+	if (n == 0)
+		return 0;
+	size_t start = tail & q->mask;
+	size_t first = cap - start < n ? cap - start : n;
+	memcpy(q->data + start, items, sizeof(TYPE) * first);
+	memcpy(q->data, items + first, sizeof(TYPE) * (n - first));
+	atomic_store_explicit(&q->tail, tail + n, memory_order_release);
+	return n;
+}
+
+FUNCDEF(bool, _try_push)(NAME *q, TYPE val) {
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	if (tail - q->head_cache == q->mask + 1) {
+		q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->head_cache == q->mask + 1)
+			return false;
+	}
+	q->data[tail & q->mask] = val;
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+FUNCDEF(size_t, _try_pop_n)(NAME *q, TYPE *dst, size_t n) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	size_t cap = q->mask + 1;
+	if (q->tail_cache - head < n) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		size_t avail = q->tail_cache - head;
+		if (n > avail)
+			n = avail;
+	}
+	if (n == 0)
+		return 0;
+	size_t start = head & q->mask;
+	size_t first = cap - start < n ? cap - start : n;
+	memcpy(dst, q->data + start, sizeof(TYPE) * first);
+	memcpy(dst + first, q->data, sizeof(TYPE) * (n - first));
+	atomic_store_explicit(&q->head, head + n, memory_order_release);
+	return n;
+}
+
+FUNCDEF(bool, _try_pop)(NAME *q, TYPE *out) {
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if (head == q->tail_cache) {
+		q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_cache)
+			return false;
+	}
+	*out = q->data[head & q->mask];
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+	return true;
+}
+
+#endif
+
+#include "../internal/generic/end.h"
@@ -0,0 +1,176 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* A small vector keeps its first GENERIC_INLINE_CAP items inside the struct
+ * itself and only allocates once it grows beyond that. Unlike vec.h, the
+ * vector is a struct, so functions which may modify it take a pointer.
+ *
+ * Pointers into the vector (e.g. from _data() or _back()) are invalidated
+ * whenever the struct itself is moved or copied while the items are stored
+ * inline.
+
+Example Usage:
+
+// something.h:
+#define GENERIC_TYPE int           // Item type
+#define GENERIC_NAME IntSVec       // Name of the resulting vector type
+#define GENERIC_PREFIX int_svec    // Prefix for functions
+#define GENERIC_INLINE_CAP 4       // Number of items stored without allocating
+#include "svec.h"
+
+// something.c:
+#define GENERIC_IMPL // We want something.c to define the actual function implementations
+#include "something.h"
+
+// Printing (takes a pointer):
+fmt("%{IntSVec}", &v);
+
+*/
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#ifndef GENERIC_INLINE_CAP
+#error GENERIC_INLINE_CAP must be defined before including svec.h
+#endif
+
+#define GENERIC_REQUIRE_TYPE
+#include "../internal/generic/begin.h"
+
+#define INLINE_CAP GENERIC_INLINE_CAP
+
+typedef struct NAME {
+	size_t len, cap; /* cap == INLINE_CAP means the items are stored inline */
+	union {
+		TYPE *heap;
+		TYPE inl[INLINE_CAP];
+	} data;
+} NAME;
+
+VARDECL(_Atomic(const char *), __val_fmt);
+
+FUNCDECL(NAME, )();
+FUNCDECL(void, _term)(NAME *v);
+FUNCDECL(void, _fmt_register)(const char *val_fmt);
+static inline FUNCDEF(TYPE *, _data)(NAME *v) { return v->cap > INLINE_CAP ? v->data.heap : v->data.inl; }
+static inline FUNCDEF(size_t, _len)(const NAME *v) { return v->len; }
+static inline FUNCDEF(size_t, _cap)(const NAME *v) { return v->cap; }
+FUNCDECL(Error, _fit)(NAME *v, size_t new_minimum_cap);
+FUNCDECL(Error, _push)(NAME *v, TYPE val);
+FUNCDECL(TYPE, _pop)(NAME *v);
+FUNCDECL(TYPE *, _back)(NAME *v);
+FUNCDECL(TYPE, _del)(NAME *v, size_t idx);
+FUNCDECL(Error, _insert)(NAME *v, size_t idx, TYPE val);
+
+#ifdef GENERIC_IMPL
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
+
+static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	NAME *vec = va_arg(v, NAME *);
+	TYPE *data = FUNC(_data)(vec);
+	ctx->putc_func(ctx, '{');
+	for (size_t i = 0; i < vec->len; i++) {
+		if (i != 0)
+			fmtc(ctx, ", ");
+		fmtc(ctx, VAR(__val_fmt), data[i]);
+	}
+	ctx->putc_func(ctx, '}');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+FUNCDEF(NAME, )() {
+	return (NAME){ .cap = INLINE_CAP };
+}
+
+FUNCDEF(void, _term)(NAME *v) {
+	for (size_t i = 0; i < v->len; i++) {
+		GENERIC_TERM_ITEM((FUNC(_data)(v)[i]));
+	}
+	if (v->cap > INLINE_CAP)
+		free(v->data.heap);
+}
+
+FUNCDEF(void, _fmt_register)(const char *val_fmt) {
+	VAR(__val_fmt) = val_fmt;
+	fmt_register(NAME_STR, FUNC(__print_func));
+}
+
+FUNCDEF(Error, _fit)(NAME *v, size_t new_minimum_cap) {
+	size_t new_cap = new_minimum_cap < v->len ? v->len : new_minimum_cap;
+	if (new_cap <= INLINE_CAP) {
+		/* Move back into the struct. */
+		if (v->cap > INLINE_CAP) {
+			TYPE *heap = v->data.heap;
+			memcpy(v->data.inl, heap, sizeof(TYPE) * v->len);
+			free(heap);
+			v->cap = INLINE_CAP;
+		}
+		return OK();
+	}
+	if (v->cap > INLINE_CAP) {
+		TYPE *new_heap = realloc(v->data.heap, sizeof(TYPE) * new_cap);
+		if (new_heap == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		v->data.heap = new_heap;
+	} else {
+		/* Spill onto the heap. */
+		TYPE *new_heap = malloc(sizeof(TYPE) * new_cap);
+		if (new_heap == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		memcpy(new_heap, v->data.inl, sizeof(TYPE) * v->len);
+		v->data.heap = new_heap;
+	}
+	v->cap = new_cap;
+	return OK();
+}
+
+FUNCDEF(Error, _push)(NAME *v, TYPE val) {
+	if (v->len + 1 > v->cap)
+		TRY(FUNC(_fit)(v, v->cap * 2), );
+	FUNC(_data)(v)[v->len++] = val;
+	return OK();
+}
+
+FUNCDEF(TYPE, _pop)(NAME *v) {
+	TYPE val = FUNC(_data)(v)[v->len-1];
+	GENERIC_TERM_ITEM((val));
+	v->len--;
+	return val;
+}
+
+FUNCDEF(TYPE *, _back)(NAME *v) {
+	return &FUNC(_data)(v)[v->len - 1];
+}
+
+FUNCDEF(TYPE, _del)(NAME *v, size_t idx) {
+	TYPE *data = FUNC(_data)(v);
+	TYPE val = data[idx];
+	GENERIC_TERM_ITEM((val));
+	memmove(data + idx, data + idx + 1, sizeof(TYPE) * (--v->len - idx));
+	return val;
+}
+
+FUNCDEF(Error, _insert)(NAME *v, size_t idx, TYPE val) {
+	if (v->len + 1 > v->cap)
+		TRY(FUNC(_fit)(v, v->cap * 2), );
+	TYPE *data = FUNC(_data)(v);
+	memmove(data + idx + 1, data + idx, sizeof(TYPE) * (v->len++ - idx));
+	data[idx] = val;
+	return OK();
+}
+
+#endif
+
+#undef INLINE_CAP
+#undef GENERIC_INLINE_CAP
+
+#include "../internal/generic/end.h"
@@ -13,14 +13,54 @@
 #define GENERIC_IMPL // We want something.c to define the actual function implementations
 #include "something.h"
 
+// File-backed (unix only; the length is kept in the file):
+IntVec v;
+TRY(int_vec_open(&v, "ints.vec"), ); // or int_vec_create() for a new file
+TRY(int_vec_push(&v, 42), );
+TRY(int_vec_sync(v), );
+int_vec_term(v);
+
+Optional configuration (define before including vec.h):
+
+// Next capacity when the vector is full (default: VEC_GROWTH_2X).
+#define GENERIC_GROWTH(_cap) VEC_GROWTH_STEP(_cap, 1 << 24, 1 << 24)
+// Comparison used by _sort, _sort_parallel, _lower_bound and _binary_search.
+// Returns <0, 0 or >0 like strcmp(); the functions are only defined if set.
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+// Maps an item to an order preserving 64-bit key for _radix_sort (see
+// vec_radix_key_*() for numbers); the function is only defined if set.
+#define GENERIC_RADIX_KEY(_itm) vec_radix_key_i32(_itm)
+// Kernel family from ds/simd.h (i8, u8, i16, u16, i32, u32, i64, u64, f32 or
+// f64) matching TYPE, for _find, _count_eq, _min, _max and _sum.
+#define GENERIC_SIMD i32
+// Allocations of at least this many bytes are made with mmap() instead of
+// malloc(). On Linux, such vectors grow with mremap(), which moves pages
+// instead of copying bytes (define _GNU_SOURCE before any #include for that).
+#define GENERIC_MMAP_THRESHOLD (64 << 20)
+
 */
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <ds/error.h>
 #include <ds/fmt.h>
+#include <ds/pool.h>
+#include <ds/simd.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VEC_FILE_SUPPORT
+#endif
 
 #define GENERIC_REQUIRE_TYPE
 #include "../internal/generic/begin.h"
@@ -29,11 +69,44 @@
 #define _GENERIC_VEC_ONCE
 size_t vec_len(const void *v);
 size_t vec_cap(const void *v);
+
+/* Access pattern hints for file-backed vectors, see _advise. */
+typedef enum VecAdvice {
+	VecAdviceNormal,
+	VecAdviceSequential, /* read ahead aggressively, drop pages behind */
+	VecAdviceRandom,     /* don't read ahead */
+	VecAdviceWillNeed,   /* start paging everything in now */
+} VecAdvice;
+
+/* Growth policies for GENERIC_GROWTH. */
+#define VEC_GROWTH_2X(_cap)   ((_cap) == 0 ? 8 : (_cap) * 2)
+#define VEC_GROWTH_1_5X(_cap) ((_cap) < 8 ? 8 : (_cap) + (_cap) / 2)
+/* Doubles until the capacity reaches _threshold items, then grows by _step items at a time. */
+#define VEC_GROWTH_STEP(_cap, _threshold, _step) ((_cap) < (_threshold) ? VEC_GROWTH_2X(_cap) : (_cap) + (_step))
+
+/* Order preserving key functions for GENERIC_RADIX_KEY. */
+static inline uint64_t vec_radix_key_u64(uint64_t x) { return x; }
+static inline uint64_t vec_radix_key_i64(int64_t x) { return (uint64_t)x ^ (UINT64_C(1) << 63); }
+static inline uint64_t vec_radix_key_i32(int32_t x) { return (uint32_t)x ^ (UINT32_C(1) << 31); }
+static inline uint64_t vec_radix_key_f64(double x) {
+	uint64_t u;
+	memcpy(&u, &x, sizeof(u));
+	return u >> 63 ? ~u : u | (UINT64_C(1) << 63);
+}
+static inline uint64_t vec_radix_key_f32(float x) {
+	uint32_t u;
+	memcpy(&u, &x, sizeof(u));
+	return u >> 31 ? ~u : u | (UINT32_C(1) << 31);
+}
+#endif
+
+#ifndef GENERIC_GROWTH
+#define GENERIC_GROWTH(_cap) VEC_GROWTH_2X(_cap)
 #endif
 
 typedef TYPE *NAME;
 
-VARDECL(const char *, __val_fmt);
+VARDECL(_Atomic(const char *), __val_fmt);
 
 FUNCDECL(NAME, )();
 FUNCDECL(void, _term)(NAME v);
@@ -46,16 +119,81 @@ FUNCDECL(TYPE, _pop)(NAME v);
 FUNCDECL(TYPE *, _back)(NAME v);
 FUNCDECL(TYPE, _del)(NAME v, size_t idx);
 FUNCDECL(Error, _insert)(NAME *v, size_t idx, TYPE val);
+FUNCDECL(Error, _reserve)(NAME *v, size_t additional);
+FUNCDECL(Error, _extend)(NAME *v, const TYPE *items, size_t n);
+FUNCDECL(Error, _insert_n)(NAME *v, size_t idx, const TYPE *items, size_t n);
+FUNCDECL(void, _del_range)(NAME v, size_t begin, size_t end);
+FUNCDECL(TYPE, _swap_del)(NAME v, size_t idx);
+FUNCDECL(Error, _resize)(NAME *v, size_t new_len, TYPE fill);
+FUNCDECL(Error, _shrink_to_fit)(NAME *v);
+#ifdef VEC_FILE_SUPPORT
+/* File-backed vectors map a file (a small header followed by the items)
+ * into memory, so they can be larger than RAM and survive restarts: the
+ * length is stored in the file, and pages are only read when touched. All
+ * other functions (and vec_len(), indexing, etc.) work on them as usual.
+ * Items must be plain data, as they are stored as is and are not
+ * terminated by _term, which just unmaps the file. A file can be mapped
+ * several times, e.g. by several processes, but changing the capacity through
+ * one mapping means the others must be reopened to see the new items. */
+/* Creates (or truncates) the file at path and maps it as an empty vector. */
+FUNCDECL(Error, _create)(NAME *v, const char *path);
+/* Maps a file previously created by _create with the same item type. */
+FUNCDECL(Error, _open)(NAME *v, const char *path);
+/* Writes modified items back to the file, returning once they are on disk. */
+FUNCDECL(Error, _sync)(NAME v);
+FUNCDECL(Error, _advise)(NAME v, VecAdvice advice);
+#endif
+#ifdef GENERIC_CMP
+FUNCDECL(void, _sort)(NAME v);
+FUNCDECL(Error, _sort_parallel)(NAME v, ThreadPool *pool);
+FUNCDECL(size_t, _lower_bound)(const NAME v, TYPE key);
+FUNCDECL(TYPE *, _binary_search)(NAME v, TYPE key);
+#endif
+#ifdef GENERIC_RADIX_KEY
+FUNCDECL(Error, _radix_sort)(NAME v);
+#endif
+FUNCDECL(Error, _filter_into)(NAME *dst, const NAME src, bool (*pred)(const TYPE *itm, void *ctx), void *ctx);
+/* Calls fn on every item, spread over the threads of pool. */
+FUNCDECL(void, _par_for_each)(NAME v, ThreadPool *pool, void (*fn)(TYPE *itm, void *ctx), void *ctx);
+/* Folds the items into accumulators of acc_size bytes, in parallel: each
+ * thread starts chunks from a copy of identity and folds items into it with
+ * map_fn, then the chunks' accumulators are combined into result (which also
+ * starts as identity) with reduce_fn, in item order. */
+FUNCDECL(Error, _par_reduce)(const NAME v, ThreadPool *pool,
+		void (*map_fn)(void *acc, const TYPE *itm, void *ctx),
+		void (*reduce_fn)(void *acc, const void *other, void *ctx),
+		const void *identity, size_t acc_size, void *result, void *ctx);
+#ifdef GENERIC_SIMD
+#define SIMD_FUNC(name) GENERIC_CONCAT(GENERIC_CONCAT(simd_, name), GENERIC_CONCAT(_, GENERIC_SIMD))
+#define SIMD_SUM_TYPE GENERIC_CONCAT(GENERIC_CONCAT(simd_sum_, GENERIC_SIMD), _t)
+/* Returns the index of the first item equal to x, or the length of the vector. */
+static inline FUNCDEF(size_t, _find)(const NAME v, TYPE x) { return SIMD_FUNC(find)(v, vec_len(v), x); }
+static inline FUNCDEF(size_t, _count_eq)(const NAME v, TYPE x) { return SIMD_FUNC(count_eq)(v, vec_len(v), x); }
+/* The vector must not be empty. */
+static inline FUNCDEF(TYPE, _min)(const NAME v) { return SIMD_FUNC(min)(v, vec_len(v)); }
+static inline FUNCDEF(TYPE, _max)(const NAME v) { return SIMD_FUNC(max)(v, vec_len(v)); }
+static inline FUNCDEF(SIMD_SUM_TYPE, _sum)(const NAME v) { return SIMD_FUNC(sum)(v, vec_len(v)); }
+#undef SIMD_FUNC
+#undef SIMD_SUM_TYPE
+#endif
 
 #ifdef GENERIC_IMPL
-VARDEF(const char *, __val_fmt) = NULL;
+VARDEF(_Atomic(const char *), __val_fmt) = NULL;
 
 #define _VEC_HEADER(vec) ((_VecHeader*)(vec) - 1)
 
 #ifndef _GENERIC_VEC_IMPL_ONCE
 #define _GENERIC_VEC_IMPL_ONCE
+typedef enum _VecKind {
+	_VecKindHeap = 0, /* malloc() */
+	_VecKindMmap,     /* anonymous mmap() */
+	_VecKindFile,     /* shared mmap() of a file, see _VecFileHeader */
+} _VecKind;
+
 typedef struct _VecHeader {
-	size_t cap, len;
+	_Alignas(max_align_t) size_t cap; /* keeps the items after the header aligned */
+	size_t len;
+	unsigned char kind; /* _VecKind */
 } _VecHeader;
 
 size_t vec_len(const void *v) {
@@ -65,6 +203,189 @@ size_t vec_len(const void *v) {
 size_t vec_cap(const void *v) {
 	return v == NULL ? 0 : _VEC_HEADER(v)->cap;
 }
+
+static size_t _vec_block_size(size_t item_size, size_t cap) {
+	return sizeof(_VecHeader) + item_size * cap;
+}
+
+#ifdef VEC_FILE_SUPPORT
+#define _VEC_FILE_MAGIC "ds vec\0\2"
+
+/* Start of a file-backed vector's file (and mapping). */
+typedef struct _VecFileHeader {
+	char magic[8];
+	uint64_t item_size;
+	_VecHeader h; /* followed by the items */
+} _VecFileHeader;
+
+/* What a mapping of the file needs to know about itself. It can't go into the
+ * file, which other mappings share, so it gets a private page right before
+ * the mapping. */
+typedef struct _VecFileMap {
+	int fd;
+	size_t size; /* of the file mapping */
+} _VecFileMap;
+
+#define _VEC_FILE_HEADER(h) ((_VecFileHeader *)((char *)(h) - offsetof(_VecFileHeader, h)))
+#define _VEC_FILE_MAP(h) ((_VecFileMap *)((char *)_VEC_FILE_HEADER(h) - _vec_page_size()))
+
+static size_t _vec_page_size(void) {
+	return sysconf(_SC_PAGESIZE);
+}
+
+static size_t _vec_file_size(size_t item_size, size_t cap) {
+	return sizeof(_VecFileHeader) + item_size * cap;
+}
+
+/* Error from a failed system call, including errno's message. */
+static Error _vec_file_error(const char *what) {
+	const char *msg = strerror(errno);
+	size_t size = strlen(what) + strlen(msg) + 3;
+	char *str = malloc(size);
+	if (str == NULL)
+		return ERROR_STRING(what);
+	snprintf(str, size, "%s: %s", what, msg);
+	return ERROR_HEAP_STRING(str);
+}
+
+/* Maps size bytes of fd after a private page holding its _VecFileMap; returns
+ * the file mapping, or MAP_FAILED. */
+static void *_vec_file_map_fd(int fd, size_t size) {
+	size_t page = _vec_page_size();
+	char *p = mmap(NULL, page + size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return MAP_FAILED;
+	if (mmap(p + page, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(p, page + size);
+		return MAP_FAILED;
+	}
+	*(_VecFileMap *)p = (_VecFileMap){ .fd = fd, .size = size };
+	return p + page;
+}
+
+static void _vec_file_unmap(_VecHeader *h) {
+	_VecFileMap *m = _VEC_FILE_MAP(h);
+	munmap(m, _vec_page_size() + m->size);
+}
+
+/* Maps size bytes of fd; closes fd on failure. */
+static Error _vec_file_map(_VecHeader **h, int fd, size_t size) {
+	_VecFileHeader *fh = _vec_file_map_fd(fd, size);
+	if (fh == MAP_FAILED) {
+		Error err = _vec_file_error("mmap()");
+		close(fd);
+		return err;
+	}
+	*h = &fh->h;
+	return OK();
+}
+
+/* Grows the file first and shrinks it last, so the mapping never extends
+ * past its end. */
+static _VecHeader *_vec_file_realloc(_VecHeader *h, size_t item_size, size_t new_cap) {
+	_VecFileMap *m = _VEC_FILE_MAP(h);
+	int fd = m->fd;
+	size_t old_size = m->size, new_size = _vec_file_size(item_size, new_cap);
+	if (new_size > old_size && ftruncate(fd, new_size) != 0)
+		return NULL;
+	/* Mapping the file again just sets up page tables; nothing is copied. */
+	_VecFileHeader *fh = _vec_file_map_fd(fd, new_size);
+	if (fh == MAP_FAILED) {
+		if (new_size > old_size && ftruncate(fd, old_size) != 0) {
+			/* Nothing left to do; the file is just larger than needed. */
+		}
+		return NULL;
+	}
+	_vec_file_unmap(h);
+	if (new_size < old_size && ftruncate(fd, new_size) != 0) {
+		/* Likewise. */
+	}
+	return &fh->h;
+}
+#endif
+
+static void *_vec_block_alloc(size_t size, _VecKind kind) {
+#ifdef MAP_ANONYMOUS
+	if (kind == _VecKindMmap) {
+		void *res = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return res == MAP_FAILED ? NULL : res;
+	}
+#endif
+	return malloc(size);
+}
+
+static void _vec_block_free(_VecHeader *h, size_t item_size) {
+#ifdef VEC_FILE_SUPPORT
+	if (h->kind == _VecKindFile) {
+		int fd = _VEC_FILE_MAP(h)->fd;
+		_vec_file_unmap(h);
+		close(fd);
+		return;
+	}
+#endif
+#ifdef MAP_ANONYMOUS
+	if (h->kind == _VecKindMmap) {
+		munmap(h, _vec_block_size(item_size, h->cap));
+		return;
+	}
+#endif
+	free(h);
+}
+
+/* Resizes the block behind h (which may be NULL) to hold new_cap items,
+ * switching between malloc() and mmap() at mmap_threshold bytes. The returned
+ * header's kind is set, but its len and cap are left to the caller. Returns
+ * NULL, leaving h untouched, if we run out of memory. */
+static _VecHeader *_vec_block_realloc(_VecHeader *h, size_t item_size, size_t new_cap, size_t mmap_threshold) {
+#ifdef VEC_FILE_SUPPORT
+	if (h != NULL && h->kind == _VecKindFile)
+		return _vec_file_realloc(h, item_size, new_cap);
+#endif
+	size_t new_size = _vec_block_size(item_size, new_cap);
+	_VecKind kind = _VecKindHeap;
+#ifdef MAP_ANONYMOUS
+	if (new_size >= mmap_threshold)
+		kind = _VecKindMmap;
+#else
+	(void)mmap_threshold;
+#endif
+	_VecHeader *new_h;
+	if (h != NULL && h->kind == kind) {
+		if (kind == _VecKindHeap)
+			new_h = realloc(h, new_size);
+		else {
+#if defined(MAP_ANONYMOUS) && defined(MREMAP_MAYMOVE)
+			/* The kernel just moves the page table entries around, so
+			 * nothing gets copied, and shrinking releases the cut off
+			 * pages. */
+			new_h = mremap(h, _vec_block_size(item_size, h->cap), new_size, MREMAP_MAYMOVE);
+			if (new_h == MAP_FAILED)
+				new_h = NULL;
+#else
+			new_h = _vec_block_alloc(new_size, kind);
+			if (new_h != NULL) {
+				memcpy(new_h, h, _vec_block_size(item_size, h->len));
+				_vec_block_free(h, item_size);
+			}
+#endif
+		}
+	} else {
+		new_h = _vec_block_alloc(new_size, kind);
+		if (new_h != NULL && h != NULL) {
+			memcpy(new_h, h, _vec_block_size(item_size, h->len));
+			_vec_block_free(h, item_size);
+		}
+	}
+	if (new_h != NULL)
+		new_h->kind = kind;
+	return new_h;
+}
+#endif
+
+#ifdef GENERIC_MMAP_THRESHOLD
+#define MMAP_THRESHOLD (GENERIC_MMAP_THRESHOLD)
+#else
+#define MMAP_THRESHOLD SIZE_MAX
 #endif
 
 static FUNCDEF(FmtPrintFuncRet, __print_func)(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
@@ -88,10 +409,14 @@ FUNCDEF(NAME, )() {
 }
 
 FUNCDEF(void, _term)(NAME v) {
-	for (size_t i = 0; i < vec_len(v); i++) {
-		GENERIC_TERM_ITEM((v[i]));
+	if (v == NULL)
+		return;
+	if (_VEC_HEADER(v)->kind != _VecKindFile) {
+		for (size_t i = 0; i < vec_len(v); i++) {
+			GENERIC_TERM_ITEM((v[i]));
+		}
 	}
-	free(_VEC_HEADER(v));
+	_vec_block_free(_VEC_HEADER(v), sizeof(TYPE));
 }
 
 FUNCDEF(void, _fmt_register)(const char *val_fmt) {
@@ -112,18 +437,18 @@ FUNCDEF(Error, _fit)(NAME *v, size_t new_minimum_cap) {
 		new_cap = new_minimum_cap < h->len ? h->len : new_minimum_cap;
 		len = h->len;
 	}
-	_VecHeader *new_h = realloc(h, sizeof(_VecHeader) + sizeof(TYPE) * new_cap);
+	_VecHeader *new_h = _vec_block_realloc(h, sizeof(TYPE), new_cap, MMAP_THRESHOLD);
 	if (new_h == NULL)
 		return ERROR_OUT_OF_MEMORY();
 	new_h->len = len;
-	new_h->cap = new_minimum_cap;
+	new_h->cap = new_cap;
 	*v = (NAME)(new_h + 1);
 	return OK();
 }
 
 FUNCDEF(Error, _push)(NAME *v, TYPE val) {
 	if (vec_len(*v) + 1 > vec_cap(*v))
-		TRY(FUNC(_fit)(v, vec_cap(*v) == 0 ? 8 : vec_cap(*v) * 2), );
+		TRY(FUNC(_fit)(v, GENERIC_GROWTH(vec_cap(*v))), );
 	(*v)[_VEC_HEADER(*v)->len++] = val;
 	return OK();
 }
@@ -148,14 +473,526 @@ FUNCDEF(TYPE, _del)(NAME v, size_t idx) {
 
 FUNCDEF(Error, _insert)(NAME *v, size_t idx, TYPE val) {
 	if (vec_len(*v) + 1 > vec_cap(*v))
-		TRY(FUNC(_fit)(v, vec_cap(*v) == 0 ? 8 : vec_cap(*v) * 2), );
+		TRY(FUNC(_fit)(v, GENERIC_GROWTH(vec_cap(*v))), );
 	memmove(*v + idx + 1, *v + idx, sizeof(TYPE) * (_VEC_HEADER(*v)->len++ - idx));
 	(*v)[idx] = val;
 	return OK();
 }
 
+/* Makes sure at least `additional` more items fit without reallocating,
+ * growing the capacity geometrically so repeated calls stay amortized O(1). */
+FUNCDEF(Error, _reserve)(NAME *v, size_t additional) {
+	size_t needed = vec_len(*v) + additional;
+	if (needed <= vec_cap(*v))
+		return OK();
+	size_t new_cap = GENERIC_GROWTH(vec_cap(*v));
+	return FUNC(_fit)(v, new_cap < needed ? needed : new_cap);
+}
+
+/* Appends n items. items must not point into v itself. */
+FUNCDEF(Error, _extend)(NAME *v, const TYPE *items, size_t n) {
+	if (n == 0)
+		return OK();
+	TRY(FUNC(_reserve)(v, n), );
+	memcpy(*v + _VEC_HEADER(*v)->len, items, sizeof(TYPE) * n);
+	_VEC_HEADER(*v)->len += n;
+	return OK();
+}
+
+/* Inserts n items before idx. items must not point into v itself. */
+FUNCDEF(Error, _insert_n)(NAME *v, size_t idx, const TYPE *items, size_t n) {
+	if (n == 0)
+		return OK();
+	TRY(FUNC(_reserve)(v, n), );
+	memmove(*v + idx + n, *v + idx, sizeof(TYPE) * (_VEC_HEADER(*v)->len - idx));
+	memcpy(*v + idx, items, sizeof(TYPE) * n);
+	_VEC_HEADER(*v)->len += n;
+	return OK();
+}
+
+/* Deletes the items in [begin, end). */
+FUNCDEF(void, _del_range)(NAME v, size_t begin, size_t end) {
+	if (begin >= end)
+		return;
+	for (size_t i = begin; i < end; i++) {
+		GENERIC_TERM_ITEM((v[i]));
+	}
+	memmove(v + begin, v + end, sizeof(TYPE) * (_VEC_HEADER(v)->len - end));
+	_VEC_HEADER(v)->len -= end - begin;
+}
+
+/* Like _del(), but moves the last item into the gap instead of shifting
+ * everything after idx, so it runs in O(1) but doesn't preserve order. */
+FUNCDEF(TYPE, _swap_del)(NAME v, size_t idx) {
+	TYPE val = v[idx];
+	GENERIC_TERM_ITEM((val));
+	v[idx] = v[--_VEC_HEADER(v)->len];
+	return val;
+}
+
+/* Grows the vector to new_len items, filling new slots with fill, or shrinks
+ * it, terminating the items which are cut off. */
+FUNCDEF(Error, _resize)(NAME *v, size_t new_len, TYPE fill) {
+	size_t len = vec_len(*v);
+	if (new_len <= len) {
+		if (new_len < len)
+			FUNC(_del_range)(*v, new_len, len);
+		return OK();
+	}
+	if (new_len > vec_cap(*v))
+		TRY(FUNC(_fit)(v, new_len), );
+	for (size_t i = len; i < new_len; i++)
+		(*v)[i] = fill;
+	_VEC_HEADER(*v)->len = new_len;
+	return OK();
+}
+
+/* Appends every item of src for which pred returns true to dst. Room for all
+ * of src is reserved up front, so call _shrink_to_fit() afterwards if few
+ * items are expected to match. src and dst must be different vectors. */
+FUNCDEF(Error, _filter_into)(NAME *dst, const NAME src, bool (*pred)(const TYPE *itm, void *ctx), void *ctx) {
+	size_t n = vec_len(src);
+	if (n == 0)
+		return OK();
+	TRY(FUNC(_reserve)(dst, n), );
+	TYPE *out = *dst + vec_len(*dst);
+	for (size_t i = 0; i < n; i++) {
+		*out = src[i];
+		out += pred(&src[i], ctx); /* branchless: always copy, only keep matches */
+	}
+	_VEC_HEADER(*dst)->len = out - *dst;
+	return OK();
+}
+
+/* Releases any unused capacity. */
+FUNCDEF(Error, _shrink_to_fit)(NAME *v) {
+	if (*v == NULL || vec_len(*v) == vec_cap(*v))
+		return OK();
+	if (vec_len(*v) == 0 && _VEC_HEADER(*v)->kind != _VecKindFile) {
+		_vec_block_free(_VEC_HEADER(*v), sizeof(TYPE));
+		*v = NULL;
+		return OK();
+	}
+	return FUNC(_fit)(v, vec_len(*v));
+}
+
+#ifdef VEC_FILE_SUPPORT
+FUNCDEF(Error, _create)(NAME *v, const char *path) {
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return _vec_file_error("open()");
+	if (ftruncate(fd, _vec_file_size(sizeof(TYPE), 0)) != 0) {
+		Error err = _vec_file_error("ftruncate()");
+		close(fd);
+		return err;
+	}
+	_VecHeader *h;
+	TRY(_vec_file_map(&h, fd, _vec_file_size(sizeof(TYPE), 0)), );
+	_VecFileHeader *fh = _VEC_FILE_HEADER(h);
+	memcpy(fh->magic, _VEC_FILE_MAGIC, sizeof(fh->magic));
+	fh->item_size = sizeof(TYPE);
+	*h = (_VecHeader){ .kind = _VecKindFile };
+	*v = (NAME)(h + 1);
+	return OK();
+}
+
+FUNCDEF(Error, _open)(NAME *v, const char *path) {
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return _vec_file_error("open()");
+	_VecFileHeader fh;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		Error err = _vec_file_error("fstat()");
+		close(fd);
+		return err;
+	}
+	if ((size_t)st.st_size < sizeof(fh) || pread(fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+			memcmp(fh.magic, _VEC_FILE_MAGIC, sizeof(fh.magic)) != 0) {
+		close(fd);
+		return ERROR_STRING("not a vector file");
+	}
+	if (fh.item_size != sizeof(TYPE) || fh.h.len > fh.h.cap ||
+			(uint64_t)st.st_size < _vec_file_size(sizeof(TYPE), fh.h.cap)) {
+		close(fd);
+		return ERROR_STRING("vector file doesn't match the item type");
+	}
+	_VecHeader *h;
+	TRY(_vec_file_map(&h, fd, _vec_file_size(sizeof(TYPE), fh.h.cap)), );
+	h->kind = _VecKindFile;
+	*v = (NAME)(h + 1);
+	return OK();
+}
+
+FUNCDEF(Error, _sync)(NAME v) {
+	_VecHeader *h = _VEC_HEADER(v);
+	if (msync(_VEC_FILE_HEADER(h), _VEC_FILE_MAP(h)->size, MS_SYNC) != 0)
+		return _vec_file_error("msync()");
+	return OK();
+}
+
+FUNCDEF(Error, _advise)(NAME v, VecAdvice advice) {
+	static const int advices[] = {
+		[VecAdviceNormal]     = POSIX_MADV_NORMAL,
+		[VecAdviceSequential] = POSIX_MADV_SEQUENTIAL,
+		[VecAdviceRandom]     = POSIX_MADV_RANDOM,
+		[VecAdviceWillNeed]   = POSIX_MADV_WILLNEED,
+	};
+	_VecHeader *h = _VEC_HEADER(v);
+	int err = posix_madvise(_VEC_FILE_HEADER(h), _VEC_FILE_MAP(h)->size, advices[advice]);
+	if (err != 0) {
+		errno = err;
+		return _vec_file_error("posix_madvise()");
+	}
+	return OK();
+}
+#endif
+
+#define PAR_JOB GENERIC_CONCAT(NAME, __ParJob)
+/* Items per task of _par_for_each/_par_reduce, at least. */
+#define PAR_MIN_CHUNK 4096
+
+typedef struct PAR_JOB {
+	NAME v;
+	size_t n_chunks;
+	void (*each_fn)(TYPE *itm, void *ctx);
+	void (*map_fn)(void *acc, const TYPE *itm, void *ctx);
+	unsigned char *accs; /* one per chunk, for _par_reduce */
+	size_t acc_size;
+	void *ctx;
+} PAR_JOB;
+
+/* A few chunks per thread, so threads which get delayed don't hold up the
+ * rest. */
+static FUNCDEF(size_t, __par_n_chunks)(size_t n, ThreadPool *pool) {
+	size_t max = thread_pool_size(pool) * 4;
+	size_t n_chunks = (n + PAR_MIN_CHUNK - 1) / PAR_MIN_CHUNK;
+	return n_chunks < max ? n_chunks : max;
+}
+
+static FUNCDEF(void, __par_task)(void *arg, size_t chunk) {
+	PAR_JOB *job = arg;
+	size_t n = vec_len(job->v);
+	size_t begin = n * chunk / job->n_chunks, end = n * (chunk + 1) / job->n_chunks;
+	if (job->each_fn != NULL) {
+		for (size_t i = begin; i < end; i++)
+			job->each_fn(&job->v[i], job->ctx);
+	} else {
+		void *acc = job->accs + chunk * job->acc_size;
+		for (size_t i = begin; i < end; i++)
+			job->map_fn(acc, &job->v[i], job->ctx);
+	}
+}
+
+FUNCDEF(void, _par_for_each)(NAME v, ThreadPool *pool, void (*fn)(TYPE *itm, void *ctx), void *ctx) {
+	PAR_JOB job = { .v = v, .n_chunks = FUNC(__par_n_chunks)(vec_len(v), pool), .each_fn = fn, .ctx = ctx };
+	thread_pool_run(pool, FUNC(__par_task), &job, job.n_chunks);
+}
+
+FUNCDEF(Error, _par_reduce)(const NAME v, ThreadPool *pool,
+		void (*map_fn)(void *acc, const TYPE *itm, void *ctx),
+		void (*reduce_fn)(void *acc, const void *other, void *ctx),
+		const void *identity, size_t acc_size, void *result, void *ctx) {
+	memcpy(result, identity, acc_size);
+	PAR_JOB job = { .v = v, .n_chunks = FUNC(__par_n_chunks)(vec_len(v), pool), .map_fn = map_fn, .acc_size = acc_size, .ctx = ctx };
+	if (job.n_chunks == 0)
+		return OK();
+	job.accs = malloc(acc_size * job.n_chunks);
+	if (job.accs == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	for (size_t i = 0; i < job.n_chunks; i++)
+		memcpy(job.accs + i * acc_size, identity, acc_size);
+	thread_pool_run(pool, FUNC(__par_task), &job, job.n_chunks);
+	for (size_t i = 0; i < job.n_chunks; i++)
+		reduce_fn(result, job.accs + i * acc_size, ctx);
+	free(job.accs);
+	return OK();
+}
+
+#undef PAR_JOB
+#undef PAR_MIN_CHUNK
+
+#ifdef GENERIC_CMP
+#define SORT_JOB GENERIC_CONCAT(NAME, __SortJob)
+#define SORT_MAX_THREADS 64
+
+static inline FUNCDEF(void, __swap)(TYPE *a, TYPE *b) {
+	TYPE tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static FUNCDEF(void, __insertion_sort)(TYPE *a, size_t n) {
+	for (size_t i = 1; i < n; i++) {
+		TYPE x = a[i];
+		size_t j = i;
+		for (; j > 0 && GENERIC_CMP(x, a[j - 1]) < 0; j--)
+			a[j] = a[j - 1];
+		a[j] = x;
+	}
+}
+
+static FUNCDEF(void, __sift_down)(TYPE *a, size_t i, size_t n) {
+	TYPE x = a[i];
+	for (;;) {
+		size_t child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && GENERIC_CMP(a[child], a[child + 1]) < 0)
+			child++;
+		if (GENERIC_CMP(x, a[child]) >= 0)
+			break;
+		a[i] = a[child];
+		i = child;
+	}
+	a[i] = x;
+}
+
+static FUNCDEF(void, __heap_sort)(TYPE *a, size_t n) {
+	for (size_t i = n / 2; i-- > 0;)
+		FUNC(__sift_down)(a, i, n);
+	for (size_t i = n; i-- > 1;) {
+		FUNC(__swap)(&a[0], &a[i]);
+		FUNC(__sift_down)(a, 0, i);
+	}
+}
+
+/* Quicksort which falls back to heapsort once it recursed too deep (i.e. it
+ * hit a bad case) and leaves small partitions to insertion sort. */
+static FUNCDEF(void, __introsort)(TYPE *a, size_t n, size_t depth) {
+	while (n > 16) {
+		if (depth == 0) {
+			FUNC(__heap_sort)(a, n);
+			return;
+		}
+		depth--;
+		size_t m = (n - 1) / 2;
+		if (GENERIC_CMP(a[m], a[0]) < 0)
+			FUNC(__swap)(&a[m], &a[0]);
+		if (GENERIC_CMP(a[n - 1], a[m]) < 0) {
+			FUNC(__swap)(&a[n - 1], &a[m]);
+			if (GENERIC_CMP(a[m], a[0]) < 0)
+				FUNC(__swap)(&a[m], &a[0]);
+		}
+		TYPE pivot = a[m];
+		/* Hoare partitioning into [0, j] and [j + 1, n). */
+		ptrdiff_t i = -1, j = n;
+		for (;;) {
+			do { i++; } while (GENERIC_CMP(a[i], pivot) < 0);
+			do { j--; } while (GENERIC_CMP(pivot, a[j]) < 0);
+			if (i >= j)
+				break;
+			FUNC(__swap)(&a[i], &a[j]);
+		}
+		/* Recurse into the smaller half to bound the stack depth. */
+		size_t left = j + 1;
+		if (left < n - left) {
+			FUNC(__introsort)(a, left, depth);
+			a += left;
+			n -= left;
+		} else {
+			FUNC(__introsort)(a + left, n - left, depth);
+			n = left;
+		}
+	}
+	FUNC(__insertion_sort)(a, n);
+}
+
+static FUNCDEF(void, __sort_range)(TYPE *a, size_t n) {
+	size_t depth = 0;
+	for (size_t i = n; i > 1; i >>= 1)
+		depth += 2;
+	FUNC(__introsort)(a, n, depth);
+}
+
+/* Sorts the vector in place, ordering items by GENERIC_CMP. Not stable. */
+FUNCDEF(void, _sort)(NAME v) {
+	FUNC(__sort_range)(v, vec_len(v));
+}
+
+/* Returns the index of the first item which doesn't compare less than key,
+ * or the length of the vector if there is none. v must be sorted. */
+FUNCDEF(size_t, _lower_bound)(const NAME v, TYPE key) {
+	size_t lo = 0, n = vec_len(v);
+	while (n > 0) {
+		size_t half = n / 2;
+		if (GENERIC_CMP(v[lo + half], key) < 0) {
+			lo += half + 1;
+			n -= half + 1;
+		} else
+			n = half;
+	}
+	return lo;
+}
+
+/* Returns an item comparing equal to key, or NULL. v must be sorted. */
+FUNCDEF(TYPE *, _binary_search)(NAME v, TYPE key) {
+	size_t i = FUNC(_lower_bound)(v, key);
+	if (i < vec_len(v) && GENERIC_CMP(v[i], key) == 0)
+		return &v[i];
+	return NULL;
+}
+
+typedef struct SORT_JOB {
+	const TYPE *a, *b;
+	size_t na, nb;
+	TYPE *dst; /* for sorting (b == NULL), a == dst */
+} SORT_JOB;
+
+/* Stable merge of a and b into dst. */
+static FUNCDEF(void, __merge)(const TYPE *a, size_t na, const TYPE *b, size_t nb, TYPE *dst) {
+	size_t i = 0, j = 0;
+	while (i < na && j < nb)
+		*dst++ = GENERIC_CMP(b[j], a[i]) < 0 ? b[j++] : a[i++];
+	memcpy(dst, a + i, sizeof(TYPE) * (na - i));
+	memcpy(dst + (na - i), b + j, sizeof(TYPE) * (nb - j));
+}
+
+/* Returns how many of the first k items of the merge of a and b come from a,
+ * so one merge can be split up between several threads. */
+static FUNCDEF(size_t, __merge_split)(size_t k, const TYPE *a, size_t na, const TYPE *b, size_t nb) {
+	size_t lo = k > nb ? k - nb : 0, hi = k < na ? k : na;
+	while (lo < hi) {
+		size_t i = lo + (hi - lo) / 2;
+		if (GENERIC_CMP(b[k - i - 1], a[i]) < 0)
+			hi = i;
+		else
+			lo = i + 1;
+	}
+	return lo;
+}
+
+static FUNCDEF(void, __sort_task)(void *arg, size_t i) {
+	SORT_JOB *job = (SORT_JOB *)arg + i;
+	if (job->b == NULL)
+		FUNC(__sort_range)(job->dst, job->na);
+	else
+		FUNC(__merge)(job->a, job->na, job->b, job->nb, job->dst);
+}
+
+/* Sorts the vector on the threads of pool: each thread sorts one chunk, then
+ * pairs of chunks are merged, splitting each merge between the threads until
+ * a single chunk is left. Needs a temporary buffer as large as the vector.
+ * Not stable. */
+FUNCDEF(Error, _sort_parallel)(NAME v, ThreadPool *pool) {
+	size_t n = vec_len(v);
+	size_t nthreads = thread_pool_size(pool);
+	if (nthreads > SORT_MAX_THREADS)
+		nthreads = SORT_MAX_THREADS;
+	if (nthreads <= 1 || n < 4096 * nthreads) {
+		FUNC(_sort)(v);
+		return OK();
+	}
+	TYPE *tmp = malloc(sizeof(TYPE) * n);
+	if (tmp == NULL)
+		return ERROR_OUT_OF_MEMORY();
+
+	SORT_JOB jobs[SORT_MAX_THREADS];
+	size_t bounds[SORT_MAX_THREADS + 1];
+	size_t nchunks = nthreads;
+	for (size_t i = 0; i <= nchunks; i++)
+		bounds[i] = n * i / nchunks;
+	for (size_t i = 0; i < nchunks; i++)
+		jobs[i] = (SORT_JOB){ .dst = v + bounds[i], .na = bounds[i + 1] - bounds[i] };
+	thread_pool_run(pool, FUNC(__sort_task), jobs, nchunks);
+
+	TYPE *src = v, *dst = tmp;
+	while (nchunks > 1) {
+		size_t npairs = nchunks / 2;
+		size_t parts_per_pair = nthreads / npairs;
+		size_t njobs = 0;
+		for (size_t p = 0; p < npairs; p++) {
+			const TYPE *a = src + bounds[2 * p], *b = src + bounds[2 * p + 1];
+			size_t na = bounds[2 * p + 1] - bounds[2 * p], nb = bounds[2 * p + 2] - bounds[2 * p + 1];
+			TYPE *out = dst + bounds[2 * p];
+			size_t prev_k = 0, prev_i = 0;
+			for (size_t part = 1; part <= parts_per_pair; part++) {
+				size_t k = (na + nb) * part / parts_per_pair;
+				size_t i = FUNC(__merge_split)(k, a, na, b, nb);
+				jobs[njobs++] = (SORT_JOB){
+					.a = a + prev_i, .na = i - prev_i,
+					.b = b + (prev_k - prev_i), .nb = (k - i) - (prev_k - prev_i),
+					.dst = out + prev_k,
+				};
+				prev_k = k;
+				prev_i = i;
+			}
+		}
+		thread_pool_run(pool, FUNC(__sort_task), jobs, njobs);
+		/* An odd chunk out just gets copied over. */
+		if (nchunks % 2 != 0)
+			memcpy(dst + bounds[nchunks - 1], src + bounds[nchunks - 1], sizeof(TYPE) * (n - bounds[nchunks - 1]));
+		for (size_t i = 0; i <= npairs; i++)
+			bounds[i] = bounds[2 * i < nchunks ? 2 * i : nchunks];
+		bounds[npairs + nchunks % 2] = n;
+		nchunks = npairs + nchunks % 2;
+		TYPE *swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != v)
+		memcpy(v, src, sizeof(TYPE) * n);
+	free(tmp);
+	return OK();
+}
+#undef SORT_JOB
+#undef SORT_MAX_THREADS
+#endif
+
+#ifdef GENERIC_RADIX_KEY
+/* Stable LSD radix sort on the 64-bit keys GENERIC_RADIX_KEY produces, one
+ * byte at a time. Passes over bytes that are the same for every key (e.g.
+ * the upper half of 32-bit keys) are skipped. */
+FUNCDEF(Error, _radix_sort)(NAME v) {
+	size_t n = vec_len(v);
+	if (n < 2)
+		return OK();
+	TYPE *tmp = malloc(sizeof(TYPE) * n);
+	if (tmp == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	size_t counts[8][256] = {0};
+	for (size_t i = 0; i < n; i++) {
+		uint64_t key = GENERIC_RADIX_KEY(v[i]);
+		for (size_t b = 0; b < 8; b++)
+			counts[b][(key >> (b * 8)) & 0xff]++;
+	}
+	TYPE *src = v, *dst = tmp;
+	for (size_t b = 0; b < 8; b++) {
+		size_t shift = b * 8;
+		if (counts[b][(GENERIC_RADIX_KEY(src[0]) >> shift) & 0xff] == n)
+			continue;
+		size_t offsets[256];
+		for (size_t i = 0, sum = 0; i < 256; i++) {
+			offsets[i] = sum;
+			sum += counts[b][i];
+		}
+		for (size_t i = 0; i < n; i++)
+			dst[offsets[(GENERIC_RADIX_KEY(src[i]) >> shift) & 0xff]++] = src[i];
+		TYPE *swap = src;
+		src = dst;
+		dst = swap;
+	}
+	if (src != v)
+		memcpy(v, src, sizeof(TYPE) * n);
+	free(tmp);
+	return OK();
+}
+#endif
+
 #undef _VEC_HEADER
+#undef MMAP_THRESHOLD
+
+#endif
 
+#undef GENERIC_GROWTH
+#ifdef GENERIC_RADIX_KEY
+#undef GENERIC_RADIX_KEY
+#endif
+#ifdef GENERIC_SIMD
+#undef GENERIC_SIMD
+#endif
+#ifdef GENERIC_MMAP_THRESHOLD
+#undef GENERIC_MMAP_THRESHOLD
 #endif
 
 #include "../internal/generic/end.h"
@@ -0,0 +1,30 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_INTERNAL_DTOA_H__
+#define __DS_INTERNAL_DTOA_H__
+
+/* Decimal digits of doubles, used by fmt's floating point printers.
+ *
+ * Both functions take a finite, nonzero x (the sign is ignored) and write
+ * its digits to digits, without leading or trailing zeros, setting *point
+ * such that |x| = 0.<digits> * 10^*point. They return the number of digits.
+ *
+ * _dtoa_shortest() returns the fewest digits which still parse back to x
+ * (picking the closest such number), using the Ryu algorithm by Ulf Adams.
+ * It writes at most 17 digits.
+ *
+ * _dtoa_exact() returns the exact value, which is always finite in decimal,
+ * for correctly rounding to a given precision. It writes at most
+ * DTOA_EXACT_MAX_DIGITS digits and is much slower for very large or small
+ * numbers. */
+
+#include <stddef.h>
+
+#define DTOA_SHORTEST_MAX_DIGITS 17
+#define DTOA_EXACT_MAX_DIGITS 800
+
+size_t _dtoa_shortest(double x, char *digits, int *point);
+size_t _dtoa_exact(double x, char *digits, int *point);
+
+#endif
@@ -2,6 +2,9 @@
 // SPDX license identifier: MIT
 
 #undef GENERIC_TERM_ITEM
+#ifdef GENERIC_CMP
+#undef GENERIC_CMP
+#endif
 
 #if defined(GENERIC_TYPE)
 #undef TYPE
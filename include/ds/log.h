@@ -0,0 +1,96 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_LOG_H__
+#define __DS_LOG_H__
+
+/* An asynchronous logger on top of fmt. log_fmt() only captures its arguments
+ * (see fmt_compiled_capture()) into a lock-free ring buffer of the calling
+ * thread; a background thread formats the messages and writes them to a file
+ * in large batches.
+ *
+ * Each log_fmt() call site compiles its format once, on its first call (see
+ * fmt_site_get()), so all loggers must be terminated before fmt_term(). Its
+ * arguments must be capturable: the builtin types are, custom types need a
+ * capture function (see fmt_register_capture()). Messages of one thread are
+ * written in order; messages of different threads may be interleaved in any
+ * order.
+
+Example Usage:
+
+Logger l;
+ERROR_ASSERT(logger_init(&l, "server.log", LogOverflowCount, 0));
+log_fmt(&l, "request %d from %s took %zu us\n", id, client, us);
+logger_term(&l); // writes all remaining messages
+
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define LOG_SUPPORT
+#endif
+
+#ifdef LOG_SUPPORT
+
+/* What log_fmt() does when its thread's ring buffer is full. */
+typedef enum LogOverflow {
+	LogOverflowBlock, /* wait until the background thread makes room */
+	LogOverflowDrop,  /* drop the message (see logger_dropped()) */
+	LogOverflowCount, /* drop it, and log how many were dropped */
+} LogOverflow;
+
+typedef struct _LogRing _LogRing;
+
+typedef struct Logger {
+	int fd;
+	bool own_fd;
+	FmtFd out; /* used by the background thread only */
+	LogOverflow overflow;
+	size_t ring_size;
+	pthread_key_t ring_key; /* the calling thread's _LogRing */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake_cond, flushed_cond;
+	_LogRing *rings;
+	size_t flush_requested, flush_done;
+	bool stop;
+	_Atomic bool sleeping; /* the background thread is idle */
+	_Atomic size_t dropped;
+	size_t dropped_reported;
+	struct Logger *next; /* all running loggers, for flushing at exit */
+} Logger;
+
+/* Starts a logger appending to the file at path (or writing to stdout if path
+ * is NULL). Each thread which logs gets a ring buffer of ring_size bytes
+ * (64 KiB if 0); messages taking more than half of it are always dropped.
+ *
+ * Loggers which haven't been terminated are flushed by an atexit() handler.
+ * That only works for loggers with static storage duration: one in main()'s
+ * stack frame no longer exists when atexit() handlers run after main()
+ * returns, so terminate it before returning. */
+Error logger_init(Logger *l, const char *restrict path, LogOverflow overflow, size_t ring_size);
+/* Writes all remaining messages and stops the logger. No thread may log to it
+ * anymore. */
+void logger_term(Logger *l);
+/* Waits until all messages logged before the call are written. */
+void logger_flush(Logger *l);
+/* Number of messages dropped so far. */
+static inline size_t logger_dropped(Logger *l) { return atomic_load_explicit(&l->dropped, memory_order_relaxed); }
+
+void _log_fmt(const char *restrict file, size_t line, Logger *l, FmtSite *site, const char *restrict format, ...);
+
+#define log_fmt(l, format, ...) do { \
+	static FmtSite _log_site; \
+	_log_fmt(__FILE__, __LINE__, l, &_log_site, format, ##__VA_ARGS__); \
+} while (0)
+
+#endif
+
+#endif
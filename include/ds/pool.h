@@ -0,0 +1,57 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_POOL_H__
+#define __DS_POOL_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <ds/error.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define THREAD_POOL_PTHREADS
+#endif
+
+/* A fixed set of worker threads which run batches of numbered tasks. The
+ * threads are created once and sleep between batches, so a batch costs a
+ * wakeup instead of a thread creation.
+ *
+ * Without pthreads, the pool has no workers and runs everything on the
+ * calling thread. */
+
+typedef void (*ThreadPoolTaskFunc)(void *ctx, size_t task);
+
+typedef struct ThreadPool {
+	size_t n_workers;
+#ifdef THREAD_POOL_PTHREADS
+	pthread_t *workers;
+	pthread_mutex_t run_mutex; /* one batch at a time */
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	size_t generation; /* incremented for every batch */
+	size_t n_busy; /* workers which haven't finished the current batch */
+	bool stop;
+#endif
+	/* Current batch */
+	ThreadPoolTaskFunc func;
+	void *ctx;
+	size_t n_tasks;
+	_Atomic size_t next_task;
+} ThreadPool;
+
+/* Starts a pool of nthreads threads (counting the thread which calls
+ * thread_pool_run()), or one per CPU if nthreads is 0. */
+Error thread_pool_init(ThreadPool *pool, size_t nthreads);
+void thread_pool_term(ThreadPool *pool);
+/* Number of threads working on a batch, including the calling thread. */
+size_t thread_pool_size(const ThreadPool *pool);
+/* Calls func(ctx, i) for every i in [0, n_tasks) and returns once all calls
+ * have returned. The calls are spread over the pool's threads and the calling
+ * thread, in no particular order. Tasks must not call thread_pool_run() on
+ * the same pool. */
+void thread_pool_run(ThreadPool *pool, ThreadPoolTaskFunc func, void *ctx, size_t n_tasks);
+
+#endif
@@ -0,0 +1,62 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_SIMD_H__
+#define __DS_SIMD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Vectorized search and reduction kernels over arrays of numbers.
+ *
+ * There is one set of functions per item type, named by the suffix:
+ * i8, u8, i16, u16, i32, u32, i64, u64, f32 (float) and f64 (double).
+ * On x86, the AVX2 version of a kernel is picked at runtime if the CPU
+ * supports it; otherwise the SSE2 (x86) or NEON (ARM) version is used.
+ *
+ * simd_find_*     returns the index of the first item equal to x, or n.
+ * simd_count_eq_* returns the number of items equal to x.
+ * simd_min_*,
+ * simd_max_*      return the smallest/largest item; n must not be 0. Like a
+ *                 plain loop starting at data[0], they ignore NaNs unless
+ *                 data[0] is NaN.
+ * simd_sum_*      returns the sum of all items. Integer sums are computed in
+ *                 64 bits, float sums in double precision. The order of
+ *                 floating point additions differs from a plain loop, so
+ *                 results may differ in the last bits.
+ *
+ * Vectors from ds/generic/vec.h get wrappers for these when GENERIC_SIMD is
+ * defined to one of the suffixes above. */
+
+typedef int64_t  simd_sum_i8_t;
+typedef uint64_t simd_sum_u8_t;
+typedef int64_t  simd_sum_i16_t;
+typedef uint64_t simd_sum_u16_t;
+typedef int64_t  simd_sum_i32_t;
+typedef uint64_t simd_sum_u32_t;
+typedef int64_t  simd_sum_i64_t;
+typedef uint64_t simd_sum_u64_t;
+typedef double   simd_sum_f32_t;
+typedef double   simd_sum_f64_t;
+
+#define _SIMD_DECLARE(sfx, type) \
+	size_t simd_find_##sfx(const type *data, size_t n, type x); \
+	size_t simd_count_eq_##sfx(const type *data, size_t n, type x); \
+	type simd_min_##sfx(const type *data, size_t n); \
+	type simd_max_##sfx(const type *data, size_t n); \
+	simd_sum_##sfx##_t simd_sum_##sfx(const type *data, size_t n);
+
+_SIMD_DECLARE(i8,  int8_t)
+_SIMD_DECLARE(u8,  uint8_t)
+_SIMD_DECLARE(i16, int16_t)
+_SIMD_DECLARE(u16, uint16_t)
+_SIMD_DECLARE(i32, int32_t)
+_SIMD_DECLARE(u32, uint32_t)
+_SIMD_DECLARE(i64, int64_t)
+_SIMD_DECLARE(u64, uint64_t)
+_SIMD_DECLARE(f32, float)
+_SIMD_DECLARE(f64, double)
+
+#undef _SIMD_DECLARE
+
+#endif
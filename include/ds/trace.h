@@ -0,0 +1,83 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __DS_TRACE_H__
+#define __DS_TRACE_H__
+
+/* Binary tracing with fmt. trace_fmt() doesn't format anything: it appends
+ * the ID of its format, a timestamp and the captured arguments (see
+ * fmt_compiled_capture()) to a trace file. Each format string is written to
+ * the file once, the first time it's used. ds-fmtdecode renders a trace file
+ * to text later, with the same print functions.
+ *
+ * Each trace_fmt() call site compiles its format on its first call (see
+ * fmt_site_get()), so all traces must be closed before fmt_term().
+ *
+ * The file is a header followed by records, all in multiples of 8 bytes, so it
+ * can be read in place with mmap(). It is in the byte order and type sizes of
+ * the machine which wrote it.
+ *
+ * Custom types need a capture function (see fmt_register_capture()) to be
+ * traced, and since ds-fmtdecode only knows the builtin types, decoding them
+ * takes a program of your own which registers them and calls trace_decode().
+
+Example Usage:
+
+Trace t;
+ERROR_ASSERT(trace_open(&t, "server.trace"));
+trace_fmt(&t, "request %d from %s took %zu us\n", id, client, us);
+ERROR_ASSERT(trace_close(&t));
+
+// Then: ds-fmtdecode server.trace
+
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ds/bitset.h>
+#include <ds/error.h>
+#include <ds/fmt.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define TRACE_SUPPORT
+#endif
+
+#ifdef TRACE_SUPPORT
+
+typedef struct Trace {
+	FmtFd out;
+	bool lost; /* an event was lost for lack of memory; see trace_flush() */
+	pthread_mutex_t mutex;
+	FmtBuf event; /* the event being recorded */
+	Bitset defined; /* site IDs whose format is already in the file */
+} Trace;
+
+/* Creates (or truncates) the trace file at path. */
+Error trace_open(Trace *t, const char *restrict path);
+/* Writes everything traced so far. Fails if a write failed, or an event was
+ * lost for lack of memory, since the last flush. */
+Error trace_flush(Trace *t);
+/* Flushes and closes the file; t can't be used anymore, even on error. */
+Error trace_close(Trace *t);
+
+void _trace_fmt(const char *restrict file, size_t line, Trace *t, FmtSite *site, const char *restrict format, ...);
+
+#define trace_fmt(t, format, ...) do { \
+	static FmtSite _trace_site; \
+	_trace_fmt(__FILE__, __LINE__, t, &_trace_site, format, ##__VA_ARGS__); \
+} while (0)
+
+#endif
+
+/* Renders the contents of a trace file to ctx, each event on its own line
+ * (unless its format ends in a newline already), prefixed with its time as
+ * "[seconds.nanoseconds] ". Events whose format doesn't compile, e.g.
+ * because it prints a type which isn't registered, are rendered as an error
+ * message. data must be 8 byte aligned, as it is when it's mmap()ed or
+ * malloc()ed. */
+Error trace_decode(FmtContext *restrict ctx, const void *restrict data, size_t size);
+
+#endif
@@ -0,0 +1,240 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/bitset.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+/* As in simd.c, the word kernels are compiled for the baseline target and,
+ * on x86, once more with AVX2 and POPCNT enabled, and picked at runtime. */
+
+#define WORDS(_bits) (((_bits) + 63) / 64)
+#define RANK_BLOCK_WORDS 8
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BITSET_X86
+#endif
+
+typedef uint64_t _v_words __attribute__((vector_size(32)));
+
+/* _expr works on both single words and vectors of them. */
+#define DEFINE_OP(impl, attr, name, _expr) \
+	attr static void _##name##_##impl(uint64_t *restrict dst, const uint64_t *restrict src, size_t n) { \
+		size_t i = 0; \
+		for (; i + 4 <= n; i += 4) { \
+			_v_words a, b; \
+			memcpy(&a, dst + i, sizeof(a)); \
+			memcpy(&b, src + i, sizeof(b)); \
+			a = _expr; \
+			memcpy(dst + i, &a, sizeof(a)); \
+		} \
+		for (; i < n; i++) { \
+			uint64_t a = dst[i], b = src[i]; \
+			dst[i] = _expr; \
+		} \
+	}
+
+#define DEFINE_KERNELS(impl, attr) \
+	DEFINE_OP(impl, attr, and, a & b) \
+	DEFINE_OP(impl, attr, or, a | b) \
+	DEFINE_OP(impl, attr, xor, a ^ b) \
+	DEFINE_OP(impl, attr, andnot, a & ~b) \
+	\
+	attr static size_t _count_##impl(const uint64_t *words, size_t n) { \
+		/* Independent sums, so the popcounts can run in parallel. */ \
+		size_t c0 = 0, c1 = 0, c2 = 0, c3 = 0; \
+		size_t i = 0; \
+		for (; i + 4 <= n; i += 4) { \
+			c0 += __builtin_popcountll(words[i]); \
+			c1 += __builtin_popcountll(words[i + 1]); \
+			c2 += __builtin_popcountll(words[i + 2]); \
+			c3 += __builtin_popcountll(words[i + 3]); \
+		} \
+		for (; i < n; i++) \
+			c0 += __builtin_popcountll(words[i]); \
+		return c0 + c1 + c2 + c3; \
+	}
+
+DEFINE_KERNELS(base, )
+
+#ifdef BITSET_X86
+DEFINE_KERNELS(avx2, __attribute__((target("avx2,popcnt"))))
+#define CALL(func, args) \
+	(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ? func##_avx2 args : func##_base args)
+#else
+#define CALL(func, args) (func##_base args)
+#endif
+
+static size_t count_words(const uint64_t *words, size_t n) {
+	return CALL(_count, (words, n));
+}
+
+static FmtPrintFuncRet print_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	if (attrs != NULL) {
+		if (attrs->len != 0)
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(0);
+	}
+	Bitset *b = va_arg(v, Bitset *);
+	for (size_t i = 0; i < b->len; i++)
+		ctx->putc_func(ctx, bitset_test(b, i) ? '1' : '0');
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+/* Clears the unused bits of the last word. */
+static void clear_tail(Bitset *b) {
+	if (b->len % 64 != 0)
+		b->words[b->len / 64] &= ((uint64_t)1 << (b->len % 64)) - 1;
+}
+
+Bitset bitset() {
+	return (Bitset){0};
+}
+
+void bitset_term(Bitset *b) {
+	free(b->words);
+}
+
+void bitset_fmt_register() {
+	fmt_register("Bitset", print_func);
+}
+
+Error bitset_resize(Bitset *b, size_t n) {
+	size_t old_words = WORDS(b->len), new_words = WORDS(n);
+	if (new_words > b->cap) {
+		size_t new_cap = b->cap == 0 ? 4 : b->cap * 2;
+		if (new_cap < new_words)
+			new_cap = new_words;
+		uint64_t *words = realloc(b->words, sizeof(uint64_t) * new_cap);
+		if (words == NULL)
+			return ERROR_OUT_OF_MEMORY();
+		b->words = words;
+		b->cap = new_cap;
+	}
+	if (new_words > old_words)
+		memset(b->words + old_words, 0, sizeof(uint64_t) * (new_words - old_words));
+	b->len = n;
+	clear_tail(b);
+	return OK();
+}
+
+Error bitset_push(Bitset *b, bool bit) {
+	if (b->len % 64 == 0) {
+		TRY(bitset_resize(b, b->len + 1), );
+	} else
+		b->len++;
+	bitset_assign(b, b->len - 1, bit);
+	return OK();
+}
+
+void bitset_fill(Bitset *b, bool bit) {
+	if (b->len == 0)
+		return;
+	memset(b->words, bit ? 0xff : 0, sizeof(uint64_t) * WORDS(b->len));
+	clear_tail(b);
+}
+
+size_t bitset_count(const Bitset *b) {
+	return count_words(b->words, WORDS(b->len));
+}
+
+/* Only and changes the words past the end of a shorter src (to 0). */
+#define DEFINE_PUBLIC_OP(name, _clear_rest) \
+	void bitset_##name(Bitset *dst, const Bitset *src) { \
+		size_t dst_words = WORDS(dst->len), src_words = WORDS(src->len); \
+		if (dst_words > src_words) { \
+			CALL(_##name, (dst->words, src->words, src_words)); \
+			if (_clear_rest) \
+				memset(dst->words + src_words, 0, sizeof(uint64_t) * (dst_words - src_words)); \
+		} else { \
+			CALL(_##name, (dst->words, src->words, dst_words)); \
+			clear_tail(dst); \
+		} \
+	}
+
+DEFINE_PUBLIC_OP(and, true)
+DEFINE_PUBLIC_OP(or, false)
+DEFINE_PUBLIC_OP(xor, false)
+DEFINE_PUBLIC_OP(andnot, false)
+
+#undef DEFINE_PUBLIC_OP
+
+size_t bitset_next_set_bit(const Bitset *b, size_t i) {
+	if (i >= b->len)
+		return b->len;
+	size_t w = i / 64;
+	uint64_t word = b->words[w] & (~(uint64_t)0 << (i % 64));
+	size_t n_words = WORDS(b->len);
+	while (word == 0) {
+		if (++w == n_words)
+			return b->len;
+		word = b->words[w];
+	}
+	return w * 64 + __builtin_ctzll(word);
+}
+
+Error bitset_rank_build(BitsetRank *r, const Bitset *b) {
+	size_t n_words = WORDS(b->len);
+	size_t n_blocks = (n_words + RANK_BLOCK_WORDS - 1) / RANK_BLOCK_WORDS;
+	/* One extra entry holding the total, so rank() works at len. */
+	uint64_t *blocks = malloc(sizeof(uint64_t) * (n_blocks + 1));
+	if (blocks == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	uint64_t sum = 0;
+	for (size_t i = 0; i < n_blocks; i++) {
+		blocks[i] = sum;
+		size_t start = i * RANK_BLOCK_WORDS;
+		size_t n = n_words - start < RANK_BLOCK_WORDS ? n_words - start : RANK_BLOCK_WORDS;
+		sum += count_words(b->words + start, n);
+	}
+	blocks[n_blocks] = sum;
+	r->blocks = blocks;
+	r->n_blocks = n_blocks;
+	return OK();
+}
+
+void bitset_rank_term(BitsetRank *r) {
+	free(r->blocks);
+}
+
+size_t bitset_rank(const BitsetRank *r, const Bitset *b, size_t i) {
+	size_t w = i / 64;
+	size_t block = w / RANK_BLOCK_WORDS;
+	if (block >= r->n_blocks)
+		return r->blocks[r->n_blocks];
+	size_t res = r->blocks[block];
+	for (size_t j = block * RANK_BLOCK_WORDS; j < w; j++)
+		res += __builtin_popcountll(b->words[j]);
+	if (i % 64 != 0)
+		res += __builtin_popcountll(b->words[w] & (((uint64_t)1 << (i % 64)) - 1));
+	return res;
+}
+
+size_t bitset_select(const BitsetRank *r, const Bitset *b, size_t k) {
+	if (k >= r->blocks[r->n_blocks])
+		return b->len;
+	/* Last block starting with at most k set bits before it. */
+	size_t lo = 0, hi = r->n_blocks - 1;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo + 1) / 2;
+		if (r->blocks[mid] <= k)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	k -= r->blocks[lo];
+	size_t w = lo * RANK_BLOCK_WORDS;
+	for (;;) {
+		size_t c = __builtin_popcountll(b->words[w]);
+		if (k < c)
+			break;
+		k -= c;
+		w++;
+	}
+	uint64_t word = b->words[w];
+	while (k-- > 0)
+		word &= word - 1; /* clear the lowest set bit */
+	return w * 64 + __builtin_ctzll(word);
+}
@@ -4,36 +4,224 @@
 #define GENERIC_IMPL_STATIC
 
 #include <ds/fmt.h>
+#include <ds/internal/dtoa.h>
 #include <ds/number.h>
 #include <ds/types.h>
 
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define GENERIC_TYPE   FmtPrintFunc
+/* How much space a captured argument takes (see fmt_compiled_capturev()):
+ * a fixed number of bytes, a null terminated string, or as much as its
+ * capture function appended, which is then stored before it. */
+#define _CAPTURED_SIZED  0
+#define _CAPTURED_STRING (-1)
+
+/* A print function and, if it has one, how to capture its argument (see
+ * fmt_register_capture()). */
+typedef struct _FmtPrinter {
+	FmtPrintFunc print;
+	FmtCaptureFunc capture;
+	FmtPrintFunc print_captured;
+	int captured_size; /* > 0 if fixed, else _CAPTURED_SIZED or _CAPTURED_STRING */
+} _FmtPrinter;
+
+#define GENERIC_TYPE   _FmtPrinter
 #define GENERIC_NAME   _PrintFuncMap
 #define GENERIC_PREFIX _print_func_map
 #include <ds/generic/smap.h>
 
-/* Contains all builtin and custom formatting functions. */
-static _PrintFuncMap _print_funcs;
-/* Whether the fmt library was initialized. */
-static bool initialized = false;
+#define GENERIC_TYPE   FmtAttrId
+#define GENERIC_NAME   _AttrIdMap
+#define GENERIC_PREFIX _attr_id_map
+#include <ds/generic/smap.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <sched.h>
+#define FMT_PTHREADS
+#endif
+
+#ifdef FMT_FD_SUPPORT
+#include <errno.h>
+#include <unistd.h>
+#endif
+
+/* All builtin and custom formatting functions. A published registry is never
+ * modified, so formatting only has to load _registry to look up functions,
+ * without any locks. fmt_register() publishes a modified copy instead, and
+ * frees the old one once no thread can be reading it anymore (see
+ * _FmtReader). Registration is rare, so the copies are cheap. */
+typedef struct _FmtRegistry {
+	_PrintFuncMap funcs;
+	_AttrIdMap attr_ids;
+	/* By ID; ID 0 is unused. The names themselves are shared by all copies,
+	 * so fmt_attr_name() can return them, and freed by fmt_term(). */
+	const char **attr_names;
+	size_t n_attrs;
+} _FmtRegistry;
+
+/* NULL if the fmt library isn't initialized. */
+static _Atomic(_FmtRegistry *) _registry = NULL;
+#ifdef FMT_PTHREADS
+/* Serializes fmt_register() and fmt_attr_register() calls. */
+static pthread_mutex_t _register_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/* A thread reading the registry makes its seq odd before loading it, and even
+ * again when done. To replace the registry, a writer publishes the new one,
+ * then waits for each reader whose seq it sees odd to move on, since only
+ * those may have loaded the old one. Every thread gets a slot of its own (see
+ * _registry_reader()), on its own cache line, so readers never write to
+ * memory other readers use, and never wait. */
+typedef struct _FmtReader {
+	_Alignas(64) _Atomic size_t seq;
+	_Atomic bool in_use; /* cleared when the thread exits, for reuse */
+	struct _FmtReader *next;
+} _FmtReader;
+
+#ifdef FMT_PTHREADS
+/* All slots, newest first; only freed by fmt_term(). */
+static _Atomic(_FmtReader *) _readers;
+/* The calling thread's slot. */
+static pthread_key_t _reader_key;
+#endif
+
+/* All compiled FmtSites, most recent first; see fmt_term(). */
+static FmtSite *_sites;
+static uint32_t _n_sites;
+#ifdef FMT_PTHREADS
+static pthread_mutex_t _site_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#ifdef FMT_PTHREADS
+static void _registry_reader_release(void *arg) {
+	_FmtReader *r = arg;
+	atomic_store_explicit(&r->in_use, false, memory_order_release);
+}
+
+/* The calling thread's slot, which it takes over from an exited thread or
+ * adds on its first read. */
+static _FmtReader *_registry_reader(void) {
+	_FmtReader *r = pthread_getspecific(_reader_key);
+	if (r != NULL)
+		return r;
+	for (r = atomic_load(&_readers); r != NULL; r = r->next) {
+		bool in_use = false;
+		if (atomic_compare_exchange_strong(&r->in_use, &in_use, true))
+			break;
+	}
+	if (r == NULL) {
+		r = aligned_alloc(_Alignof(_FmtReader), sizeof(_FmtReader));
+		if (r == NULL) {
+			ERROR_ASSERT(ERROR_OUT_OF_MEMORY_HERE());
+		}
+		atomic_init(&r->seq, 0);
+		atomic_init(&r->in_use, true);
+		r->next = atomic_load(&_readers);
+		while (!atomic_compare_exchange_weak(&_readers, &r->next, r));
+	}
+	pthread_setspecific(_reader_key, r);
+	return r;
+}
+#endif
+
+/* Loads the registry, which stays valid until _registry_read_end(reader).
+ * Keep the time in between short, since registering waits for it. */
+static _FmtRegistry *_registry_read_begin(_FmtReader **reader) {
+#ifdef FMT_PTHREADS
+	_FmtReader *r = _registry_reader();
+	/* Sequentially consistent, so a writer which published its registry
+	 * after we loaded ours sees the odd seq. */
+	atomic_store(&r->seq, atomic_load_explicit(&r->seq, memory_order_relaxed) + 1);
+	*reader = r;
+#else
+	*reader = NULL;
+#endif
+	return atomic_load(&_registry);
+}
+
+static void _registry_read_end(_FmtReader *reader) {
+#ifdef FMT_PTHREADS
+	atomic_store_explicit(&reader->seq, atomic_load_explicit(&reader->seq, memory_order_relaxed) + 1, memory_order_release);
+#else
+	(void)reader;
+#endif
+}
+
+static void _registry_free(_FmtRegistry *r) {
+	_print_func_map_term(r->funcs);
+	_attr_id_map_term(r->attr_ids);
+	free(r->attr_names);
+	free(r);
+}
+
+/* Publishes new in place of old, and frees old once it's unused. Call with
+ * _register_mutex held. */
+static void _registry_replace(_FmtRegistry *old, _FmtRegistry *new) {
+	/* A thread which sees the new registry also sees its contents, and
+	 * anything the caller set up before registering (such as the formats of
+	 * the generic containers). */
+	atomic_store(&_registry, new);
+#ifdef FMT_PTHREADS
+	for (_FmtReader *r = atomic_load(&_readers); r != NULL; r = r->next) {
+		size_t seq = atomic_load(&r->seq);
+		if (seq % 2 != 0) {
+			while (atomic_load_explicit(&r->seq, memory_order_acquire) == seq)
+				sched_yield();
+		}
+	}
+#endif
+	_registry_free(old);
+}
+
+static const char *const _builtin_attr_names[FmtAttrBuiltinEnd] = {
+	[FmtAttrPad]      = "p",
+	[FmtAttrPadChar]  = "c",
+	[FmtAttrHex]      = "x",
+	[FmtAttrHexUpper] = "X",
+	[FmtAttrOctal]    = "o",
+	[FmtAttrBase]     = "b",
+	[FmtAttrFixed]    = "f",
+	[FmtAttrExp]      = "e",
+	[FmtAttrGeneral]  = "g",
+	[FmtAttrPrec]     = "prec",
+	[FmtAttrDestroy]  = "destroy",
+};
 
 /********************************\
 |*    Builtin fmt Functions     *|
 \********************************/
+/* Writes n copies of c. */
+static void _pad(FmtContext *restrict ctx, char c, size_t n) {
+	char buf[64];
+	memset(buf, c, min(n, sizeof(buf)));
+	while (n > 0) {
+		size_t chunk = min(n, sizeof(buf));
+		fmt_write(ctx, buf, chunk);
+		n -= chunk;
+	}
+}
+
 static FmtPrintFuncRet _print_string_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
 	int pad = 0, padchar = ' ';
 	if (attrs != NULL) {
 		size_t i;
 		for (i = 0; i < attrs->len; i++) {
-			if (strcmp(attrs->names[i], "p") == 0) { 
-				pad = attrs->vals[i];
-			} else if (strcmp(attrs->names[i], "c") == 0) { 
-				padchar = attrs->vals[i];
-			} else {
-				return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
+			switch (attrs->ids[i]) {
+				case FmtAttrPad:
+					pad = attrs->vals[i];
+					break;
+				case FmtAttrPadChar:
+					padchar = attrs->vals[i];
+					break;
+				default:
+					return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
 			}
 		}
 	}
@@ -41,16 +229,77 @@ static FmtPrintFuncRet _print_string_func(FmtContext *restrict ctx, FmtAttrs *re
 	if (s == NULL)
 		s = "(null)";
 	size_t len = strlen(s);
-	if (pad > len) {
-		size_t j;
-		for (j = 0; j < pad - len; j++)
-			ctx->putc_func(ctx, padchar);
-	}
-	while (*s != 0)
-		ctx->putc_func(ctx, *s++);
+	if (pad > len)
+		_pad(ctx, padchar, pad - len);
+	fmt_write(ctx, s, len);
 	return FMT_PRINT_FUNC_RET_OK();
 }
 
+static const char _digits_lower[] = "0123456789abcdef";
+static const char _digits_upper[] = "0123456789ABCDEF";
+
+/* "00" to "99", for writing two decimal digits at a time. */
+static const char _digit_pairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static unsigned _count_digits10(unsigned long long int val) {
+	static const unsigned long long int pow10[] = {
+		1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+		100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+		10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+		100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+	};
+	if (val == 0)
+		return 1;
+	/* 1233 / 4096 is just above log10(2), so this is either the number of
+	 * digits or one more than it. */
+	unsigned bits = sizeof(val) * 8 - __builtin_clzll(val);
+	unsigned t = bits * 1233 >> 12;
+	return t + (val >= pow10[t]);
+}
+
+/* Writes the digits of val to buf and returns how many there are (at most 64). */
+static size_t _integer_to_str(char *restrict buf, unsigned long long int val, int base, bool uppercase) {
+	if (base == 10) {
+		size_t len = _count_digits10(val);
+		char *p = buf + len;
+		while (val >= 100) {
+			unsigned i = (val % 100) * 2;
+			val /= 100;
+			*--p = _digit_pairs[i + 1];
+			*--p = _digit_pairs[i];
+		}
+		if (val >= 10) {
+			*--p = _digit_pairs[val * 2 + 1];
+			*--p = _digit_pairs[val * 2];
+		} else
+			*--p = '0' + val;
+		return len;
+	}
+	const char *digits = uppercase ? _digits_upper : _digits_lower;
+	if ((base & (base - 1)) == 0) {
+		/* Powers of two: every digit is a group of bits. */
+		unsigned shift = __builtin_ctz(base), mask = base - 1;
+		unsigned bits = val == 0 ? 1 : sizeof(val) * 8 - __builtin_clzll(val);
+		size_t len = (bits + shift - 1) / shift;
+		for (size_t i = len; i-- > 0;) {
+			buf[i] = digits[val & mask];
+			val >>= shift;
+		}
+		return len;
+	}
+	char tmp[64];
+	size_t len = 0;
+	do {
+		tmp[sizeof(tmp) - ++len] = digits[val % base];
+		val /= base;
+	} while (val != 0);
+	memcpy(buf, tmp + sizeof(tmp) - len, len);
+	return len;
+}
+
 /* Helper function to print any integer. */
 static FmtPrintFuncRet _print_integer(FmtContext *restrict ctx, FmtAttrs *restrict attrs, unsigned long long int val, bool negative) {
 	int pad = 0, padchar = ' ', base = 10;
@@ -58,55 +307,51 @@ static FmtPrintFuncRet _print_integer(FmtContext *restrict ctx, FmtAttrs *restri
 	if (attrs != NULL) {
 		size_t i;
 		for (i = 0; i < attrs->len; i++) {
-			if (strcmp(attrs->names[i], "X") == 0) {
-				uppercase = true;
-				base = 16;
-			} else if (strcmp(attrs->names[i], "x") == 0) {
-				uppercase = false;
-				base = 16;
-			} else if (strcmp(attrs->names[i], "o") == 0) { 
-				base = 8;
-			} else if (strcmp(attrs->names[i], "p") == 0) { 
-				pad = attrs->vals[i];
-			} else if (strcmp(attrs->names[i], "c") == 0) { 
-				padchar = attrs->vals[i];
-			} else if (strcmp(attrs->names[i], "b") == 0) { 
-				base = attrs->vals[i];
-			} else {
-				return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
+			switch (attrs->ids[i]) {
+				case FmtAttrHexUpper:
+					uppercase = true;
+					base = 16;
+					break;
+				case FmtAttrHex:
+					uppercase = false;
+					base = 16;
+					break;
+				case FmtAttrOctal:
+					base = 8;
+					break;
+				case FmtAttrPad:
+					pad = attrs->vals[i];
+					break;
+				case FmtAttrPadChar:
+					padchar = attrs->vals[i];
+					break;
+				case FmtAttrBase:
+					base = attrs->vals[i];
+					break;
+				default:
+					return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
 			}
 		}
 	}
 	if (base < 2 || base > 16)
 		base = 10;
-	size_t i = 0;
 	char buf[65]; /* max: 64-bit binary number with negative sign */
-	if (val == 0)
-		buf[i++] = '0';
-	else {
-		char a_begin = uppercase ? 'A' : 'a';
-		while (val != 0) {
-			unsigned long long int rem = val % base;
-			buf[i++] = rem > 9 ? (rem - 10) + a_begin : rem + '0';
-			val /= base;
-		}
-		if (negative)
-			buf[i++] = '-';
-	}
-	if (pad > i) {
-		size_t j;
-		for (j = 0; j < pad - i; j++)
-			ctx->putc_func(ctx, padchar);
-	}
-	while (i--)
-		ctx->putc_func(ctx, buf[i]);
+	size_t len = 0;
+	if (negative && val != 0)
+		buf[len++] = '-';
+	len += _integer_to_str(buf + len, val, base, uppercase);
+	if (pad > len)
+		_pad(ctx, padchar, pad - len);
+	fmt_write(ctx, buf, len);
 	return FMT_PRINT_FUNC_RET_OK();
 }
 
+/* The magnitudes are computed as unsigned, so e.g. INT_MIN doesn't overflow. */
+
 static FmtPrintFuncRet _print_int_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
 	int val = va_arg(v, int);
 	if (val < 0)
-		return _print_integer(ctx, attrs, -val, true);
+		return _print_integer(ctx, attrs, 0ULL - (unsigned long long int)val, true);
 	else
 		return _print_integer(ctx, attrs, val, false);
 }
@@ -114,7 +359,7 @@ static FmtPrintFuncRet _print_int_func(FmtContext *restrict ctx, FmtAttrs *restr
 static FmtPrintFuncRet _print_lint_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
 	long int val = va_arg(v, long int);
 	if (val < 0)
-		return _print_integer(ctx, attrs, -val, true);
+		return _print_integer(ctx, attrs, 0ULL - (unsigned long long int)val, true);
 	else
 		return _print_integer(ctx, attrs, val, false);
 }
@@ -122,7 +367,7 @@ static FmtPrintFuncRet _print_lint_func(FmtContext *restrict ctx, FmtAttrs *rest
 static FmtPrintFuncRet _print_llint_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
 	long long int val = va_arg(v, long long int);
 	if (val < 0)
-		return _print_integer(ctx, attrs, -val, true);
+		return _print_integer(ctx, attrs, 0ULL - (unsigned long long int)val, true);
 	else
 		return _print_integer(ctx, attrs, val, false);
 }
@@ -144,7 +389,224 @@ static FmtPrintFuncRet _print_size_t_func(FmtContext *restrict ctx, FmtAttrs *re
 }
 
 static FmtPrintFuncRet _print_ssize_t_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
-	return _print_integer(ctx, attrs, va_arg(v, ssize_t), false);
+	ssize_t val = va_arg(v, ssize_t);
+	if (val < 0)
+		return _print_integer(ctx, attrs, 0ULL - (unsigned long long int)val, true);
+	else
+		return _print_integer(ctx, attrs, val, false);
+}
+
+/* Floating point numbers. The digits come from internal/dtoa.h: the shortest
+ * ones which parse back to the same double, or, for a given precision, the
+ * exact ones, rounded half to even like glibc's printf does. */
+
+enum {
+	_FLOAT_SHORTEST,
+	_FLOAT_F,
+	_FLOAT_E,
+	_FLOAT_G,
+};
+
+/* Rounds the n digits to keep digits, returning the new number of digits
+ * (without trailing zeros). Rounding all digits away leaves 0 digits, or 1 if
+ * the value rounded up to 10^*point. */
+static size_t _round_digits(char *restrict digits, size_t n, int *restrict point, int keep) {
+	if (keep < 0)
+		return 0;
+	if ((size_t)keep >= n)
+		return n;
+	char d = digits[keep];
+	bool up = d > '5' || (d == '5' && ((size_t)keep + 1 < n || (keep > 0 && (digits[keep - 1] - '0') % 2 == 1)));
+	n = keep;
+	if (up) {
+		while (n > 0 && digits[n - 1] == '9')
+			n--;
+		if (n == 0) {
+			digits[n++] = '1';
+			(*point)++;
+		} else
+			digits[n - 1]++;
+	} else {
+		while (n > 0 && digits[n - 1] == '0')
+			n--;
+	}
+	return n;
+}
+
+/* Writes the digits with n_frac digits after the decimal point. */
+static void _write_fixed(FmtContext *restrict ctx, const char *restrict digits, size_t n, int point, size_t n_frac) {
+	if (point <= 0)
+		ctx->putc_func(ctx, '0');
+	else {
+		size_t n_int = min(n, (size_t)point);
+		fmt_write(ctx, digits, n_int);
+		_pad(ctx, '0', point - n_int);
+	}
+	if (n_frac == 0)
+		return;
+	ctx->putc_func(ctx, '.');
+	size_t lead = point < 0 ? min(n_frac, (size_t)-point) : 0;
+	_pad(ctx, '0', lead);
+	size_t start = point > 0 ? point : 0;
+	size_t n_digits = start < n ? min(n - start, n_frac - lead) : 0;
+	fmt_write(ctx, digits + start, n_digits);
+	_pad(ctx, '0', n_frac - lead - n_digits);
+}
+
+/* Writes the digits as d.ddde+XX, with n_frac digits after the decimal point. */
+static void _write_exp(FmtContext *restrict ctx, const char *restrict digits, size_t n, int point, size_t n_frac) {
+	ctx->putc_func(ctx, n != 0 ? digits[0] : '0');
+	if (n_frac != 0) {
+		ctx->putc_func(ctx, '.');
+		size_t n_digits = n > 1 ? min(n - 1, n_frac) : 0;
+		fmt_write(ctx, digits + 1, n_digits);
+		_pad(ctx, '0', n_frac - n_digits);
+	}
+	int exp = n != 0 ? point - 1 : 0;
+	char buf[8];
+	size_t len = 0;
+	buf[len++] = 'e';
+	buf[len++] = exp < 0 ? '-' : '+';
+	if (exp < 0)
+		exp = -exp;
+	if (exp < 10)
+		buf[len++] = '0';
+	len += _integer_to_str(buf + len, exp, 10, false);
+	fmt_write(ctx, buf, len);
+}
+
+static size_t _exp_len(int exp) {
+	if (exp < 0)
+		exp = -exp;
+	return exp < 100 ? 4 : exp < 1000 ? 5 : 6;
+}
+
+/* Helper function to print any floating point number. prec < 0 means the
+ * style's default. */
+static void _print_float(FmtContext *restrict ctx, double val, int style, int prec, int pad, char padchar) {
+	bool negative = signbit(val);
+	const char *special = NULL;
+	if (isnan(val))
+		special = negative ? "-nan" : "nan";
+	else if (isinf(val))
+		special = negative ? "-inf" : "inf";
+	if (special != NULL) {
+		size_t len = strlen(special);
+		if (pad > len)
+			_pad(ctx, padchar, pad - len);
+		fmt_write(ctx, special, len);
+		return;
+	}
+
+	char digits[DTOA_EXACT_MAX_DIGITS];
+	size_t n = 0;
+	int point = 1; /* zero has no digits, but is printed as 0e+00 */
+	if (style == _FLOAT_SHORTEST && prec >= 0)
+		style = _FLOAT_F;
+	else if (style != _FLOAT_SHORTEST && prec < 0)
+		prec = 6;
+	if (val != 0) {
+		n = _dtoa_shortest(val, digits, &point);
+		if (style != _FLOAT_SHORTEST) {
+			int keep = style == _FLOAT_F ? point + prec : style == _FLOAT_E ? prec + 1 : max(prec, 1);
+			/* The shortest digits are usually enough:
+			 * - If they fit in keep digits, with at most 15 of them
+			 *   they are also the correctly rounded ones, as the grid of
+			 *   numbers with keep digits is then coarser than the
+			 *   (normal) doubles.
+			 * - If they don't fit, a rounding boundary between them and
+			 *   val would be a shorter or closer number parsing back to
+			 *   val, which Ryu would have returned instead. That leaves
+			 *   the case where they end exactly on a boundary. */
+			bool exact;
+			if ((int)n <= keep)
+				exact = keep > 15 || fabs(val) < DBL_MIN;
+			else
+				exact = (int)n == keep + 1 && digits[keep] == '5';
+			if (exact)
+				n = _dtoa_exact(val, digits, &point);
+			n = _round_digits(digits, n, &point, keep);
+			if (n == 0 && style == _FLOAT_F)
+				point = 1;
+		}
+	}
+
+	/* Decide on fixed or exponential notation and the digits after the
+	 * decimal point. */
+	bool exp_form;
+	size_t n_frac;
+	switch (style) {
+		default:
+		case _FLOAT_SHORTEST:
+			exp_form = point - 1 < -4 || point - 1 >= 16;
+			n_frac = exp_form ? (n > 1 ? n - 1 : 0) : ((int)n > point ? n - point : 0);
+			break;
+		case _FLOAT_F:
+			exp_form = false;
+			n_frac = prec;
+			break;
+		case _FLOAT_E:
+			exp_form = true;
+			n_frac = prec;
+			break;
+		case _FLOAT_G: {
+			/* Like printf's %g without the # flag: trailing zeros are
+			 * removed. */
+			int exp = n != 0 ? point - 1 : 0;
+			exp_form = exp < -4 || exp >= max(prec, 1);
+			n_frac = exp_form ? (n > 1 ? n - 1 : 0) : ((int)n > point ? n - point : 0);
+			break;
+		}
+	}
+
+	if (pad > 0) {
+		size_t len = negative + n_frac + (n_frac != 0);
+		if (exp_form)
+			len += 1 + _exp_len(n != 0 ? point - 1 : 0);
+		else
+			len += point > 0 ? point : 1;
+		if (pad > len)
+			_pad(ctx, padchar, pad - len);
+	}
+	if (negative)
+		ctx->putc_func(ctx, '-');
+	if (exp_form)
+		_write_exp(ctx, digits, n, point, n_frac);
+	else
+		_write_fixed(ctx, digits, n, point, n_frac);
+}
+
+static FmtPrintFuncRet _print_double_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	int pad = 0, padchar = ' ', prec = -1, style = _FLOAT_SHORTEST;
+	if (attrs != NULL) {
+		size_t i;
+		for (i = 0; i < attrs->len; i++) {
+			switch (attrs->ids[i]) {
+				case FmtAttrFixed:
+					style = _FLOAT_F;
+					break;
+				case FmtAttrExp:
+					style = _FLOAT_E;
+					break;
+				case FmtAttrGeneral:
+					style = _FLOAT_G;
+					break;
+				case FmtAttrPrec:
+					prec = attrs->vals[i];
+					break;
+				case FmtAttrPad:
+					pad = attrs->vals[i];
+					break;
+				case FmtAttrPadChar:
+					padchar = attrs->vals[i];
+					break;
+				default:
+					return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
+			}
+		}
+	}
+	_print_float(ctx, va_arg(v, double), style, prec, pad, padchar);
+	return FMT_PRINT_FUNC_RET_OK();
 }
 
 static void _print_error(FmtContext *restrict ctx, Error val, bool destroy) {
@@ -177,11 +639,10 @@ static FmtPrintFuncRet _print_error_func(FmtContext *restrict ctx, FmtAttrs *res
 	if (attrs != NULL) {
 		size_t i;
 		for (i = 0; i < attrs->len; i++) {
-			if (strcmp(attrs->names[i], "destroy") == 0) {
+			if (attrs->ids[i] == FmtAttrDestroy)
 				destroy = true;
-			} else {
+			else
 				return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
-			}
 		}
 	}
 	Error val = va_arg(v, Error);
@@ -256,6 +717,11 @@ static void _fmtf_putc_func(FmtContext *restrict ctx, char c) {
 	fputc(c, f);
 }
 
+static void _fmtf_write_func(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	FILE *f = ctx->ctx_data;
+	fwrite(buf, 1, n, f);
+}
+
 typedef struct _FmtsContext {
 	char *buf;
 	size_t size, written;
@@ -268,248 +734,700 @@ static void _fmts_putc_func(FmtContext *restrict ctx, char c) {
 	ctxs->written++;
 }
 
+static void _fmts_write_func(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	_FmtsContext *ctxs = ctx->ctx_data;
+	if (ctxs->size > 0 && ctxs->written < ctxs->size - 1)
+		memcpy(ctxs->buf + ctxs->written, buf, min(n, ctxs->size - 1 - ctxs->written));
+	ctxs->written += n;
+}
+
+/* Appends to an FmtBuf. b->buf may point to stack, which is never
+ * reallocated (see _fmta_finish()). Once an allocation fails, all further
+ * output is dropped and oom is set. */
+typedef struct _FmtbContext {
+	FmtBuf *b;
+	char *stack;
+	bool oom;
+} _FmtbContext;
+
+/* Makes room for n more chars and the null terminator. */
+static bool _fmtb_grow(_FmtbContext *restrict ctxb, size_t n) {
+	FmtBuf *b = ctxb->b;
+	if (ctxb->oom)
+		return false;
+	size_t needed = b->len + n + 1;
+	size_t new_cap = max(b->cap * 2, max(needed, (size_t)64));
+	char *buf;
+	if (b->buf != NULL && b->buf == ctxb->stack) {
+		buf = malloc(new_cap);
+		if (buf != NULL)
+			memcpy(buf, b->buf, b->len);
+	} else
+		buf = realloc(b->buf, new_cap);
+	if (buf == NULL) {
+		ctxb->oom = true;
+		return false;
+	}
+	b->buf = buf;
+	b->cap = new_cap;
+	return true;
+}
+
+static void _fmtb_putc_func(FmtContext *restrict ctx, char c) {
+	_FmtbContext *ctxb = ctx->ctx_data;
+	FmtBuf *b = ctxb->b;
+	if (b->len + 1 >= b->cap && !_fmtb_grow(ctxb, 1))
+		return;
+	b->buf[b->len++] = c;
+}
+
+static void _fmtb_write_func(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	_FmtbContext *ctxb = ctx->ctx_data;
+	FmtBuf *b = ctxb->b;
+	if (b->len + n >= b->cap && !_fmtb_grow(ctxb, n))
+		return;
+	memcpy(b->buf + b->len, buf, n);
+	b->len += n;
+}
+
+/* Null terminates the output, or, if an allocation failed, drops all of it
+ * (everything after start). */
+static Error _fmtb_finish(const char *restrict file, size_t line, _FmtbContext *restrict ctxb, size_t start) {
+	FmtBuf *b = ctxb->b;
+	if (b->buf == NULL)
+		_fmtb_grow(ctxb, 0);
+	if (ctxb->oom) {
+		b->len = start;
+		if (b->buf != NULL)
+			b->buf[b->len] = 0;
+		return ERROR_OUT_OF_MEMORY_LOCATION(file, line);
+	}
+	b->buf[b->len] = 0;
+	return OK();
+}
+
+/* Returns the output as a string of its own size, starting from a buffer on
+ * the stack, so short output only takes a single allocation. */
+static char *_fmta_finish(_FmtbContext *restrict ctxb, size_t *restrict out_len) {
+	FmtBuf *b = ctxb->b;
+	char *res;
+	if (ctxb->oom)
+		res = NULL;
+	else if (b->buf == ctxb->stack) {
+		res = malloc(b->len + 1);
+		if (res != NULL)
+			memcpy(res, b->buf, b->len);
+	} else {
+		res = realloc(b->buf, b->len + 1);
+		if (res == NULL)
+			res = b->buf;
+	}
+	if (res == NULL) {
+		if (b->buf != ctxb->stack)
+			free(b->buf);
+		return NULL;
+	}
+	res[b->len] = 0;
+	if (out_len != NULL)
+		*out_len = b->len;
+	return res;
+}
+
+#ifdef FMT_FD_SUPPORT
+/* Writes n iovecs completely, modifying them on partial writes. */
+static void _fmtfd_writev(FmtFd *restrict out, struct iovec *restrict iov, size_t n) {
+	while (n > 0) {
+		ssize_t res = writev(out->fd, iov, n);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (out->write_errno == 0)
+				out->write_errno = errno;
+			return;
+		}
+		while (n > 0 && (size_t)res >= iov->iov_len) {
+			res -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+}
+
+/* Ends the current segment of buf, so something else can be written after it. */
+static void _fmtfd_end_segment(FmtFd *restrict out) {
+	if (out->len > out->seg_start) {
+		out->iov[out->n_iov++] = (struct iovec){ .iov_base = out->buf + out->seg_start, .iov_len = out->len - out->seg_start };
+		out->seg_start = out->len;
+	}
+}
+
+/* Writes the buffer and all pending iovecs, in a single call if possible. */
+static void _fmtfd_flush(FmtFd *restrict out) {
+	_fmtfd_end_segment(out);
+	_fmtfd_writev(out, out->iov, out->n_iov);
+	out->len = out->seg_start = out->n_iov = 0;
+}
+
+/* Queues n chars at buf to be written without copying them; they must stay
+ * valid until the next flush. */
+static void _fmtfd_add_ref(FmtFd *restrict out, const char *restrict buf, size_t n) {
+	/* Leave room for the segment before buf and the one after it. */
+	if (out->n_iov + 3 > FMT_FD_MAX_IOVECS)
+		_fmtfd_flush(out);
+	_fmtfd_end_segment(out);
+	out->iov[out->n_iov++] = (struct iovec){ .iov_base = (char *)buf, .iov_len = n };
+}
+
+static void _fmtfd_putc_func(FmtContext *restrict ctx, char c) {
+	FmtFd *out = ctx->ctx_data;
+	if (out->len == out->cap)
+		_fmtfd_flush(out);
+	out->buf[out->len++] = c;
+}
+
+static void _fmtfd_write(FmtFd *restrict out, const char *restrict buf, size_t n) {
+	if (n > out->cap - out->len) {
+		if (n >= out->cap) {
+			/* Not worth copying; write it along with the buffer. */
+			_fmtfd_add_ref(out, buf, n);
+			_fmtfd_flush(out);
+			return;
+		}
+		_fmtfd_flush(out);
+	}
+	memcpy(out->buf + out->len, buf, n);
+	out->len += n;
+}
+
+static void _fmtfd_write_func(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	_fmtfd_write(ctx->ctx_data, buf, n);
+}
+
+static void _fmtfd_write_ref_func(FmtContext *restrict ctx, const char *restrict buf, size_t n) {
+	if (n < FMT_FD_SCATTER_MIN) {
+		_fmtfd_write_func(ctx, buf, n);
+		return;
+	}
+	_fmtfd_add_ref(ctx->ctx_data, buf, n);
+}
+#endif
 
 /********************************\
 |* The guts of any fmt function *|
 \********************************/
-static Error _fmt_main(bool use_err_location, const char *restrict file, size_t line, FmtContext *restrict ctx, const char *restrict format, va_list args) {
-	if (!initialized) {
-		const char *err_str = "fmt: fmt_init() must be called at the beginning of the program before using any other fmt functions, and fmt_term() must be called when done\n";
-		return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
+/* Format strings are parsed into ops, which are either a run of literal text
+ * or a call to a print function. The fmt functions parse and run one op at a
+ * time; fmt_compile() stores all of them. */
+typedef struct _FmtOp {
+	FmtPrintFunc func; /* NULL for literal text */
+	FmtCaptureFunc capture; /* set by fmt_compile() for the builtin conversions */
+	FmtPrintFunc print_captured;
+	int captured_size;
+	FmtAttrs *attrs;
+	unsigned star_mask; /* attrs whose value is taken from the arguments ('*') */
+	const char *lit;
+	size_t lit_len;
+} _FmtOp;
+
+struct FmtCompiled {
+	size_t n_ops;
+	_FmtOp *ops;
+	size_t capture_reserve; /* captured bytes which don't depend on the arguments */
+};
+
+static FmtPrintFuncRet _print_char_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	ctx->putc_func(ctx, va_arg(v, int));
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static FmtPrintFuncRet _print_pointer_func(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	static FmtAttrs pointer_attrs = {
+		.len  = 3,
+		.ids  = { FmtAttrPad, FmtAttrBase, FmtAttrPadChar },
+		.vals = {         12,          16,            '0' },
+	};
+	fmt_write(ctx, "0x", 2);
+	return _print_integer(ctx, &pointer_attrs, (size_t)va_arg(v, void *), false);
+}
+
+/********************************\
+|*      Capturing arguments     *|
+\********************************/
+/* Calls func with the arguments after attrs. */
+static FmtPrintFuncRet _call_print_func(FmtPrintFunc func, FmtContext *restrict ctx, FmtAttrs *restrict attrs, ...) {
+	va_list args;
+	va_start(args, attrs);
+	FmtPrintFuncRet res = func(ctx, attrs, args);
+	va_end(args);
+	return res;
+}
+
+/* Builtin types which are passed by value are captured as they are. */
+#define _CAPTURE_BY_VALUE(_name, _type, _print_func) \
+	static Error _capture_##_name(FmtBuf *restrict out, FmtAttrs *restrict attrs, va_list v) { \
+		_type val = va_arg(v, _type); \
+		return fmtb_append(out, (const char *)&val, sizeof(val)); \
+	} \
+	static FmtPrintFuncRet _print_captured_##_name(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) { \
+		_type val; \
+		memcpy(&val, va_arg(v, const void *), sizeof(val)); \
+		return _call_print_func(_print_func, ctx, attrs, val); \
+	} \
+	static const _FmtPrinter _printer_##_name = { _print_func, _capture_##_name, _print_captured_##_name, sizeof(_type) };
+
+_CAPTURE_BY_VALUE(int, int, _print_int_func)
+_CAPTURE_BY_VALUE(lint, long int, _print_lint_func)
+_CAPTURE_BY_VALUE(llint, long long int, _print_llint_func)
+_CAPTURE_BY_VALUE(uint, unsigned int, _print_uint_func)
+_CAPTURE_BY_VALUE(ulint, unsigned long int, _print_ulint_func)
+_CAPTURE_BY_VALUE(ullint, unsigned long long int, _print_ullint_func)
+_CAPTURE_BY_VALUE(size_t, size_t, _print_size_t_func)
+_CAPTURE_BY_VALUE(ssize_t, ssize_t, _print_ssize_t_func)
+_CAPTURE_BY_VALUE(double, double, _print_double_func)
+_CAPTURE_BY_VALUE(char, int, _print_char_func)
+_CAPTURE_BY_VALUE(pointer, void *, _print_pointer_func)
+
+#undef _CAPTURE_BY_VALUE
+
+/* Strings are copied, including the null terminator. */
+static Error _capture_string(FmtBuf *restrict out, FmtAttrs *restrict attrs, va_list v) {
+	const char *s = va_arg(v, const char *);
+	if (s == NULL)
+		s = "(null)";
+	return fmtb_append(out, s, strlen(s) + 1);
+}
+
+static FmtPrintFuncRet _print_captured_string(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	return _call_print_func(_print_string_func, ctx, attrs, (const char *)va_arg(v, const void *));
+}
+
+static const _FmtPrinter _printer_string = { _print_string_func, _capture_string, _print_captured_string, _CAPTURED_STRING };
+
+/* Errors may own heap memory (and be destroyed by printing them), so they are
+ * printed right away and captured as text. */
+static Error _capture_error(FmtBuf *restrict out, FmtAttrs *restrict attrs, va_list v) {
+	_FmtbContext ctxb = { .b = out };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	FmtPrintFuncRet res = _print_error_func(&ctx, attrs, v);
+	if (res.invalid_attr) {
+		char errbuf[256];
+		snprintf(errbuf, 256, "fmt: Invalid attribute: '%s'", fmt_attr_name(attrs->ids[res.invalid_attr_idx]));
+		return ERROR_HEAP_STRING(strdup(errbuf));
 	}
-	const char *c = format;
-	while (*c != 0) {
-		if (*c == '%')  {
-			c++;
-			if (*c == '{') {
-				FmtAttrs attrs = {0};
-				c++;
-				_Token t;
-				char name[128];
-				t = _next_token(&c, name, 128);
-				if (t != String) {
-					const char *err_str = "fmt: Expected valid type name after %{";
-					return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
-				}
-				FmtPrintFunc *print_func = _print_func_map_get(_print_funcs, name);
-				if (print_func == NULL) {
-					char errbuf[256];
-					snprintf(errbuf, 256, "fmt: Unrecognized type name: '%s'", name);
-					return use_err_location ? ERROR_HEAP_STRING_LOCATION(file, line, strdup(errbuf)) : ERROR_HEAP_STRING(strdup(errbuf));
-				}
-				t = _next_token(&c, NULL, 0);
-				if (t == Colon) {
-					while (attrs.len < FMT_MAX_ATTRS) {
-						t = _next_token(&c, attrs.names[attrs.len], FMT_MAX_ATTR_LEN);
-						if (t != String) {
-							const char *err_str = "fmt: Expected valid attribute name after %{<type>:";
-							return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
-						}
-						t = _next_token(&c, NULL, 0);
-						if (t == Equals) {
-							char num[64];
-							t = _next_token(&c, num, 64);
-							if (t != Number && t != CharLiteral && t != Asterisk) {
-								if (t == UnclosedCharLiteral) {
-									const char *err_str = "fmt: Char literal after %{<type>:<attr>= unclosed or containing more than one character";
-									return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
-								} else {
-									const char *err_str = "fmt: Expected number, char literal or asterisk after %{<type>:<attr>=";
-									return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
-								}
-							}
-							if (t == Number)
-								attrs.vals[attrs.len] = atoi(num);
-							else if (t == CharLiteral)
-								attrs.vals[attrs.len] = num[0];
-							else if (t == Asterisk)
-								attrs.vals[attrs.len] = va_arg(args, int);
-							t = _next_token(&c, NULL, 0);
-						} else
-							attrs.vals[attrs.len] = -1;
-						attrs.len++;
-						if (t == End)
-							break;
-						if (t != Comma) {
-							const char *err_str = "fmt: Expected ',' or '}' after %{<type>:<attr>=<val>";
-							return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
-						}
-					}
-				}
-				FmtPrintFuncRet res = (*print_func)(ctx, &attrs, args);
-				if (res.invalid_attr) {
+	_fmtb_putc_func(&ctx, 0);
+	if (ctxb.oom)
+		return ERROR_OUT_OF_MEMORY();
+	out->buf[out->len] = 0;
+	return OK();
+}
+
+static FmtPrintFuncRet _print_captured_text(FmtContext *restrict ctx, FmtAttrs *restrict attrs, va_list v) {
+	const char *s = va_arg(v, const void *);
+	fmt_write(ctx, s, strlen(s));
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static const _FmtPrinter _printer_error = { _print_error_func, _capture_error, _print_captured_text, _CAPTURED_STRING };
+
+/* The printers of the builtin conversions (%d etc.), by print function. */
+static const _FmtPrinter *const _builtin_printers[] = {
+	&_printer_int, &_printer_lint, &_printer_llint, &_printer_uint, &_printer_ulint, &_printer_ullint,
+	&_printer_size_t, &_printer_ssize_t, &_printer_double, &_printer_char, &_printer_pointer, &_printer_string,
+};
+
+/* Attributes of the builtin conversions; never modified. */
+static FmtAttrs _attrs_x = { .len = 1, .ids = { FmtAttrHex } };
+static FmtAttrs _attrs_X = { .len = 1, .ids = { FmtAttrHexUpper } };
+static FmtAttrs _attrs_f = { .len = 1, .ids = { FmtAttrFixed } };
+static FmtAttrs _attrs_e = { .len = 1, .ids = { FmtAttrExp } };
+static FmtAttrs _attrs_g = { .len = 1, .ids = { FmtAttrGeneral } };
+
+/* The ID of a builtin attribute name, or 0. Much faster than looking it up in
+ * the registry, which matters for the fmt functions, which parse every time. */
+static FmtAttrId _builtin_attr_id(const char *restrict name) {
+	for (FmtAttrId id = 1; id < FmtAttrBuiltinEnd; id++) {
+		const char *b = _builtin_attr_names[id];
+		if (b[0] == name[0] && strcmp(b, name) == 0)
+			return id;
+	}
+	return 0;
+}
+
+/* Parses the rest of a %{...} op, after its type name, with registry loaded. */
+static Error _parse_braced_op(const char **restrict c, _FmtOp *restrict op, FmtAttrs *restrict attrs, _FmtRegistry *restrict registry, const char *restrict name) {
+	_FmtPrinter *printer = _print_func_map_get(registry->funcs, name);
+	_Token t;
+	if (printer == NULL) {
+		char errbuf[256];
+		snprintf(errbuf, 256, "fmt: Unrecognized type name: '%s'", name);
+		return ERROR_HEAP_STRING(strdup(errbuf));
+	}
+	op->func = printer->print;
+	op->capture = printer->capture;
+	op->print_captured = printer->print_captured;
+	op->captured_size = printer->captured_size;
+	op->attrs = attrs;
+	t = _next_token(c, NULL, 0);
+	if (t == Colon) {
+		while (attrs->len < FMT_MAX_ATTRS) {
+			char attr_name[FMT_MAX_ATTR_LEN];
+			t = _next_token(c, attr_name, FMT_MAX_ATTR_LEN);
+			if (t != String)
+				return ERROR_STRING("fmt: Expected valid attribute name after %{<type>:");
+			FmtAttrId id = _builtin_attr_id(attr_name);
+			if (id == 0) {
+				FmtAttrId *custom_id = _attr_id_map_get(registry->attr_ids, attr_name);
+				if (custom_id == NULL) {
 					char errbuf[256];
-					snprintf(errbuf, 256, "fmt: Invalid attribute: '%s'", attrs.names[res.invalid_attr_idx]);
-					return use_err_location ? ERROR_HEAP_STRING_LOCATION(file, line, strdup(errbuf)) : ERROR_HEAP_STRING(strdup(errbuf));
-				}
-				if (t != End) {
-					const char *err_str = "fmt: Expected end";
-					return use_err_location ? ERROR_STRING_LOCATION(file, line, err_str) : ERROR_STRING(err_str);
+					snprintf(errbuf, 256, "fmt: Unrecognized attribute name: '%s'", attr_name);
+					return ERROR_HEAP_STRING(strdup(errbuf));
 				}
-			} else {
-				enum {
-					MOD_NONE,
-					MOD_Z,
-					MOD_L,
-					MOD_LL,
-					MOD_H,
-					MOD_HH,
-				};
-				int mod = MOD_NONE;
-				switch (*c) {
-					case 'z':
-						c++;
-						mod = MOD_Z;
-						break;
-					case 'l':
-						c++;
-						if (*c == 'l') {
-							c++;
-							mod = MOD_LL;
-						} else
-							mod = MOD_L;
-						break;
-					case 'h':
-						c++;
-						if (*c == 'h') {
-							c++;
-							mod = MOD_HH;
-						} else
-							mod = MOD_H;
-						break;
-				}
-				switch (*c) {
-					case '%':
-						c++;
-						ctx->putc_func(ctx, '%');
-						break;
-					case 's': {
-						c++;
-						_print_string_func(ctx, NULL, args);
-						break;
-					}
-					case 'c': {
-						c++;
-						ctx->putc_func(ctx, va_arg(args, int));
-						break;
-					}
-					case 'i':
-					case 'd':
-						c++;
-						switch (mod) {
-							default:
-							case MOD_H:
-							case MOD_HH:
-								_print_int_func(ctx, NULL, args);
-								break;
-							case MOD_Z:
-								_print_ssize_t_func(ctx, NULL, args);
-								break;
-							case MOD_L:
-								_print_lint_func(ctx, NULL, args);
-								break;
-							case MOD_LL:
-								_print_llint_func(ctx, NULL, args);
-								break;
-						}
-						break;
-					case 'u':
-						c++;
-						switch (mod) {
-							default:
-							case MOD_H:
-							case MOD_HH:
-								_print_uint_func(ctx, NULL, args);
-								break;
-							case MOD_Z:
-								_print_size_t_func(ctx, NULL, args);
-								break;
-							case MOD_L:
-								_print_ulint_func(ctx, NULL, args);
-								break;
-							case MOD_LL:
-								_print_ullint_func(ctx, NULL, args);
-								break;
-						}
-						break;
-					case 'x':
-						c++;
-						FmtAttrs custom_attrs = {
-							.len   = 1,
-							.names = { { 'x' } },
-						};
-						switch (mod) {
-							default:
-							case MOD_H:
-							case MOD_HH:
-								_print_uint_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_Z:
-								_print_size_t_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_L:
-								_print_ulint_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_LL:
-								_print_ullint_func(ctx, &custom_attrs, args);
-								break;
-						}
-						break;
-					case 'X': {
-						c++;
-						FmtAttrs custom_attrs = {
-							.len   = 1,
-							.names = { { 'X' } },
-						};
-						switch (mod) {
-							default:
-							case MOD_H:
-							case MOD_HH:
-								_print_uint_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_Z:
-								_print_size_t_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_L:
-								_print_ulint_func(ctx, &custom_attrs, args);
-								break;
-							case MOD_LL:
-								_print_ullint_func(ctx, &custom_attrs, args);
-								break;
-						}
-						break;
-					}
-					case 'p': {
-						c++;
-						ctx->putc_func(ctx, '0');
-						ctx->putc_func(ctx, 'x');
-						FmtAttrs custom_attrs = {
-							.len   = 3,
-							.names = { { 'p' }, { 'b' }, { 'c' } },
-							.vals  = {    12,      16,     '0'   },
-						};
-						_print_size_t_func(ctx, &custom_attrs, args);
-						break;
-					}
+				id = *custom_id;
+			}
+			attrs->ids[attrs->len] = id;
+			t = _next_token(c, NULL, 0);
+			if (t == Equals) {
+				char num[64];
+				t = _next_token(c, num, 64);
+				if (t != Number && t != CharLiteral && t != Asterisk) {
+					if (t == UnclosedCharLiteral)
+						return ERROR_STRING("fmt: Char literal after %{<type>:<attr>= unclosed or containing more than one character");
+					else
+						return ERROR_STRING("fmt: Expected number, char literal or asterisk after %{<type>:<attr>=");
 				}
+				if (t == Number)
+					attrs->vals[attrs->len] = atoi(num);
+				else if (t == CharLiteral)
+					attrs->vals[attrs->len] = num[0];
+				else if (t == Asterisk)
+					op->star_mask |= 1u << attrs->len;
+				t = _next_token(c, NULL, 0);
+			} else
+				attrs->vals[attrs->len] = -1;
+			attrs->len++;
+			if (t == End)
+				break;
+			if (t != Comma)
+				return ERROR_STRING("fmt: Expected ',' or '}' after %{<type>:<attr>=<val>");
+		}
+	}
+	if (t != End)
+		return ERROR_STRING("fmt: Expected end");
+	return OK();
+}
+
+/* Parses the op at *c, advancing *c past it. A %{...} op's attributes are
+ * written to attrs_buf. op is literal text of length 0 if *c is an
+ * unrecognized conversion: the '%' is dropped and what follows it is printed
+ * as literal text, e.g. "%y" prints "y". */
+static Error _parse_op(const char **restrict c, _FmtOp *restrict op, FmtAttrs *restrict attrs_buf) {
+	*op = (_FmtOp){0};
+	if (**c != '%') {
+		op->lit = *c;
+		while (**c != 0 && **c != '%')
+			(*c)++;
+		op->lit_len = *c - op->lit;
+		return OK();
+	}
+	(*c)++;
+	if (**c == '{') {
+		(*c)++;
+		FmtAttrs *attrs = attrs_buf;
+		*attrs = (FmtAttrs){0};
+		_Token t;
+		char name[128];
+		t = _next_token(c, name, 128);
+		if (t != String)
+			return ERROR_STRING("fmt: Expected valid type name after %{");
+		_FmtReader *reader;
+		_FmtRegistry *registry = _registry_read_begin(&reader);
+		Error res = _parse_braced_op(c, op, attrs, registry, name);
+		_registry_read_end(reader);
+		return res;
+	}
+	enum {
+		MOD_NONE,
+		MOD_Z,
+		MOD_L,
+		MOD_LL,
+		MOD_H,
+		MOD_HH,
+	};
+	int mod = MOD_NONE;
+	switch (**c) {
+		case 'z':
+			(*c)++;
+			mod = MOD_Z;
+			break;
+		case 'l':
+			(*c)++;
+			if (**c == 'l') {
+				(*c)++;
+				mod = MOD_LL;
+			} else
+				mod = MOD_L;
+			break;
+		case 'h':
+			(*c)++;
+			if (**c == 'h') {
+				(*c)++;
+				mod = MOD_HH;
+			} else
+				mod = MOD_H;
+			break;
+	}
+	switch (**c) {
+		case '%':
+			op->lit = (*c)++;
+			op->lit_len = 1;
+			break;
+		case 's':
+			(*c)++;
+			op->func = _print_string_func;
+			break;
+		case 'c':
+			(*c)++;
+			op->func = _print_char_func;
+			break;
+		case 'i':
+		case 'd':
+			(*c)++;
+			switch (mod) {
+				default:
+				case MOD_H:
+				case MOD_HH: op->func = _print_int_func;     break;
+				case MOD_Z:  op->func = _print_ssize_t_func; break;
+				case MOD_L:  op->func = _print_lint_func;    break;
+				case MOD_LL: op->func = _print_llint_func;   break;
 			}
-		} else
-			ctx->putc_func(ctx, *c++);
+			break;
+		case 'x':
+		case 'X':
+			op->attrs = **c == 'x' ? &_attrs_x : &_attrs_X;
+			/* fallthrough */
+		case 'u':
+			(*c)++;
+			switch (mod) {
+				default:
+				case MOD_H:
+				case MOD_HH: op->func = _print_uint_func;   break;
+				case MOD_Z:  op->func = _print_size_t_func; break;
+				case MOD_L:  op->func = _print_ulint_func;  break;
+				case MOD_LL: op->func = _print_ullint_func; break;
+			}
+			break;
+		case 'p':
+			(*c)++;
+			op->func = _print_pointer_func;
+			break;
+		case 'f':
+		case 'e':
+		case 'g':
+			op->attrs = **c == 'f' ? &_attrs_f : **c == 'e' ? &_attrs_e : &_attrs_g;
+			(*c)++;
+			op->func = _print_double_func;
+			break;
+	}
+	return OK();
+}
+
+/* Writes n chars which stay valid until the fmt call returns, so they may be
+ * referenced rather than copied. */
+typedef void (*_FmtWriteRefFunc)(FmtContext *restrict ctx, const char *restrict buf, size_t n);
+
+/* write_ref, if not NULL, gets the top level plain %s arguments. They can't be
+ * passed on through ctx, since print functions also use it to print their own
+ * temporary strings. */
+static Error _run_op(FmtContext *restrict ctx, const _FmtOp *restrict op, va_list args, _FmtWriteRefFunc write_ref) {
+	if (op->func == NULL) {
+		if (op->lit_len != 0)
+			fmt_write(ctx, op->lit, op->lit_len);
+		return OK();
+	}
+	if (write_ref != NULL && op->func == _print_string_func && (op->attrs == NULL || op->attrs->len == 0)) {
+		const char *s = va_arg(args, const char *);
+		if (s == NULL)
+			s = "(null)";
+		write_ref(ctx, s, strlen(s));
+		return OK();
+	}
+	FmtAttrs *attrs = op->attrs;
+	FmtAttrs star_attrs;
+	if (op->star_mask != 0) {
+		star_attrs = *attrs;
+		for (size_t i = 0; i < star_attrs.len; i++) {
+			if (op->star_mask & (1u << i))
+				star_attrs.vals[i] = va_arg(args, int);
+		}
+		attrs = &star_attrs;
+	}
+	FmtPrintFuncRet res = op->func(ctx, attrs, args);
+	if (res.invalid_attr) {
+		char errbuf[256];
+		snprintf(errbuf, 256, "fmt: Invalid attribute: '%s'", fmt_attr_name(attrs->ids[res.invalid_attr_idx]));
+		return ERROR_HEAP_STRING(strdup(errbuf));
 	}
 	return OK();
 }
 
+static Error _check_initialized() {
+	if (atomic_load_explicit(&_registry, memory_order_relaxed) == NULL)
+		return ERROR_STRING("fmt: fmt_init() must be called at the beginning of the program before using any other fmt functions, and fmt_term() must be called when done\n");
+	return OK();
+}
+
+static Error _fmt_main(FmtContext *restrict ctx, const char *restrict format, va_list args, _FmtWriteRefFunc write_ref) {
+	TRY(_check_initialized(), );
+	const char *c = format;
+	while (*c != 0) {
+		if (*c != '%') {
+			const char *lit = c;
+			while (*c != 0 && *c != '%')
+				c++;
+			fmt_write(ctx, lit, c - lit);
+			continue;
+		}
+		_FmtOp op;
+		FmtAttrs attrs;
+		TRY(_parse_op(&c, &op, &attrs), );
+		TRY(_run_op(ctx, &op, args, write_ref), );
+	}
+	return OK();
+}
+
+static Error _fmt_compiled_main(FmtContext *restrict ctx, const FmtCompiled *restrict f, va_list args, _FmtWriteRefFunc write_ref) {
+	TRY(_check_initialized(), );
+	for (size_t i = 0; i < f->n_ops; i++)
+		TRY(_run_op(ctx, &f->ops[i], args, write_ref), );
+	return OK();
+}
+
 /********************************\
 |*       Public functions       *|
 \********************************/
+/* Returns an unpublished copy of old, with room for one more attribute name. */
+static _FmtRegistry *_registry_copy(_FmtRegistry *old) {
+	_FmtRegistry *new = malloc(sizeof(_FmtRegistry));
+	const char **attr_names = malloc(sizeof(*attr_names) * (old->n_attrs + 1));
+	if (new == NULL || attr_names == NULL) {
+		ERROR_ASSERT(ERROR_OUT_OF_MEMORY_HERE());
+	}
+	memcpy(attr_names, old->attr_names, sizeof(*attr_names) * old->n_attrs);
+	*new = (_FmtRegistry){
+		.funcs = _print_func_map(),
+		.attr_ids = _attr_id_map(),
+		.attr_names = attr_names,
+		.n_attrs = old->n_attrs,
+	};
+	ERROR_ASSERT(_print_func_map_rehash(&new->funcs, (old->funcs.len + 1) * 2));
+	_PrintFuncMapItem *it = NULL;
+	while (_print_func_map_it_next(old->funcs, &it))
+		ERROR_ASSERT(_print_func_map_set(&new->funcs, it->key, it->val));
+	ERROR_ASSERT(_attr_id_map_rehash(&new->attr_ids, (old->attr_ids.len + 1) * 2));
+	_AttrIdMapItem *attr_it = NULL;
+	while (_attr_id_map_it_next(old->attr_ids, &attr_it))
+		ERROR_ASSERT(_attr_id_map_set(&new->attr_ids, attr_it->key, attr_it->val));
+	return new;
+}
+
+/* Gives name the next attribute ID in r, which must have room for it. name
+ * must live until fmt_term(), which frees the names of custom attributes. */
+static FmtAttrId _registry_add_attr(_FmtRegistry *r, const char *name) {
+	if (strlen(name) >= FMT_MAX_ATTR_LEN) {
+		ERROR_ASSERT(ERROR_STRING("fmt: Attribute name too long"));
+	}
+	if (r->n_attrs > UINT16_MAX) {
+		ERROR_ASSERT(ERROR_STRING("fmt: Too many attribute names"));
+	}
+	FmtAttrId id = r->n_attrs++;
+	r->attr_names[id] = name;
+	ERROR_ASSERT(_attr_id_map_set(&r->attr_ids, name, id));
+	return id;
+}
+
+/* Publishes a copy of the registry with keyword set to printer. If update is
+ * true, keyword must exist, and only the capture functions are set. */
+static void _register(const char *restrict keyword, _FmtPrinter printer, bool update) {
+#ifdef FMT_PTHREADS
+	pthread_mutex_lock(&_register_mutex);
+#endif
+	_FmtRegistry *old = atomic_load_explicit(&_registry, memory_order_relaxed);
+	if (old == NULL) {
+		ERROR_ASSERT(ERROR_STRING("fmt: fmt_register() called while fmt uninitialized"));
+	}
+	if (update) {
+		_FmtPrinter *existing = _print_func_map_get(old->funcs, keyword);
+		if (existing == NULL) {
+			ERROR_ASSERT(ERROR_STRING("fmt: fmt_register_capture() called for a type which isn't registered"));
+		}
+		printer.print = existing->print;
+	}
+	_FmtRegistry *new = _registry_copy(old);
+	ERROR_ASSERT(_print_func_map_set(&new->funcs, keyword, printer));
+	_registry_replace(old, new);
+#ifdef FMT_PTHREADS
+	pthread_mutex_unlock(&_register_mutex);
+#endif
+}
+
+FmtAttrId fmt_attr_register(const char *restrict name) {
+#ifdef FMT_PTHREADS
+	pthread_mutex_lock(&_register_mutex);
+#endif
+	_FmtRegistry *old = atomic_load_explicit(&_registry, memory_order_relaxed);
+	if (old == NULL) {
+		ERROR_ASSERT(ERROR_STRING("fmt: fmt_attr_register() called while fmt uninitialized"));
+	}
+	FmtAttrId *existing = _attr_id_map_get(old->attr_ids, name);
+	FmtAttrId id;
+	if (existing != NULL)
+		id = *existing;
+	else {
+		char *name_copy = strdup(name);
+		if (name_copy == NULL) {
+			ERROR_ASSERT(ERROR_OUT_OF_MEMORY_HERE());
+		}
+		_FmtRegistry *new = _registry_copy(old);
+		id = _registry_add_attr(new, name_copy);
+		_registry_replace(old, new);
+	}
+#ifdef FMT_PTHREADS
+	pthread_mutex_unlock(&_register_mutex);
+#endif
+	return id;
+}
+
+const char *fmt_attr_name(FmtAttrId id) {
+	_FmtReader *reader;
+	_FmtRegistry *r = _registry_read_begin(&reader);
+	const char *res = "(unknown)";
+	if (r != NULL && id != 0 && id < r->n_attrs)
+		res = r->attr_names[id];
+	_registry_read_end(reader);
+	return res;
+}
+
 void fmt_register(const char *restrict keyword, FmtPrintFunc print_func) {
-	_print_func_map_set(&_print_funcs, keyword, print_func);
+	_register(keyword, (_FmtPrinter){ .print = print_func }, false);
+}
+
+void fmt_register_capture(const char *restrict keyword, FmtCaptureFunc capture, FmtPrintFunc print_captured) {
+	_register(keyword, (_FmtPrinter){ .capture = capture, .print_captured = print_captured }, true);
 }
 
 void _fmtv(const char *restrict file, size_t line, const char *restrict format, va_list args) {
 	FmtContext ctx = {
 		.ctx_data = stdout,
 		.putc_func = _fmtf_putc_func,
+		.write_func = _fmtf_write_func,
 	};
 	_fmtcv(file, line, &ctx, format, args);
 }
@@ -529,6 +1447,7 @@ size_t _fmtsv(const char *restrict file, size_t line, char *restrict buf, size_t
 	FmtContext ctx = {
 		.ctx_data = &ctxs,
 		.putc_func = _fmts_putc_func,
+		.write_func = _fmts_write_func,
 	};
 	_fmtcv(file, line, &ctx, format, args);
 	if (size > 0)
@@ -545,7 +1464,7 @@ size_t _fmts(const char *restrict file, size_t line, char *restrict buf, size_t
 }
 
 void _fmtcv(const char *restrict file, size_t line, FmtContext *restrict ctx, const char *restrict format, va_list args) {
-	ERROR_ASSERT(_fmt_main(true, file, line, ctx, format, args));
+	ERROR_ASSERT(_error_hereify(file, line, _fmt_main(ctx, format, args, NULL)));
 }
 
 void _fmtc(const char *restrict file, size_t line, FmtContext *restrict ctx, const char *restrict format, ...) {
@@ -555,30 +1474,509 @@ void _fmtc(const char *restrict file, size_t line, FmtContext *restrict ctx, con
 	va_end(args);
 }
 
+char *_fmtav(const char *restrict file, size_t line, size_t *restrict out_len, const char *restrict format, va_list args) {
+	char stack[256];
+	FmtBuf b = { .buf = stack, .cap = sizeof(stack) };
+	_FmtbContext ctxb = { .b = &b, .stack = stack };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	_fmtcv(file, line, &ctx, format, args);
+	return _fmta_finish(&ctxb, out_len);
+}
+
+char *_fmta(const char *restrict file, size_t line, size_t *restrict out_len, const char *restrict format, ...) {
+	va_list args;
+	va_start(args, format);
+	char *res = _fmtav(file, line, out_len, format, args);
+	va_end(args);
+	return res;
+}
+
+Error _fmtbv(const char *restrict file, size_t line, FmtBuf *restrict b, const char *restrict format, va_list args) {
+	_FmtbContext ctxb = { .b = b };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	size_t start = b->len;
+	_fmtcv(file, line, &ctx, format, args);
+	return _fmtb_finish(file, line, &ctxb, start);
+}
+
+Error _fmtb(const char *restrict file, size_t line, FmtBuf *restrict b, const char *restrict format, ...) {
+	va_list args;
+	va_start(args, format);
+	Error res = _fmtbv(file, line, b, format, args);
+	va_end(args);
+	return res;
+}
+
+void fmtb_term(FmtBuf *b) {
+	free(b->buf);
+}
+
+Error _fmtb_reserve_slow(FmtBuf *b, size_t additional) {
+	_FmtbContext ctxb = { .b = b };
+	if (!_fmtb_grow(&ctxb, additional))
+		return ERROR_OUT_OF_MEMORY();
+	return OK();
+}
+
+Error fmt_compile(FmtCompiled **res, const char *restrict format) {
+	TRY(_check_initialized(), );
+	/* Count the ops and attribute sets first, so everything (including a copy
+	 * of format for the literal text) fits in a single allocation. */
+	size_t n_ops = 0, n_attrs = 0;
+	FmtAttrs attrs;
+	for (const char *c = format; *c != 0;) {
+		_FmtOp op;
+		TRY(_parse_op(&c, &op, &attrs), );
+		if (op.func == NULL && op.lit_len == 0)
+			continue;
+		n_ops++;
+		n_attrs += op.attrs == &attrs;
+	}
+	size_t format_size = strlen(format) + 1;
+	FmtCompiled *f = malloc(sizeof(FmtCompiled) + sizeof(_FmtOp) * n_ops + sizeof(FmtAttrs) * n_attrs + format_size);
+	if (f == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	f->n_ops = 0;
+	f->ops = (_FmtOp *)(f + 1);
+	f->capture_reserve = 0;
+	FmtAttrs *next_attrs = (FmtAttrs *)(f->ops + n_ops);
+	char *format_copy = (char *)(next_attrs + n_attrs);
+	memcpy(format_copy, format, format_size);
+	for (const char *c = format_copy; *c != 0;) {
+		_FmtOp op;
+		ERROR_ASSERT(_parse_op(&c, &op, next_attrs)); /* can't fail, it already worked once */
+		if (op.func == NULL && op.lit_len == 0)
+			continue;
+		for (size_t i = 0; op.capture == NULL && i < sizeof(_builtin_printers) / sizeof(_builtin_printers[0]); i++) {
+			if (op.func == _builtin_printers[i]->print) {
+				op.capture = _builtin_printers[i]->capture;
+				op.print_captured = _builtin_printers[i]->print_captured;
+				op.captured_size = _builtin_printers[i]->captured_size;
+			}
+		}
+		if (op.func != NULL) {
+			for (unsigned m = op.star_mask; m != 0; m &= m - 1)
+				f->capture_reserve += 8;
+			f->capture_reserve += op.captured_size > 0 ? (op.captured_size + 7) / 8 * 8 : 8;
+		}
+		f->ops[f->n_ops++] = op;
+		next_attrs += op.attrs == next_attrs;
+	}
+	*res = f;
+	return OK();
+}
+
+void fmt_compiled_term(FmtCompiled *f) {
+	free(f);
+}
+
+FmtCompiled *_fmt_site_compile(const char *restrict file, size_t line, FmtSite *site, const char *restrict format) {
+#ifdef FMT_PTHREADS
+	pthread_mutex_lock(&_site_mutex);
+#endif
+	FmtCompiled *f = atomic_load_explicit(&site->f, memory_order_relaxed);
+	if (f == NULL) {
+		ERROR_ASSERT(_error_hereify(file, line, fmt_compile(&f, format)));
+		site->id = _n_sites++;
+		site->next = _sites;
+		_sites = site;
+		atomic_store_explicit(&site->f, f, memory_order_release);
+	}
+#ifdef FMT_PTHREADS
+	pthread_mutex_unlock(&_site_mutex);
+#endif
+	return f;
+}
+
+void _fmt_compiledv(const char *restrict file, size_t line, const FmtCompiled *restrict f, va_list args) {
+	FmtContext ctx = {
+		.ctx_data = stdout,
+		.putc_func = _fmtf_putc_func,
+		.write_func = _fmtf_write_func,
+	};
+	_fmtc_compiledv(file, line, &ctx, f, args);
+}
+
+void _fmt_compiled(const char *restrict file, size_t line, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	_fmt_compiledv(file, line, f, args);
+	va_end(args);
+}
+
+size_t _fmts_compiledv(const char *restrict file, size_t line, char *restrict buf, size_t size, const FmtCompiled *restrict f, va_list args) {
+	_FmtsContext ctxs = {
+		.buf = buf,
+		.size = size,
+	};
+	FmtContext ctx = {
+		.ctx_data = &ctxs,
+		.putc_func = _fmts_putc_func,
+		.write_func = _fmts_write_func,
+	};
+	_fmtc_compiledv(file, line, &ctx, f, args);
+	if (size > 0)
+		buf[min(ctxs.written, size - 1)] = 0;
+	return ctxs.written;
+}
+
+size_t _fmts_compiled(const char *restrict file, size_t line, char *restrict buf, size_t size, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	size_t res = _fmts_compiledv(file, line, buf, size, f, args);
+	va_end(args);
+	return res;
+}
+
+void _fmtc_compiledv(const char *restrict file, size_t line, FmtContext *restrict ctx, const FmtCompiled *restrict f, va_list args) {
+	ERROR_ASSERT(_error_hereify(file, line, _fmt_compiled_main(ctx, f, args, NULL)));
+}
+
+void _fmtc_compiled(const char *restrict file, size_t line, FmtContext *restrict ctx, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	_fmtc_compiledv(file, line, ctx, f, args);
+	va_end(args);
+}
+
+char *_fmta_compiledv(const char *restrict file, size_t line, size_t *restrict out_len, const FmtCompiled *restrict f, va_list args) {
+	char stack[256];
+	FmtBuf b = { .buf = stack, .cap = sizeof(stack) };
+	_FmtbContext ctxb = { .b = &b, .stack = stack };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	_fmtc_compiledv(file, line, &ctx, f, args);
+	return _fmta_finish(&ctxb, out_len);
+}
+
+char *_fmta_compiled(const char *restrict file, size_t line, size_t *restrict out_len, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	char *res = _fmta_compiledv(file, line, out_len, f, args);
+	va_end(args);
+	return res;
+}
+
+Error _fmtb_compiledv(const char *restrict file, size_t line, FmtBuf *restrict b, const FmtCompiled *restrict f, va_list args) {
+	_FmtbContext ctxb = { .b = b };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	size_t start = b->len;
+	_fmtc_compiledv(file, line, &ctx, f, args);
+	return _fmtb_finish(file, line, &ctxb, start);
+}
+
+Error _fmtb_compiled(const char *restrict file, size_t line, FmtBuf *restrict b, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	Error res = _fmtb_compiledv(file, line, b, f, args);
+	va_end(args);
+	return res;
+}
+
+#ifdef FMT_FD_SUPPORT
+Error fmt_fd_init(FmtFd *out, int fd, size_t buf_size, bool scatter) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	if (buf_size == 0)
+		buf_size = FMT_FD_DEFAULT_BUF_SIZE;
+	buf_size = (buf_size + page - 1) / page * page;
+	char *buf = aligned_alloc(page, buf_size);
+	if (buf == NULL)
+		return ERROR_OUT_OF_MEMORY();
+	*out = (FmtFd){
+		.fd = fd,
+		.scatter = scatter,
+		.buf = buf,
+		.cap = buf_size,
+	};
+	return OK();
+}
+
+Error fmt_fd_term(FmtFd *out) {
+	Error res = fmt_fd_flush(out);
+	free(out->buf);
+	return res;
+}
+
+Error fmt_fd_flush(FmtFd *out) {
+	_fmtfd_flush(out);
+	int err = out->write_errno;
+	out->write_errno = 0;
+	if (err != 0)
+		return ERROR_HEAP_STRING(strdup(strerror(err)));
+	return OK();
+}
+
+FmtContext fmt_fd_context(FmtFd *out) {
+	return (FmtContext){
+		.ctx_data = out,
+		.putc_func = _fmtfd_putc_func,
+		.write_func = _fmtfd_write_func,
+	};
+}
+
+void fmt_fd_write(FmtFd *restrict out, const void *restrict buf, size_t n) {
+	_fmtfd_write(out, buf, n);
+}
+
+void _fmtfdv(const char *restrict file, size_t line, FmtFd *restrict out, const char *restrict format, va_list args) {
+	FmtContext ctx = fmt_fd_context(out);
+	ERROR_ASSERT(_error_hereify(file, line, _fmt_main(&ctx, format, args, out->scatter ? _fmtfd_write_ref_func : NULL)));
+	/* The strings referenced by iov die with the call. */
+	if (out->n_iov > 0)
+		_fmtfd_flush(out);
+}
+
+void _fmtfd(const char *restrict file, size_t line, FmtFd *restrict out, const char *restrict format, ...) {
+	va_list args;
+	va_start(args, format);
+	_fmtfdv(file, line, out, format, args);
+	va_end(args);
+}
+
+void _fmtfd_compiledv(const char *restrict file, size_t line, FmtFd *restrict out, const FmtCompiled *restrict f, va_list args) {
+	FmtContext ctx = fmt_fd_context(out);
+	ERROR_ASSERT(_error_hereify(file, line, _fmt_compiled_main(&ctx, f, args, out->scatter ? _fmtfd_write_ref_func : NULL)));
+	if (out->n_iov > 0)
+		_fmtfd_flush(out);
+}
+
+void _fmtfd_compiled(const char *restrict file, size_t line, FmtFd *restrict out, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	_fmtfd_compiledv(file, line, out, f, args);
+	va_end(args);
+}
+#endif
+
+/* Pads out to a multiple of 8 bytes after start. */
+static Error _capture_align(FmtBuf *restrict out, size_t start) {
+	static const char zeros[8] = {0};
+	return fmtb_append(out, zeros, (8 - (out->len - start) % 8) % 8);
+}
+
+/* Captured arguments are, for each op which prints something: its '*' attrs
+ * as 8 byte slots, then the argument, padded to 8 bytes. Unless the argument
+ * has a fixed size or is a null terminated string, its size comes first as a
+ * uint64_t. */
+Error fmt_compiled_capturev(FmtBuf *restrict out, const FmtCompiled *restrict f, va_list args) {
+	size_t start = out->len;
+	TRY(fmtb_reserve(out, f->capture_reserve), );
+	for (size_t i = 0; i < f->n_ops; i++) {
+		const _FmtOp *op = &f->ops[i];
+		if (op->func == NULL)
+			continue;
+		if (op->capture == NULL) {
+			out->len = start;
+			return ERROR_STRING("fmt: Can't capture a type without a capture function; see fmt_register_capture()");
+		}
+		FmtAttrs *attrs = op->attrs;
+		FmtAttrs star_attrs;
+		if (op->star_mask != 0) {
+			star_attrs = *attrs;
+			for (size_t j = 0; j < star_attrs.len; j++) {
+				if (op->star_mask & (1u << j)) {
+					int64_t val = star_attrs.vals[j] = va_arg(args, int);
+					TRY(fmtb_append(out, (const char *)&val, sizeof(val)), out->len = start);
+				}
+			}
+			attrs = &star_attrs;
+		}
+		if (op->captured_size != _CAPTURED_SIZED) {
+			TRY(op->capture(out, attrs, args), out->len = start);
+		} else {
+			size_t size_pos = out->len;
+			uint64_t size = 0;
+			TRY(fmtb_append(out, (const char *)&size, sizeof(size)), out->len = start);
+			TRY(op->capture(out, attrs, args), out->len = start);
+			size = out->len - size_pos - sizeof(size);
+			memcpy(out->buf + size_pos, &size, sizeof(size));
+		}
+		if ((out->len - start) % 8 != 0)
+			TRY(_capture_align(out, start), out->len = start);
+	}
+	return OK();
+}
+
+Error fmt_compiled_capture(FmtBuf *restrict out, const FmtCompiled *restrict f, ...) {
+	va_list args;
+	va_start(args, f);
+	Error res = fmt_compiled_capturev(out, f, args);
+	va_end(args);
+	return res;
+}
+
+Error fmtc_captured(FmtContext *restrict ctx, const FmtCompiled *restrict f, const void *restrict captured) {
+	const char *c = captured;
+	for (size_t i = 0; i < f->n_ops; i++) {
+		const _FmtOp *op = &f->ops[i];
+		if (op->func == NULL) {
+			fmt_write(ctx, op->lit, op->lit_len);
+			continue;
+		}
+		FmtAttrs *attrs = op->attrs;
+		FmtAttrs star_attrs;
+		if (op->star_mask != 0) {
+			star_attrs = *attrs;
+			for (size_t j = 0; j < star_attrs.len; j++) {
+				if (op->star_mask & (1u << j)) {
+					int64_t val;
+					memcpy(&val, c, sizeof(val));
+					star_attrs.vals[j] = val;
+					c += sizeof(val);
+				}
+			}
+			attrs = &star_attrs;
+		}
+		uint64_t size;
+		if (op->captured_size > 0)
+			size = op->captured_size;
+		else if (op->captured_size == _CAPTURED_STRING)
+			size = strlen(c) + 1;
+		else {
+			memcpy(&size, c, sizeof(size));
+			c += sizeof(size);
+		}
+		FmtPrintFuncRet res = _call_print_func(op->print_captured, ctx, attrs, (const void *)c);
+		if (res.invalid_attr) {
+			char errbuf[256];
+			snprintf(errbuf, 256, "fmt: Invalid attribute: '%s'", fmt_attr_name(attrs->ids[res.invalid_attr_idx]));
+			return ERROR_HEAP_STRING(strdup(errbuf));
+		}
+		c += (size + 7) / 8 * 8;
+	}
+	return OK();
+}
+
+bool fmt_captured_fits(const FmtCompiled *restrict f, const void *restrict captured, size_t size) {
+	const char *c = captured;
+	size_t left = size;
+	for (size_t i = 0; i < f->n_ops; i++) {
+		const _FmtOp *op = &f->ops[i];
+		if (op->func == NULL)
+			continue;
+		for (size_t j = 0; op->star_mask != 0 && j < op->attrs->len; j++) {
+			if (op->star_mask & (1u << j)) {
+				if (left < sizeof(int64_t))
+					return false;
+				c += sizeof(int64_t);
+				left -= sizeof(int64_t);
+			}
+		}
+		uint64_t arg_size;
+		if (op->captured_size > 0)
+			arg_size = op->captured_size;
+		else if (op->captured_size == _CAPTURED_STRING)
+			arg_size = strnlen(c, left) + 1;
+		else {
+			if (left < sizeof(arg_size))
+				return false;
+			memcpy(&arg_size, c, sizeof(arg_size));
+			c += sizeof(arg_size);
+			left -= sizeof(arg_size);
+		}
+		if (arg_size > left)
+			return false;
+		/* The padding of the last argument may be cut off. */
+		uint64_t padded = min((arg_size + 7) / 8 * 8, left);
+		c += padded;
+		left -= padded;
+	}
+	return true;
+}
+
+Error fmtb_captured(FmtBuf *restrict b, const FmtCompiled *restrict f, const void *restrict captured) {
+	_FmtbContext ctxb = { .b = b };
+	FmtContext ctx = {
+		.ctx_data = &ctxb,
+		.putc_func = _fmtb_putc_func,
+		.write_func = _fmtb_write_func,
+	};
+	size_t start = b->len;
+	Error err = fmtc_captured(&ctx, f, captured);
+	if (error_is(err)) {
+		b->len = start;
+		if (b->buf != NULL)
+			b->buf[start] = 0;
+		return err;
+	}
+	return _fmtb_finish(__FILE__, __LINE__, &ctxb, start);
+}
+
 void fmt_init() {
-	if (initialized) {
+	if (atomic_load_explicit(&_registry, memory_order_relaxed) != NULL) {
 		ERROR_ASSERT(ERROR_STRING("fmt: fmt_init() can only be called once"));
 	}
-	initialized = true;
-	_print_funcs = _print_func_map();
+	/* The builtin functions go into the first registry directly, which is
+	 * only published when complete. */
+	_FmtRegistry *r = malloc(sizeof(_FmtRegistry));
+	const char **attr_names = calloc(FmtAttrBuiltinEnd, sizeof(*attr_names));
+	if (r == NULL || attr_names == NULL) {
+		ERROR_ASSERT(ERROR_OUT_OF_MEMORY_HERE());
+	}
+	*r = (_FmtRegistry){ .funcs = _print_func_map(), .attr_ids = _attr_id_map(), .attr_names = attr_names, .n_attrs = 1 };
+#ifdef FMT_PTHREADS
+	if (pthread_key_create(&_reader_key, _registry_reader_release) != 0) {
+		ERROR_ASSERT(ERROR_OUT_OF_MEMORY_HERE());
+	}
+#endif
+
+	for (FmtAttrId id = 1; id < FmtAttrBuiltinEnd; id++)
+		_registry_add_attr(r, _builtin_attr_names[id]);
+
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "str", _printer_string));
 
-	fmt_register("str", _print_string_func);
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "int", _printer_int));
 
-	fmt_register("int", _print_int_func);
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "unsigned int", _printer_uint));
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "uint", _printer_uint));
 
-	fmt_register("unsigned int", _print_uint_func);
-	fmt_register("uint", _print_uint_func);
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "size_t", _printer_size_t));
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "ssize_t", _printer_ssize_t));
 
-	fmt_register("size_t", _print_size_t_func);
-	fmt_register("ssize_t", _print_ssize_t_func);
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "double", _printer_double));
 
-	fmt_register("Error", _print_error_func);
+	ERROR_ASSERT(_print_func_map_set(&r->funcs, "Error", _printer_error));
+
+	atomic_store_explicit(&_registry, r, memory_order_release);
 }
 
 void fmt_term() {
-	if (!initialized) {
+	_FmtRegistry *r = atomic_exchange_explicit(&_registry, NULL, memory_order_acquire);
+	if (r == NULL) {
 		ERROR_ASSERT(ERROR_STRING("fmt: fmt_term() called while fmt uninitialized"));
 	}
-	initialized = false;
-	_print_func_map_term(_print_funcs);
+	for (size_t id = FmtAttrBuiltinEnd; id < r->n_attrs; id++)
+		free((char *)r->attr_names[id]);
+	_registry_free(r);
+#ifdef FMT_PTHREADS
+	/* Threads still holding a slot under the deleted key get a new one. */
+	pthread_key_delete(_reader_key);
+	for (_FmtReader *reader = atomic_exchange(&_readers, NULL); reader != NULL;) {
+		_FmtReader *next = reader->next;
+		free(reader);
+		reader = next;
+	}
+#endif
+	while (_sites != NULL) {
+		FmtSite *next = _sites->next;
+		fmt_compiled_term(atomic_exchange_explicit(&_sites->f, NULL, memory_order_relaxed));
+		_sites->next = NULL;
+		_sites = next;
+	}
+	_n_sites = 0;
 }
@@ -0,0 +1,334 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/log.h>
+
+#ifdef LOG_SUPPORT
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RING_SIZE (64 * 1024)
+/* How long the background thread sleeps when there is nothing to do. */
+#define IDLE_NSEC 10000000
+
+/* A ring buffer of messages, written by one thread and read by the background
+ * thread. Positions count bytes and only ever increase; the producer and
+ * consumer sides live on separate cache lines, as in generic/spsc.h.
+ *
+ * A message is a Record followed by its captured arguments, all in multiples
+ * of 8 bytes and never wrapping around the end of data. If a message doesn't
+ * fit before the end, the rest is skipped, marked by a size with the lowest
+ * bit set. Messages take at most half the ring, so an empty ring always has
+ * room for one. */
+struct _LogRing {
+	/* Consumer side */
+	_Alignas(64) _Atomic size_t head;
+	/* Producer side */
+	_Alignas(64) _Atomic size_t tail;
+	size_t head_cache;
+	FmtBuf scratch; /* arguments are captured here first */
+	/* Shared */
+	_Alignas(64) char *data;
+	size_t size;
+	_Atomic bool closed; /* the thread exited; freed once empty */
+	struct _LogRing *next;
+};
+
+typedef struct Record {
+	uint64_t size;
+	const FmtCompiled *f;
+} Record;
+
+static pthread_mutex_t loggers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Logger *loggers;
+static pthread_once_t atexit_once = PTHREAD_ONCE_INIT;
+
+/********************************\
+|*       Background thread      *|
+\********************************/
+static void flush_output(FmtFd *out) {
+	/* Write errors have nowhere to go. */
+	error_to_string(NULL, 0, fmt_fd_flush(out), true);
+}
+
+/* Formats all messages in r; returns whether there were any. */
+static bool drain_ring(_LogRing *r, FmtFd *out) {
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+	if (head == tail)
+		return false;
+	while (head != tail) {
+		const char *p = r->data + head % r->size;
+		Record rec;
+		memcpy(&rec.size, p, sizeof(rec.size));
+		if (rec.size & 1) {
+			head += rec.size & ~(uint64_t)1;
+			continue;
+		}
+		memcpy(&rec, p, sizeof(rec));
+		FmtContext ctx = fmt_fd_context(out);
+		Error err = fmtc_captured(&ctx, rec.f, p + sizeof(rec));
+		if (error_is(err))
+			fmtfd(out, "log: %{Error:destroy}\n", err);
+		head += rec.size;
+	}
+	/* Only now, since the arguments may be read until they're formatted. */
+	atomic_store_explicit(&r->head, head, memory_order_release);
+	return true;
+}
+
+static void *background_thread(void *arg) {
+	Logger *l = arg;
+	for (;;) {
+		pthread_mutex_lock(&l->mutex);
+		/* Rings are only ever added at the front, so the list from here on
+		 * can be read without the lock. */
+		_LogRing *rings = l->rings;
+		size_t flush_requested = l->flush_requested;
+		bool stop = l->stop;
+		pthread_mutex_unlock(&l->mutex);
+
+		bool busy = false;
+		/* out writes whenever its buffer fills up. */
+		for (_LogRing *r = rings; r != NULL; r = r->next)
+			busy |= drain_ring(r, &l->out);
+		size_t dropped = atomic_load_explicit(&l->dropped, memory_order_relaxed);
+		if (l->overflow == LogOverflowCount && dropped != l->dropped_reported) {
+			fmtfd(&l->out, "log: %zu messages dropped\n", dropped - l->dropped_reported);
+			l->dropped_reported = dropped;
+		}
+		if (l->out.len != 0)
+			flush_output(&l->out);
+
+		pthread_mutex_lock(&l->mutex);
+		/* Free the rings of exited threads once they're empty. */
+		for (_LogRing **r = &l->rings; *r != NULL;) {
+			_LogRing *ring = *r;
+			if (atomic_load_explicit(&ring->closed, memory_order_acquire) &&
+					atomic_load_explicit(&ring->head, memory_order_relaxed) == atomic_load_explicit(&ring->tail, memory_order_acquire)) {
+				*r = ring->next;
+				free(ring->data);
+				free(ring);
+			} else
+				r = &ring->next;
+		}
+		if (flush_requested != l->flush_done) {
+			l->flush_done = flush_requested;
+			pthread_cond_broadcast(&l->flushed_cond);
+		}
+		if (stop && !busy) {
+			pthread_mutex_unlock(&l->mutex);
+			break;
+		}
+		if (!busy && !l->stop && l->flush_requested == l->flush_done) {
+			struct timespec until;
+			clock_gettime(CLOCK_REALTIME, &until);
+			until.tv_nsec += IDLE_NSEC;
+			if (until.tv_nsec >= 1000000000) {
+				until.tv_sec++;
+				until.tv_nsec -= 1000000000;
+			}
+			atomic_store_explicit(&l->sleeping, true, memory_order_relaxed);
+			pthread_cond_timedwait(&l->wake_cond, &l->mutex, &until);
+			atomic_store_explicit(&l->sleeping, false, memory_order_relaxed);
+		}
+		pthread_mutex_unlock(&l->mutex);
+	}
+	return NULL;
+}
+
+/********************************\
+|*           Logging            *|
+\********************************/
+/* Called when a thread which logged exits. */
+static void close_ring(void *arg) {
+	_LogRing *r = arg;
+	fmtb_term(&r->scratch);
+	r->scratch = fmt_buf();
+	atomic_store_explicit(&r->closed, true, memory_order_release);
+}
+
+static _LogRing *new_ring(Logger *l) {
+	_LogRing *r = aligned_alloc(64, (sizeof(_LogRing) + 63) / 64 * 64);
+	char *data = malloc(l->ring_size);
+	if (r == NULL || data == NULL) {
+		free(r);
+		free(data);
+		return NULL;
+	}
+	*r = (_LogRing){ .data = data, .size = l->ring_size, .scratch = fmt_buf() };
+	pthread_mutex_lock(&l->mutex);
+	r->next = l->rings;
+	l->rings = r;
+	pthread_mutex_unlock(&l->mutex);
+	pthread_setspecific(l->ring_key, r);
+	return r;
+}
+
+/* Copies a message into r; returns false if it doesn't fit right now. */
+static bool try_push(_LogRing *r, const FmtCompiled *f, const char *args, size_t args_size) {
+	size_t rec_size = sizeof(Record) + args_size;
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t pos = tail % r->size;
+	size_t skip = pos + rec_size > r->size ? r->size - pos : 0;
+	if (tail + skip + rec_size - r->head_cache > r->size) {
+		r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+		if (tail + skip + rec_size - r->head_cache > r->size)
+			return false;
+	}
+	if (skip != 0) {
+		uint64_t marker = skip | 1;
+		memcpy(r->data + pos, &marker, sizeof(marker));
+		pos = 0;
+	}
+	Record rec = { .size = rec_size, .f = f };
+	memcpy(r->data + pos, &rec, sizeof(rec));
+	memcpy(r->data + pos + sizeof(rec), args, args_size);
+	atomic_store_explicit(&r->tail, tail + skip + rec_size, memory_order_release);
+	return true;
+}
+
+void _log_fmt(const char *restrict file, size_t line, Logger *l, FmtSite *site, const char *restrict format, ...) {
+	FmtCompiled *f = _fmt_site_get(file, line, site, format);
+	_LogRing *r = pthread_getspecific(l->ring_key);
+	if (r == NULL && (r = new_ring(l)) == NULL) {
+		atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+		return;
+	}
+
+	fmtb_reset(&r->scratch);
+	va_list args;
+	va_start(args, format);
+	Error err = fmt_compiled_capturev(&r->scratch, f, args);
+	va_end(args);
+	if (err.kind == ErrorOutOfMemory) {
+		atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	ERROR_ASSERT(_error_hereify(file, line, err));
+
+	size_t args_size = r->scratch.len;
+	if (sizeof(Record) + args_size > r->size / 2) {
+		atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	while (!try_push(r, f, r->scratch.buf, args_size)) {
+		if (l->overflow != LogOverflowBlock) {
+			atomic_fetch_add_explicit(&l->dropped, 1, memory_order_relaxed);
+			return;
+		}
+		pthread_cond_signal(&l->wake_cond);
+		sched_yield();
+	}
+	/* Wake the background thread early rather than let the ring fill up. */
+	size_t used = atomic_load_explicit(&r->tail, memory_order_relaxed) - r->head_cache;
+	if (used > r->size / 2 && atomic_load_explicit(&l->sleeping, memory_order_relaxed))
+		pthread_cond_signal(&l->wake_cond);
+}
+
+/********************************\
+|*          The logger          *|
+\********************************/
+/* Only safe for loggers with static storage duration; see logger_init(). */
+static void flush_all_at_exit() {
+	pthread_mutex_lock(&loggers_mutex);
+	for (Logger *l = loggers; l != NULL; l = l->next)
+		logger_flush(l);
+	pthread_mutex_unlock(&loggers_mutex);
+}
+
+static void install_atexit() {
+	atexit(flush_all_at_exit);
+}
+
+Error logger_init(Logger *l, const char *restrict path, LogOverflow overflow, size_t ring_size) {
+	*l = (Logger){
+		.fd = STDOUT_FILENO,
+		.overflow = overflow,
+		.ring_size = ring_size == 0 ? DEFAULT_RING_SIZE : (ring_size + 7) / 8 * 8,
+	};
+	if (path != NULL) {
+		l->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (l->fd < 0)
+			return ERROR_HEAP_STRING(strdup(strerror(errno)));
+		l->own_fd = true;
+	}
+	TRY(fmt_fd_init(&l->out, l->fd, 0, false), if (l->own_fd) close(l->fd));
+	if (pthread_key_create(&l->ring_key, close_ring) != 0) {
+		fmt_fd_term(&l->out);
+		if (l->own_fd)
+			close(l->fd);
+		return ERROR_STRING("log: failed to create thread-local key");
+	}
+	pthread_mutex_init(&l->mutex, NULL);
+	pthread_cond_init(&l->wake_cond, NULL);
+	pthread_cond_init(&l->flushed_cond, NULL);
+	if (pthread_create(&l->thread, NULL, background_thread, l) != 0) {
+		pthread_key_delete(l->ring_key);
+		pthread_mutex_destroy(&l->mutex);
+		pthread_cond_destroy(&l->wake_cond);
+		pthread_cond_destroy(&l->flushed_cond);
+		fmt_fd_term(&l->out);
+		if (l->own_fd)
+			close(l->fd);
+		return ERROR_STRING("failed to create thread");
+	}
+	pthread_once(&atexit_once, install_atexit);
+	pthread_mutex_lock(&loggers_mutex);
+	l->next = loggers;
+	loggers = l;
+	pthread_mutex_unlock(&loggers_mutex);
+	return OK();
+}
+
+void logger_flush(Logger *l) {
+	pthread_mutex_lock(&l->mutex);
+	size_t gen = ++l->flush_requested;
+	pthread_cond_signal(&l->wake_cond);
+	/* A pass which started after the request has formatted everything
+	 * logged before it. */
+	while (l->flush_done - gen > SIZE_MAX / 2)
+		pthread_cond_wait(&l->flushed_cond, &l->mutex);
+	pthread_mutex_unlock(&l->mutex);
+}
+
+void logger_term(Logger *l) {
+	pthread_mutex_lock(&loggers_mutex);
+	for (Logger **it = &loggers; *it != NULL; it = &(*it)->next) {
+		if (*it == l) {
+			*it = l->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&loggers_mutex);
+
+	pthread_mutex_lock(&l->mutex);
+	l->stop = true;
+	pthread_cond_signal(&l->wake_cond);
+	pthread_mutex_unlock(&l->mutex);
+	pthread_join(l->thread, NULL);
+
+	pthread_key_delete(l->ring_key);
+	for (_LogRing *r = l->rings; r != NULL;) {
+		_LogRing *next = r->next;
+		fmtb_term(&r->scratch);
+		free(r->data);
+		free(r);
+		r = next;
+	}
+	pthread_mutex_destroy(&l->mutex);
+	pthread_cond_destroy(&l->wake_cond);
+	pthread_cond_destroy(&l->flushed_cond);
+	error_to_string(NULL, 0, fmt_fd_term(&l->out), true); /* flushed already */
+	if (l->own_fd)
+		close(l->fd);
+}
+
+#endif
@@ -0,0 +1,130 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/pool.h>
+
+#include <stdlib.h>
+#ifdef THREAD_POOL_PTHREADS
+#include <unistd.h>
+#endif
+
+/* Runs tasks of the current batch until there are none left. */
+static void run_tasks(ThreadPool *pool) {
+	for (;;) {
+		size_t task = atomic_fetch_add_explicit(&pool->next_task, 1, memory_order_relaxed);
+		if (task >= pool->n_tasks)
+			break;
+		pool->func(pool->ctx, task);
+	}
+}
+
+#ifdef THREAD_POOL_PTHREADS
+static void *worker(void *arg) {
+	ThreadPool *pool = arg;
+	size_t seen = 0;
+	pthread_mutex_lock(&pool->mutex);
+	for (;;) {
+		while (!pool->stop && pool->generation == seen)
+			pthread_cond_wait(&pool->work_cond, &pool->mutex);
+		if (pool->stop)
+			break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->mutex);
+		run_tasks(pool);
+		pthread_mutex_lock(&pool->mutex);
+		if (--pool->n_busy == 0)
+			pthread_cond_signal(&pool->done_cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+	return NULL;
+}
+#endif
+
+Error thread_pool_init(ThreadPool *pool, size_t nthreads) {
+	*pool = (ThreadPool){0};
+#ifdef THREAD_POOL_PTHREADS
+	if (nthreads == 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		nthreads = n < 1 ? 1 : (size_t)n;
+	}
+	pthread_mutex_init(&pool->run_mutex, NULL);
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, NULL);
+	if (nthreads > 1) {
+		pool->workers = malloc(sizeof(pthread_t) * (nthreads - 1));
+		if (pool->workers == NULL) {
+			thread_pool_term(pool);
+			return ERROR_OUT_OF_MEMORY();
+		}
+	}
+	for (size_t i = 0; i + 1 < nthreads; i++) {
+		if (pthread_create(&pool->workers[i], NULL, worker, pool) != 0) {
+			thread_pool_term(pool);
+			return ERROR_STRING("failed to create thread");
+		}
+		pool->n_workers++;
+	}
+#else
+	(void)nthreads;
+#endif
+	return OK();
+}
+
+void thread_pool_term(ThreadPool *pool) {
+#ifdef THREAD_POOL_PTHREADS
+	pthread_mutex_lock(&pool->mutex);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+	for (size_t i = 0; i < pool->n_workers; i++)
+		pthread_join(pool->workers[i], NULL);
+	free(pool->workers);
+	pthread_mutex_destroy(&pool->run_mutex);
+	pthread_mutex_destroy(&pool->mutex);
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+#else
+	(void)pool;
+#endif
+}
+
+size_t thread_pool_size(const ThreadPool *pool) {
+	return pool->n_workers + 1;
+}
+
+void thread_pool_run(ThreadPool *pool, ThreadPoolTaskFunc func, void *ctx, size_t n_tasks) {
+	if (n_tasks == 0)
+		return;
+#ifdef THREAD_POOL_PTHREADS
+	if (n_tasks == 1 || pool->n_workers == 0) {
+		for (size_t i = 0; i < n_tasks; i++)
+			func(ctx, i);
+		return;
+	}
+	pthread_mutex_lock(&pool->run_mutex);
+	pthread_mutex_lock(&pool->mutex);
+	pool->func = func;
+	pool->ctx = ctx;
+	pool->n_tasks = n_tasks;
+	atomic_store_explicit(&pool->next_task, 0, memory_order_relaxed);
+	pool->n_busy = pool->n_workers;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	run_tasks(pool);
+
+	pthread_mutex_lock(&pool->mutex);
+	while (pool->n_busy != 0)
+		pthread_cond_wait(&pool->done_cond, &pool->mutex);
+	pthread_mutex_unlock(&pool->mutex);
+	pthread_mutex_unlock(&pool->run_mutex);
+#else
+	pool->func = func;
+	pool->ctx = ctx;
+	pool->n_tasks = n_tasks;
+	atomic_store_explicit(&pool->next_task, 0, memory_order_relaxed);
+	run_tasks(pool);
+#endif
+}
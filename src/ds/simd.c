@@ -0,0 +1,263 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/simd.h>
+
+#include <string.h>
+
+/* The kernels are written once using GCC's vector extensions and compiled
+ * twice: once for the baseline target (SSE2 on x86-64, NEON on ARM64), and,
+ * on x86, once more with AVX2 enabled. Every vector is 32 bytes, which is a
+ * single AVX2 register, or two SSE2/NEON registers. Loads go through
+ * memcpy(), so the data doesn't need any particular alignment. */
+
+#define VEC_BYTES 32
+/* Number of iterations after which count_eq flushes its per-lane counters,
+ * which are only as wide as the items (so 8 bits for i8/u8). */
+#define COUNT_FLUSH 127
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86
+#endif
+
+#if defined(__GNUC__)
+/* _v_<sfx>: items, _m_<sfx>: comparison results (signed integers of the same
+ * width), _a_<sfx>: sum accumulators (simd_sum_<sfx>_t lanes), _h_<sfx>: as
+ * many items as _a_<sfx> has lanes. Every type which is used in a loop is at
+ * most VEC_BYTES wide, so it stays in a register. */
+#define DEFINE_VECTOR_TYPES(sfx, type, mask_type) \
+	typedef type      _v_##sfx __attribute__((vector_size(VEC_BYTES))); \
+	typedef mask_type _m_##sfx __attribute__((vector_size(VEC_BYTES))); \
+	typedef simd_sum_##sfx##_t _a_##sfx __attribute__((vector_size(VEC_BYTES))); \
+	typedef type      _h_##sfx __attribute__((vector_size(VEC_BYTES / sizeof(simd_sum_##sfx##_t) * sizeof(type))));
+
+DEFINE_VECTOR_TYPES(i8,  int8_t,   int8_t)
+DEFINE_VECTOR_TYPES(u8,  uint8_t,  int8_t)
+DEFINE_VECTOR_TYPES(i16, int16_t,  int16_t)
+DEFINE_VECTOR_TYPES(u16, uint16_t, int16_t)
+DEFINE_VECTOR_TYPES(i32, int32_t,  int32_t)
+DEFINE_VECTOR_TYPES(u32, uint32_t, int32_t)
+DEFINE_VECTOR_TYPES(i64, int64_t,  int64_t)
+DEFINE_VECTOR_TYPES(u64, uint64_t, int64_t)
+DEFINE_VECTOR_TYPES(f32, float,    int32_t)
+DEFINE_VECTOR_TYPES(f64, double,   int64_t)
+
+typedef uint64_t _v_any __attribute__((vector_size(VEC_BYTES)));
+
+/* Whether any lane of a comparison result is set. */
+#define ANY(m) __extension__ ({ _v_any _m = (_v_any)(m); (_m[0] | _m[1] | _m[2] | _m[3]) != 0; })
+/* Broadcasts x into every lane. */
+#define SPLAT(sfx, type, x) __extension__ ({ \
+	type _tmp[VEC_BYTES / sizeof(type)]; \
+	for (size_t _i = 0; _i < VEC_BYTES / sizeof(type); _i++) \
+		_tmp[_i] = x; \
+	_v_##sfx _res; \
+	memcpy(&_res, _tmp, sizeof(_res)); \
+	_res; \
+})
+/* Per-lane a OP b ? a : b. */
+#define SELECT(sfx, a, op, b) __extension__ ({ \
+	_m_##sfx _sel = (a) op (b); \
+	(_v_##sfx)(((_m_##sfx)(a) & _sel) | ((_m_##sfx)(b) & ~_sel)); \
+})
+
+#define DEFINE_KERNELS(impl, attr, sfx, type) \
+	attr __attribute__((unused)) static size_t _find_##sfx##_##impl(const type *data, size_t n, type x) { \
+		enum { L = VEC_BYTES / sizeof(type) }; \
+		_v_##sfx xs = SPLAT(sfx, type, x); \
+		size_t i = 0; \
+		for (; i + L <= n; i += L) { \
+			_v_##sfx v; \
+			memcpy(&v, data + i, sizeof(v)); \
+			if (ANY(v == xs)) \
+				break; \
+		} \
+		for (; i < n; i++) { \
+			if (data[i] == x) \
+				return i; \
+		} \
+		return n; \
+	} \
+	\
+	attr static size_t _count_eq_##sfx##_##impl(const type *data, size_t n, type x) { \
+		enum { L = VEC_BYTES / sizeof(type) }; \
+		_v_##sfx xs = SPLAT(sfx, type, x); \
+		size_t i = 0, res = 0; \
+		while (i + L <= n) { \
+			_m_##sfx counts = {0}; \
+			for (size_t j = 0; j < COUNT_FLUSH && i + L <= n; j++, i += L) { \
+				_v_##sfx v; \
+				memcpy(&v, data + i, sizeof(v)); \
+				counts -= v == xs; /* true is -1 */ \
+			} \
+			for (size_t j = 0; j < L; j++) \
+				res += (size_t)counts[j]; \
+		} \
+		for (; i < n; i++) \
+			res += data[i] == x; \
+		return res; \
+	} \
+	\
+	attr static type _min_##sfx##_##impl(const type *data, size_t n) { \
+		enum { L = VEC_BYTES / sizeof(type) }; \
+		_v_##sfx mins = SPLAT(sfx, type, data[0]); \
+		size_t i = 0; \
+		for (; i + L <= n; i += L) { \
+			_v_##sfx v; \
+			memcpy(&v, data + i, sizeof(v)); \
+			mins = SELECT(sfx, v, <, mins); \
+		} \
+		type res = data[0]; \
+		for (size_t j = 0; j < L; j++) { \
+			if (mins[j] < res) \
+				res = mins[j]; \
+		} \
+		for (; i < n; i++) { \
+			if (data[i] < res) \
+				res = data[i]; \
+		} \
+		return res; \
+	} \
+	\
+	attr static type _max_##sfx##_##impl(const type *data, size_t n) { \
+		enum { L = VEC_BYTES / sizeof(type) }; \
+		_v_##sfx maxs = SPLAT(sfx, type, data[0]); \
+		size_t i = 0; \
+		for (; i + L <= n; i += L) { \
+			_v_##sfx v; \
+			memcpy(&v, data + i, sizeof(v)); \
+			maxs = SELECT(sfx, v, >, maxs); \
+		} \
+		type res = data[0]; \
+		for (size_t j = 0; j < L; j++) { \
+			if (maxs[j] > res) \
+				res = maxs[j]; \
+		} \
+		for (; i < n; i++) { \
+			if (data[i] > res) \
+				res = data[i]; \
+		} \
+		return res; \
+	} \
+	\
+	attr static simd_sum_##sfx##_t _sum_##sfx##_##impl(const type *data, size_t n) { \
+		/* Items are widened K at a time, into K separate accumulators. */ \
+		enum { K = sizeof(simd_sum_##sfx##_t) / sizeof(type), H = VEC_BYTES / sizeof(simd_sum_##sfx##_t) }; \
+		_a_##sfx sums[K] = {{0}}; \
+		size_t i = 0; \
+		for (; i + K * H <= n; i += K * H) { \
+			for (size_t k = 0; k < K; k++) { \
+				_h_##sfx h; \
+				memcpy(&h, data + i + k * H, sizeof(h)); \
+				sums[k] += __builtin_convertvector(h, _a_##sfx); \
+			} \
+		} \
+		simd_sum_##sfx##_t res = 0; \
+		for (size_t k = 0; k < K; k++) { \
+			for (size_t j = 0; j < H; j++) \
+				res += sums[k][j]; \
+		} \
+		for (; i < n; i++) \
+			res += data[i]; \
+		return res; \
+	}
+#else
+/* Plain loops for compilers without GCC's vector extensions. */
+#define DEFINE_KERNELS(impl, attr, sfx, type) \
+	static size_t _find_##sfx##_##impl(const type *data, size_t n, type x) { \
+		for (size_t i = 0; i < n; i++) { \
+			if (data[i] == x) \
+				return i; \
+		} \
+		return n; \
+	} \
+	\
+	static size_t _count_eq_##sfx##_##impl(const type *data, size_t n, type x) { \
+		size_t res = 0; \
+		for (size_t i = 0; i < n; i++) \
+			res += data[i] == x; \
+		return res; \
+	} \
+	\
+	static type _min_##sfx##_##impl(const type *data, size_t n) { \
+		type res = data[0]; \
+		for (size_t i = 1; i < n; i++) { \
+			if (data[i] < res) \
+				res = data[i]; \
+		} \
+		return res; \
+	} \
+	\
+	static type _max_##sfx##_##impl(const type *data, size_t n) { \
+		type res = data[0]; \
+		for (size_t i = 1; i < n; i++) { \
+			if (data[i] > res) \
+				res = data[i]; \
+		} \
+		return res; \
+	} \
+	\
+	static simd_sum_##sfx##_t _sum_##sfx##_##impl(const type *data, size_t n) { \
+		simd_sum_##sfx##_t res = 0; \
+		for (size_t i = 0; i < n; i++) \
+			res += data[i]; \
+		return res; \
+	}
+#endif
+
+#ifdef SIMD_X86
+#define DISPATCH(func, args) { \
+	if (__builtin_cpu_supports("avx2")) \
+		return func##_avx2 args; \
+	return func##_base args; \
+}
+#define DEFINE_ALL_KERNELS(sfx, type) \
+	DEFINE_KERNELS(base, , sfx, type) \
+	DEFINE_KERNELS(avx2, __attribute__((target("avx2"))), sfx, type)
+#else
+#define DISPATCH(func, args) { \
+	return func##_base args; \
+}
+#define DEFINE_ALL_KERNELS(sfx, type) \
+	DEFINE_KERNELS(base, , sfx, type)
+#endif
+
+#define DEFINE_PUBLIC(sfx, type) \
+	DEFINE_ALL_KERNELS(sfx, type) \
+	size_t simd_count_eq_##sfx(const type *data, size_t n, type x) DISPATCH(_count_eq_##sfx, (data, n, x)) \
+	type simd_min_##sfx(const type *data, size_t n) DISPATCH(_min_##sfx, (data, n)) \
+	type simd_max_##sfx(const type *data, size_t n) DISPATCH(_max_##sfx, (data, n)) \
+	simd_sum_##sfx##_t simd_sum_##sfx(const type *data, size_t n) DISPATCH(_sum_##sfx, (data, n))
+
+#define DEFINE_PUBLIC_FIND(sfx, type) \
+	size_t simd_find_##sfx(const type *data, size_t n, type x) DISPATCH(_find_##sfx, (data, n, x))
+
+DEFINE_PUBLIC(i8,  int8_t)
+DEFINE_PUBLIC(u8,  uint8_t)
+DEFINE_PUBLIC(i16, int16_t)
+DEFINE_PUBLIC(u16, uint16_t)
+DEFINE_PUBLIC(i32, int32_t)
+DEFINE_PUBLIC(u32, uint32_t)
+DEFINE_PUBLIC(i64, int64_t)
+DEFINE_PUBLIC(u64, uint64_t)
+DEFINE_PUBLIC(f32, float)
+DEFINE_PUBLIC(f64, double)
+
+DEFINE_PUBLIC_FIND(i16, int16_t)
+DEFINE_PUBLIC_FIND(u16, uint16_t)
+DEFINE_PUBLIC_FIND(i32, int32_t)
+DEFINE_PUBLIC_FIND(u32, uint32_t)
+DEFINE_PUBLIC_FIND(i64, int64_t)
+DEFINE_PUBLIC_FIND(u64, uint64_t)
+DEFINE_PUBLIC_FIND(f32, float)
+DEFINE_PUBLIC_FIND(f64, double)
+
+/* For bytes, the C library's memchr() is already vectorized. */
+size_t simd_find_u8(const uint8_t *data, size_t n, uint8_t x) {
+	const uint8_t *res = n == 0 ? NULL : memchr(data, x, n);
+	return res == NULL ? n : (size_t)(res - data);
+}
+
+size_t simd_find_i8(const int8_t *data, size_t n, int8_t x) {
+	return simd_find_u8((const uint8_t *)data, n, (uint8_t)x);
+}
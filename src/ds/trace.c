@@ -0,0 +1,250 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/trace.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TRACE_SUPPORT
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/* A trace file starts with a Header. Then come records, each a Record
+ * followed by size bytes, padded to a multiple of 8: for a format the format
+ * string with its null termination, for an event the captured arguments. */
+#define MAGIC "DSFMTTRC"
+#define BYTE_ORDER_MARK 0x01020304
+
+/* Set in the id of a record which defines a format. */
+#define RECORD_FORMAT 0x80000000
+/* Format IDs are numbered densely (see FmtSite); anything above this is taken
+ * for corruption rather than allocating room for that many formats. */
+#define MAX_FORMAT_ID (1024 * 1024)
+
+typedef struct Record {
+	uint32_t id;
+	uint32_t size;
+	uint64_t time; /* nanoseconds since the epoch */
+} Record;
+
+typedef struct Header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t ptr_size;
+} Header;
+
+#ifdef TRACE_SUPPORT
+
+/* Appends a record header to the event. */
+static Error append_record(Trace *t, uint32_t id, uint64_t time, uint32_t size) {
+	Record rec = { .id = id, .size = size, .time = time };
+	return fmtb_append(&t->event, (const char *)&rec, sizeof(rec));
+}
+
+/* Pads the event to a multiple of 8 bytes. */
+static Error align(Trace *t) {
+	static const char zeros[8] = {0};
+	return fmtb_append(&t->event, zeros, (8 - t->event.len % 8) % 8);
+}
+
+Error trace_open(Trace *t, const char *restrict path) {
+	*t = (Trace){
+		.event = fmt_buf(),
+		.defined = bitset(),
+	};
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return ERROR_HEAP_STRING(strdup(strerror(errno)));
+	TRY(fmt_fd_init(&t->out, fd, 0, false), close(fd));
+	Header h = { .byte_order = BYTE_ORDER_MARK, .ptr_size = sizeof(void *) };
+	memcpy(h.magic, MAGIC, sizeof(h.magic));
+	fmt_fd_write(&t->out, &h, sizeof(h));
+	pthread_mutex_init(&t->mutex, NULL);
+	return OK();
+}
+
+Error trace_flush(Trace *t) {
+	pthread_mutex_lock(&t->mutex);
+	Error res = fmt_fd_flush(&t->out);
+	bool lost = t->lost;
+	t->lost = false;
+	pthread_mutex_unlock(&t->mutex);
+	if (!error_is(res) && lost)
+		res = ERROR_OUT_OF_MEMORY();
+	return res;
+}
+
+Error trace_close(Trace *t) {
+	Error res = trace_flush(t);
+	int fd = t->out.fd;
+	error_to_string(NULL, 0, fmt_fd_term(&t->out), true); /* flushed already */
+	if (close(fd) != 0 && !error_is(res))
+		res = ERROR_HEAP_STRING(strdup(strerror(errno)));
+	pthread_mutex_destroy(&t->mutex);
+	fmtb_term(&t->event);
+	bitset_term(&t->defined);
+	return res;
+}
+
+/* Appends a record defining the format with the given id to the event. */
+static Error define_format(Trace *t, uint32_t id, const char *restrict format) {
+	if (id >= bitset_len(&t->defined))
+		TRY(bitset_resize(&t->defined, id + 1), );
+	size_t len = strlen(format) + 1;
+	TRY(append_record(t, id | RECORD_FORMAT, 0, len), );
+	TRY(fmtb_append(&t->event, format, len), );
+	return align(t);
+}
+
+void _trace_fmt(const char *restrict file, size_t line, Trace *t, FmtSite *site, const char *restrict format, ...) {
+	FmtCompiled *f = _fmt_site_get(file, line, site, format);
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	pthread_mutex_lock(&t->mutex);
+	/* The event is recorded in full before any of it is written, so a
+	 * failure leaves the file intact. */
+	fmtb_reset(&t->event);
+	bool define = site->id >= bitset_len(&t->defined) || !bitset_test(&t->defined, site->id);
+	Error err = OK();
+	if (define)
+		err = define_format(t, site->id, format);
+	size_t pos = t->event.len;
+	if (!error_is(err))
+		err = append_record(t, site->id, time, 0);
+	if (!error_is(err)) {
+		va_list args;
+		va_start(args, format);
+		err = fmt_compiled_capturev(&t->event, f, args);
+		va_end(args);
+	}
+	if (!error_is(err) && t->event.len - pos - sizeof(Record) > UINT32_MAX)
+		err = ERROR_OUT_OF_MEMORY();
+	if (error_is(err)) {
+		/* The event is lost; trace_flush() reports it. */
+		if (err.kind == ErrorOutOfMemory)
+			t->lost = true;
+		pthread_mutex_unlock(&t->mutex);
+		if (err.kind != ErrorOutOfMemory)
+			ERROR_ASSERT(_error_hereify(file, line, err));
+		return;
+	}
+	uint32_t size = t->event.len - pos - sizeof(Record);
+	memcpy(t->event.buf + pos + offsetof(Record, size), &size, sizeof(size));
+	fmt_fd_write(&t->out, t->event.buf, t->event.len);
+	if (define)
+		bitset_set(&t->defined, site->id);
+	pthread_mutex_unlock(&t->mutex);
+}
+
+#endif
+
+/********************************\
+|*           Decoding           *|
+\********************************/
+static Error corrupt(size_t offset) {
+	char buf[128];
+	snprintf(buf, sizeof(buf), "trace: Corrupt or truncated trace file at byte %zu", offset);
+	return ERROR_HEAP_STRING(strdup(buf));
+}
+
+Error trace_decode(FmtContext *restrict ctx, const void *restrict data, size_t size) {
+	const char *d = data;
+	Header h;
+	if (size < sizeof(h))
+		return ERROR_STRING("trace: Not a trace file");
+	memcpy(&h, d, sizeof(h));
+	if (memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0)
+		return ERROR_STRING("trace: Not a trace file");
+	if (h.byte_order != BYTE_ORDER_MARK || h.ptr_size != sizeof(void *))
+		return ERROR_STRING("trace: The trace file was written on a different kind of machine");
+
+	/* Formats by ID; NULL if not defined yet or if they failed to compile. */
+	FmtCompiled **fs = NULL;
+	const char **fs_src = NULL;
+	size_t n_fs = 0;
+	Error res = OK();
+	size_t pos = sizeof(h);
+	while (pos < size) {
+		Record rec;
+		if (size - pos < sizeof(rec)) {
+			res = corrupt(pos);
+			break;
+		}
+		memcpy(&rec, d + pos, sizeof(rec));
+		const char *payload = d + pos + sizeof(rec);
+		size_t padded = (rec.size + 7) / 8 * 8;
+		if (size - pos - sizeof(rec) < padded) {
+			res = corrupt(pos);
+			break;
+		}
+		bool is_format = rec.id & RECORD_FORMAT;
+		rec.id &= ~RECORD_FORMAT;
+		if (is_format) {
+			if (rec.size == 0 || payload[rec.size - 1] != 0 || rec.id > MAX_FORMAT_ID) {
+				res = corrupt(pos);
+				break;
+			}
+			if (rec.id >= n_fs) {
+				size_t new_n = rec.id + 1;
+				FmtCompiled **new_fs = realloc(fs, sizeof(*fs) * new_n);
+				if (new_fs != NULL)
+					fs = new_fs;
+				const char **new_src = realloc(fs_src, sizeof(*fs_src) * new_n);
+				if (new_src != NULL)
+					fs_src = new_src;
+				if (new_fs == NULL || new_src == NULL) {
+					res = ERROR_OUT_OF_MEMORY();
+					break;
+				}
+				memset(fs + n_fs, 0, sizeof(*fs) * (new_n - n_fs));
+				memset(fs_src + n_fs, 0, sizeof(*fs_src) * (new_n - n_fs));
+				n_fs = new_n;
+			}
+			if (fs[rec.id] != NULL)
+				fmt_compiled_term(fs[rec.id]);
+			fs[rec.id] = NULL;
+			fs_src[rec.id] = payload;
+			Error err = fmt_compile(&fs[rec.id], payload);
+			if (err.kind == ErrorOutOfMemory) {
+				res = err;
+				break;
+			}
+			error_to_string(NULL, 0, err, true); /* just free it; events say what failed */
+		} else {
+			if (rec.id >= n_fs || fs_src[rec.id] == NULL ||
+					(fs[rec.id] != NULL && !fmt_captured_fits(fs[rec.id], payload, rec.size))) {
+				res = corrupt(pos);
+				break;
+			}
+			fmtc(ctx, "[%zu.%{size_t:p=9,c='0'}] ", (size_t)(rec.time / 1000000000), (size_t)(rec.time % 1000000000));
+			const char *src = fs_src[rec.id];
+			size_t src_len = strlen(src);
+			bool newline = src_len != 0 && src[src_len - 1] == '\n';
+			if (fs[rec.id] == NULL)
+				fmtc(ctx, "trace: Can't decode \"%s\", it prints an unknown type", src);
+			else {
+				Error err = fmtc_captured(ctx, fs[rec.id], payload);
+				if (error_is(err))
+					fmtc(ctx, "trace: %{Error:destroy}", err);
+			}
+			if (!newline || fs[rec.id] == NULL)
+				ctx->putc_func(ctx, '\n');
+		}
+		pos += sizeof(rec) + padded;
+	}
+	for (size_t i = 0; i < n_fs; i++) {
+		if (fs[i] != NULL)
+			fmt_compiled_term(fs[i]);
+	}
+	free(fs);
+	free(fs_src);
+	return res;
+}
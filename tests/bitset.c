@@ -0,0 +1,119 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/bitset.h>
+#include <ds/fmt.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Bitsets are checked against plain arrays of bools. */
+#define N 2000
+
+static void fill_random(Bitset *b, bool *ref, size_t n, int one_in) {
+	ERROR_ASSERT(bitset_resize(b, n));
+	for (size_t i = 0; i < n; i++) {
+		ref[i] = rand() % one_in == 0;
+		bitset_assign(b, i, ref[i]);
+	}
+}
+
+static void check(const Bitset *b, const bool *ref) {
+	size_t count = 0;
+	for (size_t i = 0; i < bitset_len(b); i++) {
+		assert(bitset_test(b, i) == ref[i]);
+		count += ref[i];
+	}
+	assert(bitset_count(b) == count);
+}
+
+int main() {
+	fmt_init();
+	char buf[256];
+
+	// Basics and printing
+	Bitset b = bitset();
+	assert(bitset_len(&b) == 0 && bitset_count(&b) == 0);
+	assert(bitset_next_set_bit(&b, 0) == 0);
+	ERROR_ASSERT(bitset_push(&b, true));
+	ERROR_ASSERT(bitset_push(&b, false));
+	ERROR_ASSERT(bitset_push(&b, true));
+	bitset_set(&b, 1);
+	bitset_clear(&b, 2);
+	bitset_fmt_register();
+	fmts(buf, sizeof(buf), "%{Bitset}", &b);
+	assert(strcmp(buf, "110") == 0);
+	bitset_fill(&b, true);
+	ERROR_ASSERT(bitset_resize(&b, 130));
+	assert(bitset_count(&b) == 3 && !bitset_test(&b, 129));
+	bitset_fill(&b, true);
+	assert(bitset_count(&b) == 130);
+	/* Shrinking and growing again must not bring back old bits. */
+	ERROR_ASSERT(bitset_resize(&b, 65));
+	ERROR_ASSERT(bitset_resize(&b, 128));
+	assert(bitset_count(&b) == 65);
+	bitset_term(&b);
+
+	// Set operations, for all combinations of lengths around word and vector boundaries
+	static bool ra[N], rb[N], rc[N];
+	const size_t lens[] = { 0, 1, 63, 64, 65, 255, 256, 257, 1000, N };
+	for (size_t la = 0; la < sizeof(lens) / sizeof(lens[0]); la++) {
+		for (size_t lb = 0; lb < sizeof(lens) / sizeof(lens[0]); lb++) {
+			size_t na = lens[la], nb = lens[lb];
+			for (int op = 0; op < 4; op++) {
+				Bitset a = bitset(), c = bitset();
+				fill_random(&a, ra, na, 2);
+				fill_random(&c, rb, nb, 3);
+				for (size_t i = 0; i < na; i++) {
+					bool y = i < nb && rb[i];
+					switch (op) {
+						case 0: rc[i] = ra[i] && y; break;
+						case 1: rc[i] = ra[i] || y; break;
+						case 2: rc[i] = ra[i] != y; break;
+						case 3: rc[i] = ra[i] && !y; break;
+					}
+				}
+				switch (op) {
+					case 0: bitset_and(&a, &c); break;
+					case 1: bitset_or(&a, &c); break;
+					case 2: bitset_xor(&a, &c); break;
+					case 3: bitset_andnot(&a, &c); break;
+				}
+				assert(bitset_len(&a) == na);
+				check(&a, rc);
+				bitset_term(&a);
+				bitset_term(&c);
+			}
+		}
+	}
+
+	// Iteration, rank and select
+	for (int one_in = 1; one_in <= 200; one_in *= 7) {
+		for (size_t li = 0; li < sizeof(lens) / sizeof(lens[0]); li++) {
+			size_t n = lens[li];
+			Bitset s = bitset();
+			fill_random(&s, ra, n, one_in);
+			check(&s, ra);
+			BitsetRank r;
+			ERROR_ASSERT(bitset_rank_build(&r, &s));
+			size_t next = bitset_next_set_bit(&s, 0), rank = 0;
+			for (size_t i = 0; i < n; i++) {
+				assert(bitset_rank(&r, &s, i) == rank);
+				if (ra[i]) {
+					assert(next == i);
+					assert(bitset_select(&r, &s, rank) == i);
+					next = bitset_next_set_bit(&s, i + 1);
+					rank++;
+				}
+			}
+			assert(next == n);
+			assert(bitset_rank(&r, &s, n) == rank);
+			assert(bitset_select(&r, &s, rank) == n);
+			bitset_rank_term(&r);
+			bitset_term(&s);
+		}
+	}
+
+	fmt_term();
+}
@@ -0,0 +1,26 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#ifndef __TESTS_FILE_H__
+#define __TESTS_FILE_H__
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Returns the contents of the file at path, null terminated and aligned like
+ * any malloc() memory. */
+static inline char *read_file(const char *path, size_t *size) {
+	FILE *fp = fopen(path, "rb");
+	assert(fp != NULL);
+	fseek(fp, 0, SEEK_END);
+	*size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	char *res = malloc(*size + 1);
+	assert(fread(res, 1, *size, fp) == *size);
+	res[*size] = 0;
+	fclose(fp);
+	return res;
+}
+
+#endif
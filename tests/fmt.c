@@ -2,10 +2,105 @@
 // SPDX license identifier: MIT
 
 #include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ds/fmt.h>
 
+#include "file.h"
+
+/* Formats with both fmts() and a compiled format, which must agree. */
+#define CHECK_COMPILED(_expected, _format, ...) { \
+	char _a[256], _b[256]; \
+	FmtCompiled *_f; \
+	ERROR_ASSERT(fmt_compile(&_f, _format)); \
+	size_t _na = fmts(_a, 256, _format, ##__VA_ARGS__); \
+	size_t _nb = fmts_compiled(_b, 256, _f, ##__VA_ARGS__); \
+	assert(_na == _nb && strcmp(_a, _b) == 0); \
+	assert(strcmp(_a, _expected) == 0); \
+	fmt_compiled_term(_f); \
+}
+
+/* Contexts with and without write_func must give the same output. */
+typedef struct StrBuf {
+	char buf[256];
+	size_t len, n_calls;
+} StrBuf;
+
+static void strbuf_putc(FmtContext *ctx, char c) {
+	StrBuf *b = ctx->ctx_data;
+	b->buf[b->len++] = c;
+	b->n_calls++;
+}
+
+static void strbuf_write(FmtContext *ctx, const char *buf, size_t n) {
+	StrBuf *b = ctx->ctx_data;
+	memcpy(b->buf + b->len, buf, n);
+	b->len += n;
+	b->n_calls++;
+}
+
+/* Formats in a loop until told to stop, while the main thread registers. */
+typedef struct Formatter {
+	pthread_t thread;
+	int id;
+	size_t rounds;
+} Formatter;
+
+static _Atomic bool stop_formatting;
+
+static FmtPrintFuncRet print_point(FmtContext *ctx, FmtAttrs *attrs, va_list v) {
+	int *p = va_arg(v, int *);
+	fmtc(ctx, "(%d, %d)", p[0], p[1]);
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static FmtAttrId attr_swap;
+
+/* Prints a pair of ints, swapped with the custom attribute swap. */
+static FmtPrintFuncRet print_pair(FmtContext *ctx, FmtAttrs *attrs, va_list v) {
+	bool swap = false;
+	for (size_t i = 0; i < attrs->len; i++) {
+		if (attrs->ids[i] == attr_swap)
+			swap = true;
+		else
+			return FMT_PRINT_FUNC_RET_INVALID_ATTR(i);
+	}
+	int *p = va_arg(v, int *);
+	fmtc(ctx, "(%d, %d)", p[swap], p[!swap]);
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static Error capture_point(FmtBuf *out, FmtAttrs *attrs, va_list v) {
+	int *p = va_arg(v, int *);
+	return fmtb_append(out, (const char *)p, 2 * sizeof(int));
+}
+
+static FmtPrintFuncRet print_captured_point(FmtContext *ctx, FmtAttrs *attrs, va_list v) {
+	const int *p = va_arg(v, const void *);
+	fmtc(ctx, "(%d, %d)", p[0], p[1]);
+	return FMT_PRINT_FUNC_RET_OK();
+}
+
+static void *formatter_run(void *arg) {
+	Formatter *f = arg;
+	int point[2] = { f->id, -f->id };
+	char buf[128], expected[128];
+	snprintf(expected, 128, "%d: (%d, %d) abc", f->id, f->id, -f->id);
+	while (!atomic_load(&stop_formatting)) {
+		fmts(buf, 128, "%{int}: %{Point} %{str}", f->id, point, "abc");
+		assert(strcmp(buf, expected) == 0);
+		f->rounds++;
+	}
+	return NULL;
+}
+
 int main() {
 	fmt_init();
 	char buf[128];
@@ -14,5 +109,280 @@ int main() {
 	assert(strcmp(buf, "32, abc123 AA .................................................................................................................") == 0);
 	size = fmts(NULL, 0, "%%");
 	assert(size == 1);
+
+	// Bulk writes
+	StrBuf a = {0}, b = {0};
+	FmtContext ctx_a = { .ctx_data = &a, .putc_func = strbuf_putc };
+	FmtContext ctx_b = { .ctx_data = &b, .putc_func = strbuf_putc, .write_func = strbuf_write };
+	const char *long_str = "a string which is long enough to matter";
+	fmtc(&ctx_a, "literal text %s|%{str:p=100,c='_'}|%{int:p=70}%c", long_str, "x", -1234, '!');
+	fmtc(&ctx_b, "literal text %s|%{str:p=100,c='_'}|%{int:p=70}%c", long_str, "x", -1234, '!');
+	assert(a.len == b.len && memcmp(a.buf, b.buf, a.len) == 0);
+	assert(b.n_calls < 12 && a.n_calls == a.len);
+	/* Truncation */
+	size = fmts(buf, 8, "%s and more", long_str);
+	assert(size == strlen(long_str) + 9 && strcmp(buf, "a strin") == 0);
+	size = fmts(buf, 1, "abc");
+	assert(size == 3 && buf[0] == 0);
+
+	// Allocated output
+	size_t len;
+	char *str = fmta(&len, "%s=%{int:p=5}", "key", 42);
+	assert(len == 9 && strcmp(str, "key=   42") == 0);
+	free(str);
+	str = fmta(NULL, "");
+	assert(strcmp(str, "") == 0);
+	free(str);
+	/* Longer than the initial buffer on the stack */
+	str = fmta(&len, "%s|%{str:p=1000,c='_'}|", long_str, "end");
+	assert(len == strlen(long_str) + 1002);
+	assert(strncmp(str, long_str, strlen(long_str)) == 0 && strcmp(str + len - 5, "_end|") == 0);
+	free(str);
+	FmtBuf fb = fmt_buf();
+	ERROR_ASSERT(fmtb(&fb, ""));
+	assert(fb.len == 0 && strcmp(fb.buf, "") == 0);
+	for (int i = 0; i < 1000; i++)
+		ERROR_ASSERT(fmtb(&fb, "%d,", i));
+	ERROR_ASSERT(fmtb_append(&fb, "end", 3));
+	assert(fb.len == 3893 && fb.len < fb.cap && fb.buf[fb.len] == 0);
+	assert(strncmp(fb.buf, "0,1,2,", 6) == 0 && strcmp(fb.buf + fb.len - 7, "999,end") == 0);
+	/* Reuse doesn't allocate */
+	char *old_buf = fb.buf;
+	size_t old_cap = fb.cap;
+	fmtb_reset(&fb);
+	assert(fb.len == 0 && strcmp(fb.buf, "") == 0);
+	ERROR_ASSERT(fmtb(&fb, "%{str:p=2000}", "x"));
+	assert(fb.len == 2000 && fb.buf == old_buf && fb.cap == old_cap);
+	fmtb_term(&fb);
+
+	// Integers, against snprintf()
+	char ref[128];
+	const long long limits[] = { 0, 1, -1, 9, 10, 99, 100, INT_MAX, INT_MIN, LLONG_MAX, LLONG_MIN };
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]) + 10000; i++) {
+		long long x;
+		if (i < sizeof(limits) / sizeof(limits[0]))
+			x = limits[i];
+		else {
+			/* Random values of every magnitude */
+			x = (long long)(((unsigned long long)rand() << 42) ^ ((unsigned long long)rand() << 21) ^ rand());
+			x >>= rand() % 64;
+		}
+		fmts(buf, 128, "%lld %llu %llx %llX %{int:o}", x, (unsigned long long)x, (unsigned long long)x, (unsigned long long)x, (int)x);
+		snprintf(ref, 128, "%lld %llu %llx %llX %o", x, (unsigned long long)x, (unsigned long long)x, (unsigned long long)x, (int)x < 0 ? -(unsigned)(int)x : (unsigned)(int)x);
+		if ((int)x < 0) {
+			/* fmt prints negative octal numbers with a sign */
+			char *o = strrchr(ref, ' ') + 1;
+			memmove(o + 1, o, strlen(o) + 1);
+			*o = '-';
+		}
+		assert(strcmp(buf, ref) == 0);
+		fmts(buf, 128, "%d %zd", (int)x, (ssize_t)x);
+		snprintf(ref, 128, "%d %zd", (int)x, (ssize_t)x);
+		assert(strcmp(buf, ref) == 0);
+	}
+	fmts(buf, 128, "%{uint:b=2} %{uint:b=3} %{int:b=7,p=6,c='0'}", 10u, 10u, -48);
+	assert(strcmp(buf, "1010 101 000-66") == 0);
+
+	// Floating point numbers: the shortest digits parse back to the same
+	// double and are the fewest which do; with a precision, against snprintf()
+	const double special[] = { 0.0, -0.0, 1.0, 0.1, 0.3, 2.675, 100.0, 123.456, 1e16, 1e-5, 5e-324, 2.2250738585072014e-308, 1.7976931348623157e308 };
+	for (size_t i = 0; i < sizeof(special) / sizeof(special[0]) + 10000; i++) {
+		double x;
+		if (i < sizeof(special) / sizeof(special[0]))
+			x = special[i];
+		else {
+			/* Random bit patterns, so every exponent is covered */
+			unsigned long long bits = ((unsigned long long)rand() << 42) ^ ((unsigned long long)rand() << 21) ^ rand();
+			memcpy(&x, &bits, sizeof(x));
+			if (!isfinite(x))
+				continue;
+		}
+		fmts(buf, 128, "%{double}", x);
+		assert(strtod(buf, NULL) == x && signbit(strtod(buf, NULL)) == signbit(x));
+		/* Significant digits, from the first to the last nonzero one */
+		int n_digits = 0, n_seen = 0;
+		for (const char *c = buf; *c != 0 && *c != 'e'; c++) {
+			if (*c >= '0' && *c <= '9' && (n_seen != 0 || *c != '0'))
+				n_seen++;
+			if (*c >= '1' && *c <= '9')
+				n_digits = n_seen;
+		}
+		if (n_digits > 1) {
+			snprintf(ref, 128, "%.*e", n_digits - 2, x);
+			assert(strtod(ref, NULL) != x);
+		}
+		int prec = rand() % 20;
+		fmts(buf, 128, "%e|%g|%{double:e,prec=*}|%{double:g,prec=*}|%{double:p=30,c='_',e,prec=3}", x, x, prec, x, prec, x, x);
+		snprintf(ref, 128, "%e|%g|%.*e|%.*g|%30.3e", x, x, prec, x, prec, x, x);
+		for (char *c = strrchr(ref, '|') + 1; *c == ' '; c++)
+			*c = '_';
+		assert(strcmp(buf, ref) == 0);
+		if (fabs(x) < 1e30) {
+			fmts(buf, 128, "%f|%{double:prec=*}", x, prec, x);
+			snprintf(ref, 128, "%f|%.*f", x, prec, x);
+			assert(strcmp(buf, ref) == 0);
+		}
+	}
+	fmts(buf, 128, "%{double} %{double} %{double} %{double} %{double:p=6} %f %e", 100.0, 1e16, 0.0001, -0.0, NAN, -INFINITY, INFINITY);
+	assert(strcmp(buf, "100 1e+16 0.0001 -0    nan -inf inf") == 0);
+
+	// Compiled formats
+	CHECK_COMPILED("", "");
+	CHECK_COMPILED("plain text", "plain text");
+	CHECK_COMPILED("100% 5", "100%% %d", 5);
+	CHECK_COMPILED("y, -12 x ab 0x00000000002a", "%y, %ld %c %x %p", -12L, 'x', 171, (void *)42);
+	CHECK_COMPILED("[  -7|00ff]", "[%{int:p=4}|%{uint:x,p=*,c='0'}]", -7, 4, 255);
+	CHECK_COMPILED("18446744073709551615 9", "%llu %zd", 18446744073709551615ULL, (ssize_t)9);
+	CHECK_COMPILED("trailing ", "trailing %");
+	FmtCompiled *f;
+	Error err = fmt_compile(&f, "%{nonexistent}");
+	fmts(buf, 128, "%{Error:destroy}", err);
+	assert(strcmp(buf, "fmt: Unrecognized type name: 'nonexistent'") == 0);
+	err = fmt_compile(&f, "%{int:p=2,nonexistent}");
+	fmts(buf, 128, "%{Error:destroy}", err);
+	assert(strcmp(buf, "fmt: Unrecognized attribute name: 'nonexistent'") == 0);
+	ERROR_ASSERT(fmt_compile(&f, "%{str:p=6}|%{Error}"));
+	/* The original format string isn't needed anymore */
+	char format[] = "%d-%d";
+	FmtCompiled *g;
+	ERROR_ASSERT(fmt_compile(&g, format));
+	memset(format, 0, sizeof(format));
+	for (int i = 0; i < 3; i++) {
+		fmts_compiled(buf, 128, f, "abc", OK());
+		assert(strcmp(buf, "   abc|Success") == 0);
+		fmts_compiled(buf, 128, g, i, -i);
+	}
+	assert(strcmp(buf, "2--2") == 0);
+	str = fmta_compiled(&len, g, 1, 2);
+	assert(len == 3 && strcmp(str, "1-2") == 0);
+	free(str);
+	fb = fmt_buf();
+	ERROR_ASSERT(fmtb_compiled(&fb, g, 3, 4));
+	ERROR_ASSERT(fmtb_compiled(&fb, g, 5, 6));
+	assert(strcmp(fb.buf, "3-45-6") == 0);
+	fmtb_term(&fb);
+	fmt_compiled_term(f);
+	fmt_compiled_term(g);
+
+	// Custom attributes
+	attr_swap = fmt_attr_register("swap");
+	assert(attr_swap >= FmtAttrBuiltinEnd);
+	assert(fmt_attr_register("swap") == attr_swap);
+	assert(fmt_attr_register("prec") == FmtAttrPrec);
+	assert(strcmp(fmt_attr_name(attr_swap), "swap") == 0);
+	assert(strcmp(fmt_attr_name(FmtAttrPadChar), "c") == 0);
+	fmt_register("Pair", print_pair);
+	int pair[2] = { 1, 2 };
+	fmts(buf, 128, "%{Pair} %{Pair:swap} %{int:p=3}", pair, pair, 5);
+	assert(strcmp(buf, "(1, 2) (2, 1)   5") == 0);
+
+	// Capturing arguments and printing them later
+	fmt_register("Point", print_point);
+	ERROR_ASSERT(fmt_compile(&f, "%{int:p=*}|%s|%{str:p=5}|%c %zu %f %p|%{Error}|%{Point}"));
+	FmtBuf cap = fmt_buf();
+	char text[8] = "abc";
+	int point[2] = { 3, -4 };
+	err = fmt_compiled_capture(&cap, f, 4, 7, text, "xy", 'z', (size_t)99, 1.5, (void *)0x10, ERROR_STRING("oops"), point);
+	assert(err.kind == ErrorString && strstr(err.str, "capture") != NULL); // Point has no capture function yet
+	assert(cap.len == 0);
+	fmt_compiled_term(f);
+	fmt_register_capture("Point", capture_point, print_captured_point);
+	ERROR_ASSERT(fmt_compile(&f, "%{int:p=*}|%s|%{str:p=5}|%c %zu %f %p|%{Error}|%{Point}"));
+	ERROR_ASSERT(fmt_compiled_capture(&cap, f, 4, 7, text, "xy", 'z', (size_t)99, 1.5, (void *)0x10, ERROR_STRING("oops"), point));
+	assert(cap.len % 8 == 0);
+	char expected[128];
+	fmts(expected, 128, "%{int:p=*}|%s|%{str:p=5}|%c %zu %f %p|%{Error}|%{Point}", 4, 7, text, "xy", 'z', (size_t)99, 1.5, (void *)0x10, ERROR_STRING("oops"), point);
+	assert(strcmp(expected, "   7|abc|   xy|z 99 1.500000 0x000000000010|oops|(3, -4)") == 0);
+	strcpy(text, "XYZ");
+	point[0] = 0;
+	fb = fmt_buf();
+	ERROR_ASSERT(fmtb_captured(&fb, f, cap.buf));
+	assert(strcmp(fb.buf, expected) == 0);
+	fmtb_term(&fb);
+	// Truncated captures are caught, reading only within the given size
+	assert(fmt_captured_fits(f, cap.buf, cap.len));
+	for (size_t n = 0; n < cap.len; n++) {
+		char *part = malloc(n + 1);
+		memcpy(part, cap.buf, n);
+		assert(!fmt_captured_fits(f, part, n));
+		free(part);
+	}
+	fmtb_term(&cap);
+	fmt_compiled_term(f);
+
+	// Buffered file descriptor output, copying and scatter/gather; output much
+	// larger than the buffer, and strings larger than the whole buffer
+	{
+		char *big = malloc(100000);
+		memset(big, 'b', 99999);
+		big[99999] = 0;
+		ERROR_ASSERT(fmt_compile(&f, "%d: %s|%{Point}\n"));
+		FmtBuf expected = fmt_buf();
+		for (int i = 0; i < 2000; i++)
+			ERROR_ASSERT(fmtb(&expected, "%d: %s|%{Point}\n", i, i % 100 == 0 ? big : "short", point));
+		ERROR_ASSERT(fmtb(&expected, "%s", big));
+		ERROR_ASSERT(fmtb(&expected, "%{Error:destroy}.\n", ERROR_STRING(big)));
+		for (int scatter = 0; scatter < 2; scatter++) {
+			char path[] = "/tmp/ds_fmt_test_XXXXXX";
+			int fd = mkstemp(path);
+			assert(fd >= 0);
+			FmtFd out;
+			ERROR_ASSERT(fmt_fd_init(&out, fd, 1, scatter));
+			assert(out.cap % sysconf(_SC_PAGESIZE) == 0);
+			assert((uintptr_t)out.buf % sysconf(_SC_PAGESIZE) == 0);
+			for (int i = 0; i < 2000; i++) {
+				if (i % 2 == 0)
+					fmtfd(&out, "%d: %s|%{Point}\n", i, i % 100 == 0 ? big : "short", point);
+				else
+					fmtfd_compiled(&out, f, i, i % 100 == 0 ? big : "short", point);
+			}
+			FmtContext ctx = fmt_fd_context(&out);
+			fmtc(&ctx, "%s", big);
+			// Printed from a temporary copy, which must not be referenced
+			char *msg = strdup(big);
+			fmtfd(&out, "%{Error:destroy}.\n", ERROR_HEAP_STRING(msg));
+			ERROR_ASSERT(fmt_fd_term(&out));
+			close(fd);
+			size_t len;
+			char *res = read_file(path, &len);
+			assert(len == expected.len);
+			assert(memcmp(res, expected.buf, len) == 0);
+			free(res);
+			unlink(path);
+		}
+		fmtb_term(&expected);
+		fmt_compiled_term(f);
+		free(big);
+
+		// Write errors are reported by the next flush
+		FmtFd out;
+		ERROR_ASSERT(fmt_fd_init(&out, -1, 0, false));
+		assert(out.cap == FMT_FD_DEFAULT_BUF_SIZE);
+		fmtfd(&out, "lost\n");
+		Error err = fmt_fd_flush(&out);
+		assert(error_is(err));
+		error_to_string(NULL, 0, err, true);
+		ERROR_ASSERT(fmt_fd_term(&out));
+	}
+
+	// Formatting from several threads while registering
+	Formatter formatters[4];
+	for (int i = 0; i < 4; i++) {
+		formatters[i] = (Formatter){ .id = i };
+		assert(pthread_create(&formatters[i].thread, NULL, formatter_run, &formatters[i]) == 0);
+	}
+	for (int i = 0; i < 200; i++) {
+		char name[32];
+		snprintf(name, 32, "Type%d", i);
+		fmt_register(name, print_point);
+	}
+	atomic_store(&stop_formatting, true);
+	for (int i = 0; i < 4; i++)
+		pthread_join(formatters[i].thread, NULL);
+	point[0] = 1;
+	point[1] = 2;
+	fmts(buf, 128, "%{Type0} %{Type199}", point, point);
+	assert(strcmp(buf, "(1, 2) (1, 2)") == 0);
+
 	fmt_term();
 }
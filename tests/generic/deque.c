@@ -0,0 +1,163 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+static size_t n_terms = 0;
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntDeque
+#define GENERIC_PREFIX int_deque
+#define GENERIC_TERM_ITEM(_itm) n_terms++
+#include <ds/generic/deque.h>
+
+#define GENERIC_TYPE IntDeque
+#define GENERIC_NAME IntDeque2D
+#define GENERIC_PREFIX int_deque_2d
+#define GENERIC_TERM_ITEM(_itm) int_deque_term(&_itm)
+#include <ds/generic/deque.h>
+
+/* Checks d against the plain array model[0..len). */
+static void check(IntDeque *d, const int *model, size_t len) {
+	assert(int_deque_len(d) == len);
+	assert(d->cap == 0 || (d->cap & (d->cap - 1)) == 0);
+	for (size_t i = 0; i < len; i++)
+		assert(*int_deque_at(d, i) == model[i]);
+}
+
+int main() {
+	fmt_init();
+	int_deque_fmt_register("%d");
+
+	IntDeque d = int_deque();
+	assert(int_deque_len(&d) == 0);
+	assert(int_deque_cap(&d) == 0);
+	assert(int_deque_pop_front_n(&d, NULL, 10) == 0);
+
+	// Push/pop at both ends
+	ERROR_ASSERT(int_deque_push_back(&d, 2));
+	ERROR_ASSERT(int_deque_push_back(&d, 3));
+	ERROR_ASSERT(int_deque_push_front(&d, 1));
+	ERROR_ASSERT(int_deque_push_front(&d, 0));
+	char buf[4096];
+	fmts(buf, 4096, "%{IntDeque}", &d);
+	assert(strcmp(buf, "{0, 1, 2, 3}") == 0);
+	assert(*int_deque_front(&d) == 0);
+	assert(*int_deque_back(&d) == 3);
+	assert(int_deque_pop_front(&d) == 0);
+	assert(int_deque_pop_back(&d) == 3);
+	assert(n_terms == 2);
+	int_deque_clear(&d);
+	assert(int_deque_len(&d) == 0);
+	assert(n_terms == 4);
+
+	// FIFO usage keeps the capacity bounded
+	for (int i = 0; i < 100000; i++) {
+		ERROR_ASSERT(int_deque_push_back(&d, i));
+		if (i >= 5)
+			assert(int_deque_pop_front(&d) == i - 5);
+	}
+	assert(int_deque_len(&d) == 5);
+	assert(int_deque_cap(&d) == 8);
+	int_deque_clear(&d);
+
+	// Random operations against a plain array; the model keeps its front at
+	// model + off so items can be added on both sides.
+	{
+		enum { MODEL_CAP = 1 << 16 };
+		int *mem = malloc(sizeof(int) * MODEL_CAP);
+		assert(mem != NULL);
+		size_t off = MODEL_CAP / 2, len = 0;
+		int next = 0;
+		srand(1);
+		for (size_t iter = 0; iter < 20000; iter++) {
+			int items[37], out[37];
+			size_t n = rand() % 37;
+			for (size_t i = 0; i < n; i++)
+				items[i] = next++;
+			switch (rand() % 8) {
+			case 0:
+				ERROR_ASSERT(int_deque_push_back(&d, next));
+				mem[off + len++] = next++;
+				break;
+			case 1:
+				ERROR_ASSERT(int_deque_push_front(&d, next));
+				mem[--off] = next++;
+				len++;
+				break;
+			case 2:
+				if (len != 0) {
+					assert(int_deque_pop_back(&d) == mem[off + --len]);
+				}
+				break;
+			case 3:
+				if (len != 0) {
+					assert(int_deque_pop_front(&d) == mem[off++]);
+					len--;
+				}
+				break;
+			case 4:
+				ERROR_ASSERT(int_deque_push_back_n(&d, items, n));
+				memcpy(mem + off + len, items, sizeof(int) * n);
+				len += n;
+				break;
+			case 5:
+				ERROR_ASSERT(int_deque_push_front_n(&d, items, n));
+				off -= n;
+				memcpy(mem + off, items, sizeof(int) * n);
+				len += n;
+				break;
+			case 6: {
+				size_t got = int_deque_pop_front_n(&d, out, n);
+				assert(got == (n < len ? n : len));
+				assert(memcmp(out, mem + off, sizeof(int) * got) == 0);
+				off += got;
+				len -= got;
+				break;
+			}
+			case 7: {
+				size_t got = int_deque_pop_back_n(&d, out, n);
+				assert(got == (n < len ? n : len));
+				len -= got;
+				assert(memcmp(out, mem + off + len, sizeof(int) * got) == 0);
+				break;
+			}
+			}
+			if (iter % 1000 == 0) {
+				// Shrinking moves wrapped items back into one piece
+				ERROR_ASSERT(int_deque_fit(&d, 0));
+			}
+			check(&d, mem + off, len);
+			if (off < 64 || off + len > MODEL_CAP - 64) {
+				memmove(mem + MODEL_CAP / 2 - len / 2, mem + off, sizeof(int) * len);
+				off = MODEL_CAP / 2 - len / 2;
+			}
+		}
+		free(mem);
+	}
+	int_deque_term(&d);
+
+	// Items are terminated when popped without a destination
+	IntDeque2D d2d = int_deque_2d();
+	for (int i = 0; i < 20; i++) {
+		IntDeque inner = int_deque();
+		ERROR_ASSERT(int_deque_push_back(&inner, i));
+		ERROR_ASSERT(int_deque_2d_push_front(&d2d, inner));
+	}
+	IntDeque moved[5];
+	assert(int_deque_2d_pop_back_n(&d2d, moved, 5) == 5);
+	assert(*int_deque_front(&moved[0]) == 4 && *int_deque_front(&moved[4]) == 0);
+	for (size_t i = 0; i < 5; i++)
+		int_deque_term(&moved[i]);
+	assert(int_deque_2d_pop_front_n(&d2d, NULL, 5) == 5);
+	assert(*int_deque_front(int_deque_2d_front(&d2d)) == 14);
+	int_deque_2d_term(&d2d);
+
+	fmt_term();
+}
@@ -0,0 +1,98 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+#define GENERIC_KEY_TYPE int
+#define GENERIC_VALUE_TYPE int
+#define GENERIC_NAME IntIntFlatMap
+#define GENERIC_PREFIX int_int_flat_map
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#include <ds/generic/flat_map.h>
+
+#define GENERIC_KEY_TYPE const char *
+#define GENERIC_VALUE_TYPE char *
+#define GENERIC_NAME StrStrFlatMap
+#define GENERIC_PREFIX str_str_flat_map
+#define GENERIC_CMP(_a, _b) strcmp(_a, _b)
+#define GENERIC_TERM_ITEM(_val) free(_val)
+#include <ds/generic/flat_map.h>
+
+#define N 1000
+
+static void check_sorted(const IntIntFlatMap *m) {
+	for (size_t i = 1; i < m->len; i++)
+		assert(m->keys[i - 1] < m->keys[i]);
+}
+
+int main() {
+	fmt_init();
+	char buf[256];
+
+	// Single inserts, lookups and deletes
+	IntIntFlatMap m = int_int_flat_map();
+	assert(int_int_flat_map_get(&m, 1) == NULL);
+	assert(!int_int_flat_map_del(&m, 1));
+	for (int i = 0; i < N; i++)
+		ERROR_ASSERT(int_int_flat_map_set(&m, (i * 7919) % N, i));
+	assert(int_int_flat_map_len(&m) == N);
+	check_sorted(&m);
+	for (int i = 0; i < N; i++) {
+		int *p = int_int_flat_map_get(&m, (i * 7919) % N);
+		assert(p != NULL && *p == i);
+	}
+	assert(int_int_flat_map_get(&m, -1) == NULL);
+	assert(int_int_flat_map_get(&m, N) == NULL);
+	assert(int_int_flat_map_lower_bound(&m, -1) == 0);
+	assert(int_int_flat_map_lower_bound(&m, N) == N);
+	ERROR_ASSERT(int_int_flat_map_set(&m, 5, -5));
+	assert(*int_int_flat_map_get(&m, 5) == -5 && int_int_flat_map_len(&m) == N);
+	for (int i = 0; i < N; i += 2)
+		assert(int_int_flat_map_del(&m, i));
+	assert(int_int_flat_map_len(&m) == N / 2);
+	assert(int_int_flat_map_get(&m, 4) == NULL && int_int_flat_map_get(&m, 5) != NULL);
+	check_sorted(&m);
+	int_int_flat_map_term(&m);
+
+	// Batch inserts, checked against single inserts (with duplicate keys
+	// within batches and between a batch and the map)
+	static IntIntFlatMapItem items[N];
+	IntIntFlatMap a = int_int_flat_map(), b = int_int_flat_map();
+	for (int round = 0; round < 20; round++) {
+		size_t n = rand() % (round < 10 ? 20 : N);
+		for (size_t i = 0; i < n; i++) {
+			items[i] = (IntIntFlatMapItem){ .key = rand() % 3000, .val = rand() };
+			ERROR_ASSERT(int_int_flat_map_set(&a, items[i].key, items[i].val));
+		}
+		ERROR_ASSERT(int_int_flat_map_insert_batch(&b, items, n));
+		assert(a.len == b.len);
+		assert(memcmp(a.keys, b.keys, sizeof(int) * a.len) == 0);
+		assert(memcmp(a.vals, b.vals, sizeof(int) * a.len) == 0);
+	}
+	check_sorted(&b);
+	int_int_flat_map_term(&a);
+	int_int_flat_map_term(&b);
+
+	// Printing in key order, and terminating values
+	StrStrFlatMap s = str_str_flat_map();
+	StrStrFlatMapItem s_items[] = {
+		{ "pear", strdup("green") },
+		{ "apple", strdup("red") },
+		{ "banana", strdup("yellow") },
+	};
+	ERROR_ASSERT(str_str_flat_map_insert_batch(&s, s_items, 3));
+	assert(str_str_flat_map_del(&s, "banana"));
+	str_str_flat_map_fmt_register("%s", "%s");
+	fmts(buf, sizeof(buf), "%{StrStrFlatMap}", &s);
+	assert(strcmp(buf, "{apple: red, pear: green}") == 0);
+	str_str_flat_map_term(&s);
+
+	fmt_term();
+}
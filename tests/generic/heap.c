@@ -0,0 +1,115 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <stdlib.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec
+#define GENERIC_PREFIX int_vec
+#include <ds/generic/vec.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntHeap
+#define GENERIC_PREFIX int_heap
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#include <ds/generic/heap.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntHeap2
+#define GENERIC_PREFIX int_heap2
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_HEAP_ARITY 2
+#include <ds/generic/heap.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntMaxHeap3
+#define GENERIC_PREFIX int_max_heap3
+#define GENERIC_VEC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_b) > (_a)) - ((_b) < (_a)))
+#define GENERIC_HEAP_ARITY 3
+#include <ds/generic/heap.h>
+
+static int cmp_int(const void *a, const void *b) {
+	return (*(int *)a > *(int *)b) - (*(int *)a < *(int *)b);
+}
+
+#define N 20000
+
+int main() {
+	int *items = malloc(sizeof(int) * N);
+	int *sorted = malloc(sizeof(int) * N);
+	assert(items != NULL && sorted != NULL);
+	srand(1);
+	for (size_t i = 0; i < N; i++)
+		items[i] = sorted[i] = rand() % 5000;
+	qsort(sorted, N, sizeof(int), cmp_int);
+
+	// Push and pop
+	IntHeap h = int_heap();
+	IntHeap2 h2 = int_heap2();
+	IntMaxHeap3 h3 = int_max_heap3();
+	for (size_t i = 0; i < N; i++) {
+		ERROR_ASSERT(int_heap_push(&h, items[i]));
+		ERROR_ASSERT(int_heap2_push(&h2, items[i]));
+		ERROR_ASSERT(int_max_heap3_push(&h3, items[i]));
+	}
+	assert(int_heap_len(h) == N);
+	assert(*int_heap_peek(h) == sorted[0]);
+	assert(*int_max_heap3_peek(h3) == sorted[N - 1]);
+	for (size_t i = 0; i < N; i++) {
+		assert(int_heap_pop(h) == sorted[i]);
+		assert(int_heap2_pop(h2) == sorted[i]);
+		assert(int_max_heap3_pop(h3) == sorted[N - 1 - i]);
+	}
+	assert(int_heap_len(h) == 0);
+
+	// Interleaved push/pop/replace
+	for (int i = 0; i < 100; i++)
+		ERROR_ASSERT(int_heap_push(&h, 100 - i));
+	assert(int_heap_replace_top(h, 1000) == 1);
+	assert(int_heap_pop(h) == 2);
+	ERROR_ASSERT(int_heap_push(&h, -5));
+	assert(int_heap_pop(h) == -5);
+	assert(int_heap_pop(h) == 3);
+	int_heap_term(h);
+	int_heap2_term(h2);
+	int_max_heap3_term(h3);
+
+	// Heapify an existing vector
+	IntVec v = int_vec();
+	ERROR_ASSERT(int_vec_extend(&v, items, N));
+	int_heap_heapify(v);
+	for (size_t i = 0; i < N; i++)
+		assert(int_heap_pop(v) == sorted[i]);
+	int_vec_term(v);
+	for (size_t n = 0; n < 10; n++) {
+		IntHeap small = int_heap();
+		ERROR_ASSERT(int_vec_extend(&small, items, n));
+		int_heap_heapify(small);
+		int expected[10];
+		for (size_t i = 0; i < n; i++)
+			expected[i] = items[i];
+		qsort(expected, n, sizeof(int), cmp_int);
+		for (size_t i = 0; i < n; i++)
+			assert(int_heap_pop(small) == expected[i]);
+		int_heap_term(small);
+	}
+
+	// Top k
+	IntHeap top = int_heap();
+	ERROR_ASSERT(int_heap_top_k(&top, items, N, 100));
+	assert(int_heap_len(top) == 100);
+	for (size_t i = 0; i < 100; i++)
+		assert(int_heap_pop(top) == sorted[N - 100 + i]);
+	ERROR_ASSERT(int_heap_top_k(&top, items, 5, 100));
+	assert(int_heap_len(top) == 5);
+	int_heap_term(top);
+
+	free(items);
+	free(sorted);
+}
@@ -57,6 +57,21 @@ int main() {
 		assert(i->key != 0);
 		assert(i->val != 0);
 	}
+	// Iterating over 3 ranges visits every item exactly once, in the same order
+	{
+		IntIntMapItem *all = NULL, *part = NULL;
+		size_t n = 0;
+		for (size_t p = 0; p < 3; p++) {
+			part = NULL;
+			while (int_int_map_it_range(m, p, 3, &part)) {
+				assert(int_int_map_it_next(m, &all));
+				assert(part == all);
+				n++;
+			}
+		}
+		assert(!int_int_map_it_next(m, &all));
+		assert(n == m.len);
+	}
 	// Print using fmt
 	int_int_map_fmt_register("%d", "%d");
 	char buf[2048];
@@ -0,0 +1,111 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GENERIC_TYPE uint64_t
+#define GENERIC_NAME U64Mpmc
+#define GENERIC_PREFIX u64_mpmc
+#include <ds/generic/mpmc.h>
+
+#define N_PRODUCERS 4
+#define N_CONSUMERS 4
+#define N_PER_PRODUCER 200000
+
+/* Items are (producer << 32) | sequence number. */
+static U64Mpmc q;
+static _Atomic size_t n_consumed;
+static _Atomic uint64_t counts[N_PRODUCERS];
+
+static void *producer(void *arg) {
+	uint64_t id = (uintptr_t)arg;
+	uint64_t batch[8];
+	uint64_t next = 0;
+	while (next < N_PER_PRODUCER) {
+		size_t pushed;
+		if (next % 2 == 0) {
+			pushed = u64_mpmc_try_push(&q, id << 32 | next);
+		} else {
+			size_t n = 0;
+			for (; n < 8 && next + n < N_PER_PRODUCER; n++)
+				batch[n] = id << 32 | (next + n);
+			pushed = u64_mpmc_try_push_n(&q, batch, n);
+		}
+		if (pushed == 0)
+			sched_yield();
+		next += pushed;
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg) {
+	uint64_t last[N_PRODUCERS];
+	memset(last, 0xff, sizeof(last));
+	uint64_t buf[8];
+	size_t round = (uintptr_t)arg;
+	while (atomic_load(&n_consumed) < (size_t)N_PRODUCERS * N_PER_PRODUCER) {
+		size_t n;
+		if (round++ % 2 == 0)
+			n = u64_mpmc_try_pop(&q, &buf[0]);
+		else
+			n = u64_mpmc_try_pop_n(&q, buf, 8);
+		if (n == 0) {
+			sched_yield();
+			continue;
+		}
+		for (size_t i = 0; i < n; i++) {
+			uint64_t id = buf[i] >> 32, seq = buf[i] & 0xffffffff;
+			assert(id < N_PRODUCERS);
+			/* Each consumer sees every producer's items in order. */
+			assert(last[id] == UINT64_MAX || seq > last[id]);
+			last[id] = seq;
+			atomic_fetch_add(&counts[id], 1);
+		}
+		atomic_fetch_add(&n_consumed, n);
+	}
+	return NULL;
+}
+
+int main() {
+	// Single threaded
+	ERROR_ASSERT(u64_mpmc(&q, 3));
+	assert(u64_mpmc_cap(&q) == 4);
+	uint64_t x, buf[8];
+	assert(!u64_mpmc_try_pop(&q, &x));
+	assert(u64_mpmc_try_push(&q, 1));
+	uint64_t items[5] = { 2, 3, 4, 5, 6 };
+	assert(u64_mpmc_try_push_n(&q, items, 5) == 3); /* only room for 3 */
+	assert(!u64_mpmc_try_push(&q, 7));
+	assert(u64_mpmc_try_push_n(&q, items, 0) == 0);
+	assert(u64_mpmc_try_pop_n(&q, buf, 1) == 1 && buf[0] == 1);
+	assert(u64_mpmc_try_push(&q, 7));
+	assert(u64_mpmc_try_pop_n(&q, buf, 8) == 4);
+	assert(buf[0] == 2 && buf[1] == 3 && buf[2] == 4 && buf[3] == 7);
+	assert(u64_mpmc_try_pop_n(&q, buf, 8) == 0);
+	u64_mpmc_term(&q);
+
+	// Stress
+	ERROR_ASSERT(u64_mpmc(&q, 64));
+	pthread_t producers[N_PRODUCERS], consumers[N_CONSUMERS];
+	for (uintptr_t i = 0; i < N_PRODUCERS; i++)
+		assert(pthread_create(&producers[i], NULL, producer, (void *)i) == 0);
+	for (uintptr_t i = 0; i < N_CONSUMERS; i++)
+		assert(pthread_create(&consumers[i], NULL, consumer, (void *)i) == 0);
+	for (size_t i = 0; i < N_PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	for (size_t i = 0; i < N_CONSUMERS; i++)
+		pthread_join(consumers[i], NULL);
+	assert(atomic_load(&n_consumed) == (size_t)N_PRODUCERS * N_PER_PRODUCER);
+	for (size_t i = 0; i < N_PRODUCERS; i++)
+		assert(atomic_load(&counts[i]) == N_PER_PRODUCER);
+	assert(!u64_mpmc_try_pop(&q, &x));
+	u64_mpmc_term(&q);
+}
@@ -0,0 +1,94 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntSegVec
+#define GENERIC_PREFIX int_segvec
+#include <ds/generic/segvec.h>
+
+#define GENERIC_TYPE IntSegVec
+#define GENERIC_NAME IntSegVec2D
+#define GENERIC_PREFIX int_segvec_2d
+#define GENERIC_TERM_ITEM(_itm) int_segvec_term(&_itm)
+#include <ds/generic/segvec.h>
+
+int main() {
+	fmt_init();
+	int_segvec_fmt_register("%d");
+
+	// Index to block mapping
+	assert(_segvec_block_of(0) == 0);
+	assert(_segvec_block_of(SEGVEC_FIRST_BLOCK - 1) == 0);
+	assert(_segvec_block_of(SEGVEC_FIRST_BLOCK) == 1);
+	assert(_segvec_block_of(3 * SEGVEC_FIRST_BLOCK - 1) == 1);
+	assert(_segvec_block_of(3 * SEGVEC_FIRST_BLOCK) == 2);
+	for (size_t b = 0; b < 20; b++) {
+		assert(_segvec_block_of(_segvec_block_start(b)) == b);
+		assert(_segvec_block_of(_segvec_block_start(b + 1) - 1) == b);
+	}
+
+	IntSegVec v = int_segvec();
+	assert(int_segvec_len(&v) == 0);
+	assert(int_segvec_cap(&v) == 0);
+	for (int i = 0; i < 5; i++)
+		ERROR_ASSERT(int_segvec_push(&v, i));
+	char buf[4096];
+	fmts(buf, 4096, "%{IntSegVec}", &v);
+	assert(strcmp(buf, "{0, 1, 2, 3, 4}") == 0);
+
+	// Addresses stay the same while growing
+	int *first = int_segvec_at(&v, 0);
+	int *fifth = int_segvec_at(&v, 4);
+	for (int i = 5; i < 100000; i++) {
+		ERROR_ASSERT(int_segvec_push(&v, i));
+		assert(*int_segvec_back(&v) == i);
+	}
+	assert(int_segvec_at(&v, 0) == first && *first == 0);
+	assert(int_segvec_at(&v, 4) == fifth && *fifth == 4);
+	assert(int_segvec_len(&v) == 100000);
+	assert(int_segvec_cap(&v) >= 100000 && int_segvec_cap(&v) < 200000 + SEGVEC_FIRST_BLOCK);
+	for (size_t i = 0; i < 100000; i++)
+		assert(*int_segvec_at(&v, i) == (int)i);
+
+	// Scan block by block
+	size_t n, total = 0;
+	long long sum = 0;
+	int *block;
+	for (size_t b = 0; (block = int_segvec_block(&v, b, &n)) != NULL; b++) {
+		for (size_t i = 0; i < n; i++)
+			sum += block[i];
+		total += n;
+	}
+	assert(total == 100000);
+	assert(sum == 99999LL * 100000 / 2);
+
+	// Pop and shrink
+	for (int i = 99999; i >= 10; i--)
+		assert(int_segvec_pop(&v) == i);
+	int_segvec_shrink_to_fit(&v);
+	assert(int_segvec_cap(&v) == SEGVEC_FIRST_BLOCK);
+	assert(int_segvec_at(&v, 0) == first);
+	ERROR_ASSERT(int_segvec_reserve(&v, 1000));
+	assert(int_segvec_cap(&v) >= 1010);
+	assert(int_segvec_at(&v, 4) == fifth);
+	int_segvec_term(&v);
+
+	// Nested
+	IntSegVec2D v2d = int_segvec_2d();
+	for (int i = 0; i < 40; i++) {
+		ERROR_ASSERT(int_segvec_2d_push(&v2d, int_segvec()));
+		ERROR_ASSERT(int_segvec_push(int_segvec_2d_back(&v2d), i));
+	}
+	assert(*int_segvec_at(int_segvec_2d_at(&v2d, 33), 0) == 33);
+	int_segvec_2d_term(&v2d);
+
+	fmt_term();
+}
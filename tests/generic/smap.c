@@ -77,13 +77,37 @@ int main() {
 		assert(i->key != 0);
 		assert(i->val != 0);
 	}
+	// Iterating over 5 ranges visits every item exactly once, in the same order
+	{
+		IntMapItem *all = NULL, *part = NULL;
+		size_t n = 0;
+		for (size_t p = 0; p < 5; p++) {
+			part = NULL;
+			while (int_map_it_range(m, p, 5, &part)) {
+				assert(int_map_it_next(m, &all));
+				assert(part == all);
+				n++;
+			}
+		}
+		assert(!int_map_it_next(m, &all));
+		assert(n == m.len);
+	}
 	// Print using fmt
 	int_map_fmt_register("%d");
 	char buf[2048];
 	fmts(buf, 2048, "%{IntMap}", m);
-	assert(strcmp(buf, "{\"number: 64\": 64, \"number: 29\": 29, \"number: 46\": 46, \"number: 63\": 63, \"number: 20\": 20, \"number: 55\": 55, \"number: 74\": 74, \"number: 27\": 27, \"number: 52\": 52, \"number: 14\": 14, \"number: 30\": 30, \"number: 65\": 65, \"number: 47\": 47, \"number: 21\": 21, \"number: 54\": 54, \"number: 73\": 73, \"number: 17\": 17, \"number: 37\": 37, \"number: 66\": 66, \"number: 44\": 44, \"number: 22\": 22, \"number: 57\": 57, \"number: 11\": 11, \"number: 72\": 72, \"number: 16\": 16, \"number: 36\": 36, \"number: 42\": 42, \"number: 67\": 67, \"number: 59\": 59, \"number: 45\": 45, \"number: 23\": 23, \"number: 56\": 56, \"number: 10\": 10, \"number: 71\": 71, \"number: 48\": 48, \"number: 19\": 19, \"number: 35\": 35, \"number: 43\": 43, \"number: 60\": 60, \"number: 58\": 58, \"number: 77\": 77, \"number: 24\": 24, \"number: 51\": 51, \"number: 13\": 13, \"number: 70\": 70, \"number: 33\": 33, \"number: 49\": 49, \"number: 79\": 79, \"number: 18\": 18, \"number: 34\": 34, \"number: 40\": 40, \"number: 61\": 61, \"number: 76\": 76, \"number: 68\": 68, \"number: 39\": 39, \"number: 25\": 25, \"number: 50\": 50, \"number: 12\": 12, \"number: 32\": 32, \"number: 78\": 78, \"number: 28\": 28, \"number: 41\": 41, \"number: 62\": 62, \"number: 75\": 75, \"number: 69\": 69, \"number: 38\": 38, \"number: 26\": 26, \"number: 53\": 53, \"number: 15\": 15, \"number: 31\": 31}") == 0);
+	assert(strcmp(buf, "{\"number: 71\": 71, \"number: 35\": 35, \"number: 43\": 43, \"number: 68\": 68, \"number: 60\": 60, \"number: 57\": 57, \"number: 19\": 19, \"number: 21\": 21, \"number: 10\": 10, \"number: 47\": 47, \"number: 24\": 24, \"number: 52\": 52, \"number: 64\": 64, \"number: 12\": 12, \"number: 18\": 18, \"number: 16\": 16, \"number: 53\": 53, \"number: 32\": 32, \"number: 66\": 66, \"number: 20\": 20, \"number: 48\": 48, \"number: 14\": 14, \"number: 76\": 76, \"number: 40\": 40, \"number: 58\": 58, \"number: 70\": 70, \"number: 50\": 50, \"number: 15\": 15, \"number: 29\": 29, \"number: 31\": 31, \"number: 34\": 34, \"number: 73\": 73, \"number: 49\": 49, \"number: 69\": 69, \"number: 22\": 22, \"number: 23\": 23, \"number: 41\": 41, \"number: 54\": 54, \"number: 44\": 44, \"number: 38\": 38, \"number: 45\": 45, \"number: 77\": 77, \"number: 39\": 39, \"number: 46\": 46, \"number: 42\": 42, \"number: 25\": 25, \"number: 30\": 30, \"number: 11\": 11, \"number: 37\": 37, \"number: 74\": 74, \"number: 62\": 62, \"number: 26\": 26, \"number: 78\": 78, \"number: 33\": 33, \"number: 36\": 36, \"number: 55\": 55, \"number: 27\": 27, \"number: 17\": 17, \"number: 51\": 51, \"number: 13\": 13, \"number: 59\": 59, \"number: 56\": 56, \"number: 61\": 61, \"number: 63\": 63, \"number: 72\": 72, \"number: 75\": 75, \"number: 79\": 79, \"number: 28\": 28, \"number: 67\": 67, \"number: 65\": 65}") == 0);
 	int_map_term(m);
 
+	// The software hash fallback must agree with the hardware one, otherwise
+	// iteration order would depend on the machine
+	char key[512];
+	for (size_t i = 0; i < sizeof(key); i++)
+		key[i] = (char)(i * 31 + 7);
+	for (size_t n = 0; n <= sizeof(key); n++)
+		assert(_crc32c_sw(0, key, n) == _crc32c(0, key, n));
+	assert(_crc32c_sw(0, "123456789", 9) == 0xe3069283);
+
 	SizeTMap sm = size_t_map();
 	size_t_map_term(sm);
 
@@ -0,0 +1,99 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+static size_t n_terms = 0;
+
+#define GENERIC_NAME Particles
+#define GENERIC_PREFIX particles
+#define GENERIC_FIELDS(X) \
+	X(char, tag) \
+	X(int, id) \
+	X(float, x) \
+	X(double, mass)
+#define GENERIC_TERM_ITEM(_row) n_terms++
+#include <ds/generic/soa.h>
+
+static _Atomic bool stop_printing;
+
+/* Prints until told to stop, while the main thread re-registers. */
+static void *printer_run(void *arg) {
+	Particles *p = arg;
+	char buf[64];
+	while (!atomic_load(&stop_printing)) {
+		fmts(buf, 64, "%{Particles}", p);
+		assert(strcmp(buf, "{(o 9999), (z 7)}") == 0 || strcmp(buf, "{[111], [122]}") == 0);
+	}
+	return NULL;
+}
+
+int main() {
+	fmt_init();
+	particles_fmt_register("(%c %d)"); /* extra fields are ignored */
+
+	Particles p = particles();
+	assert(particles_len(&p) == 0);
+	assert(particles_cap(&p) == 0);
+	ERROR_ASSERT(particles_push(&p, (ParticlesRow){ .x = 1.5f, .mass = 2.0, .tag = 'a', .id = 1 }));
+	ERROR_ASSERT(particles_push(&p, (ParticlesRow){ .x = -1.f, .mass = 4.0, .tag = 'b', .id = 2 }));
+	ParticlesRow r = particles_get(&p, 1);
+	assert(r.x == -1.f && r.mass == 4.0 && r.tag == 'b' && r.id == 2);
+	assert(p.id[0] == 1 && particles_mass(&p)[1] == 4.0);
+
+	// Many rows; every column stays aligned
+	for (int i = 2; i < 10000; i++)
+		ERROR_ASSERT(particles_push(&p, (ParticlesRow){ .x = i, .mass = i * 0.5, .tag = 'a' + i % 26, .id = i + 1 }));
+	assert(particles_len(&p) == 10000);
+	assert((uintptr_t)p.x % SOA_ALIGN == 0);
+	assert((uintptr_t)p.mass % SOA_ALIGN == 0);
+	assert((uintptr_t)p.tag % SOA_ALIGN == 0);
+	assert((uintptr_t)p.id % SOA_ALIGN == 0);
+	int *ids = particles_id(&p);
+	long long sum = 0;
+	for (size_t i = 0; i < particles_len(&p); i++)
+		sum += ids[i];
+	assert(sum == 10000LL * 10001 / 2);
+	for (size_t i = 2; i < 10000; i++) {
+		r = particles_get(&p, i);
+		assert(r.x == i && r.mass == i * 0.5 && r.tag == 'a' + i % 26 && r.id == (int)i + 1);
+	}
+
+	// Removal
+	r = particles_pop(&p);
+	assert(r.id == 10000 && n_terms == 1);
+	r = particles_swap_del(&p, 0);
+	assert(r.id == 1 && n_terms == 2);
+	assert(p.id[0] == 9999 && p.tag[0] == particles_get(&p, 0).tag);
+	ERROR_ASSERT(particles_fit(&p, 0));
+	assert(particles_cap(&p) == particles_len(&p));
+	while (particles_len(&p) > 2)
+		particles_pop(&p);
+	particles_set(&p, 1, (ParticlesRow){ .x = 0.25f, .mass = 1.0, .tag = 'z', .id = 7 });
+
+	char buf[4096];
+	fmts(buf, 4096, "%{Particles}", &p);
+	assert(strcmp(buf, "{(o 9999), (z 7)}") == 0);
+
+	// Re-registering while another thread prints
+	pthread_t printer;
+	assert(pthread_create(&printer, NULL, printer_run, &p) == 0);
+	for (int i = 0; i < 200; i++)
+		particles_fmt_register(i % 2 == 0 ? "[%d]" : "(%c %d)");
+	atomic_store(&stop_printing, true);
+	pthread_join(printer, NULL);
+
+	n_terms = 0;
+	particles_term(&p);
+	assert(n_terms == 2);
+
+	fmt_term();
+}
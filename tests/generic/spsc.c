@@ -0,0 +1,80 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#define GENERIC_TYPE uint64_t
+#define GENERIC_NAME U64Spsc
+#define GENERIC_PREFIX u64_spsc
+#include <ds/generic/spsc.h>
+
+#define N_ITEMS 2000000
+
+static U64Spsc q;
+
+static void *producer(void *arg) {
+	(void)arg;
+	uint64_t batch[17];
+	uint64_t next = 0;
+	while (next < N_ITEMS) {
+		/* Alternate between single and batch pushes. */
+		if (next % 3 == 0) {
+			if (u64_spsc_try_push(&q, next))
+				next++;
+			else
+				sched_yield();
+		} else {
+			size_t n = 0;
+			for (; n < 17 && next + n < N_ITEMS; n++)
+				batch[n] = next + n;
+			size_t pushed = u64_spsc_try_push_n(&q, batch, n);
+			if (pushed == 0)
+				sched_yield();
+			next += pushed;
+		}
+	}
+	return NULL;
+}
+
+int main() {
+	// Single threaded
+	ERROR_ASSERT(u64_spsc(&q, 5));
+	assert(u64_spsc_cap(&q) == 8);
+	uint64_t x, buf[16];
+	assert(!u64_spsc_try_pop(&q, &x));
+	for (uint64_t i = 0; i < 8; i++)
+		assert(u64_spsc_try_push(&q, i));
+	assert(!u64_spsc_try_push(&q, 8));
+	assert(u64_spsc_try_pop(&q, &x) && x == 0);
+	assert(u64_spsc_try_pop_n(&q, buf, 3) == 3);
+	assert(buf[0] == 1 && buf[2] == 3);
+	/* Wraps around the end of the buffer */
+	uint64_t items[6] = { 8, 9, 10, 11, 12, 13 };
+	assert(u64_spsc_try_push_n(&q, items, 6) == 4);
+	assert(u64_spsc_try_pop_n(&q, buf, 16) == 8);
+	for (uint64_t i = 0; i < 8; i++)
+		assert(buf[i] == i + 4);
+	assert(u64_spsc_try_pop_n(&q, buf, 16) == 0);
+	u64_spsc_term(&q);
+
+	// Stress
+	ERROR_ASSERT(u64_spsc(&q, 64));
+	pthread_t thread;
+	assert(pthread_create(&thread, NULL, producer, NULL) == 0);
+	uint64_t expected = 0;
+	while (expected < N_ITEMS) {
+		size_t n = u64_spsc_try_pop_n(&q, buf, expected % 2 ? 16 : 1);
+		if (n == 0)
+			sched_yield();
+		for (size_t i = 0; i < n; i++)
+			assert(buf[i] == expected++);
+	}
+	pthread_join(thread, NULL);
+	assert(!u64_spsc_try_pop(&q, &x));
+	u64_spsc_term(&q);
+}
@@ -0,0 +1,103 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#define GENERIC_IMPL_STATIC
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ds/fmt.h>
+
+static size_t n_mallocs = 0;
+static bool malloc_fail = false;
+static void *custom_malloc(size_t size) {
+	n_mallocs++;
+	return malloc_fail ? NULL : malloc(size);
+}
+#define malloc(size) custom_malloc(size)
+
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntSVec
+#define GENERIC_PREFIX int_svec
+#define GENERIC_INLINE_CAP 4
+#include <ds/generic/svec.h>
+
+#define GENERIC_TYPE IntSVec
+#define GENERIC_NAME IntSVec2D
+#define GENERIC_PREFIX int_svec_2d
+#define GENERIC_INLINE_CAP 4
+#define GENERIC_TERM_ITEM(_itm) int_svec_term(&_itm)
+#include <ds/generic/svec.h>
+
+int main() {
+	fmt_init();
+	int_svec_fmt_register("%d");
+
+	IntSVec v = int_svec();
+	assert(int_svec_len(&v) == 0);
+	assert(int_svec_cap(&v) == 4);
+
+	// Push (inline)
+	for (size_t i = 0; i < 4; i++)
+		ERROR_ASSERT(int_svec_push(&v, i + 1));
+	assert(n_mallocs == 0);
+	assert(int_svec_data(&v) == v.data.inl);
+	// Insert/delete (inline)
+	ERROR_ASSERT(int_svec_fit(&v, 4));
+	assert(int_svec_del(&v, 0) == 1);
+	ERROR_ASSERT(int_svec_insert(&v, 1, 99));
+	assert(n_mallocs == 0);
+	char buf[4096];
+	fmts(buf, 4096, "%{IntSVec}", &v);
+	assert(strcmp(buf, "{2, 99, 3, 4}") == 0);
+	// Push (spill onto heap)
+	for (size_t i = 0; i < 252; i++)
+		ERROR_ASSERT(int_svec_push(&v, i + 5));
+	assert(n_mallocs == 1);
+	assert(int_svec_len(&v) == 256);
+	assert(int_svec_cap(&v) == 256);
+	assert(int_svec_data(&v) == v.data.heap);
+	int *data = int_svec_data(&v);
+	assert(data[0] == 2);
+	assert(data[1] == 99);
+	for (size_t i = 2; i < 256; i++)
+		assert(data[i] == i + 1);
+	// Pop, back
+	assert(int_svec_pop(&v) == 256);
+	assert(*int_svec_back(&v) == 255);
+	// Shrink back into the struct
+	while (int_svec_len(&v) > 3)
+		int_svec_pop(&v);
+	ERROR_ASSERT(int_svec_fit(&v, 0));
+	assert(int_svec_cap(&v) == 4);
+	assert(int_svec_data(&v) == v.data.inl);
+	fmts(buf, 4096, "%{IntSVec}", &v);
+	assert(strcmp(buf, "{2, 99, 3}") == 0);
+	int_svec_term(&v);
+
+	// Nested
+	IntSVec2D v2d = int_svec_2d();
+	for (size_t i = 0; i < 3; i++) {
+		ERROR_ASSERT(int_svec_2d_push(&v2d, int_svec()));
+		for (size_t j = 0; j < 8; j++)
+			ERROR_ASSERT(int_svec_push(&int_svec_2d_data(&v2d)[i], j));
+	}
+	assert(int_svec_2d_data(&v2d)[2].len == 8);
+	int_svec_2d_del(&v2d, 1);
+	int_svec_2d_term(&v2d);
+
+	// Error recovery
+	malloc_fail = true;
+	IntSVec fv = int_svec();
+	for (size_t i = 0; i < 4; i++)
+		ERROR_ASSERT(int_svec_push(&fv, i));
+	Error err = int_svec_push(&fv, 4);
+	assert(err.kind == ErrorOutOfMemory);
+	assert(int_svec_len(&fv) == 4);
+	assert(int_svec_cap(&fv) == 4);
+	int_svec_term(&fv);
+
+	fmt_term();
+}
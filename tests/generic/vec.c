@@ -1,12 +1,71 @@
 // Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
 // SPDX license identifier: MIT
 
+#define _GNU_SOURCE /* mremap() */
 #define GENERIC_IMPL
 
 #include "vec.h"
 
 #include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+static bool is_even(const int *itm, void *ctx) {
+	(void)ctx;
+	return *itm % 2 == 0;
+}
+
+static void double_it(int *itm, void *ctx) {
+	(void)ctx;
+	*itm *= 2;
+}
+
+static void sum_map(void *acc, const int *itm, void *ctx) {
+	(void)ctx;
+	*(long long *)acc += *itm;
+}
+
+static void sum_reduce(void *acc, const void *other, void *ctx) {
+	(void)ctx;
+	*(long long *)acc += *(const long long *)other;
+}
+
+/* Tracks a run of consecutive items, to check that chunks are combined in
+ * order. */
+typedef struct Run {
+	long long first, last;
+	bool ok;
+} Run;
+
+static void run_map(void *acc, const int *itm, void *ctx) {
+	(void)ctx;
+	Run *r = acc;
+	if (r->first == -1)
+		r->first = *itm;
+	else if (*itm != r->last + 1)
+		r->ok = false;
+	r->last = *itm;
+}
+
+static void run_reduce(void *acc, const void *other, void *ctx) {
+	(void)ctx;
+	Run *r = acc;
+	const Run *o = other;
+	if (o->first == -1)
+		return;
+	if (r->first == -1)
+		r->first = o->first;
+	else if (o->first != r->last + 1)
+		r->ok = false;
+	r->last = o->last;
+	r->ok = r->ok && o->ok;
+}
+
+static int cmp_int(const void *a, const void *b) {
+	return (*(int *)a > *(int *)b) - (*(int *)a < *(int *)b);
+}
 
 int main() {
 	fmt_init();
@@ -56,6 +115,219 @@ int main() {
 
 	int_vec_term(v);
 
+	// Bulk operations
+	int items[1000];
+	for (size_t i = 0; i < 1000; i++)
+		items[i] = i;
+	v = int_vec();
+	ERROR_ASSERT(int_vec_reserve(&v, 10));
+	assert(vec_cap(v) == 10);
+	ERROR_ASSERT(int_vec_extend(&v, items, 1000));
+	assert(vec_len(v) == 1000);
+	for (size_t i = 0; i < 1000; i++)
+		assert(v[i] == i);
+	int_vec_del_range(v, 10, 990);
+	assert(vec_len(v) == 20);
+	for (size_t i = 0; i < 10; i++) {
+		assert(v[i] == i);
+		assert(v[i + 10] == i + 990);
+	}
+	ERROR_ASSERT(int_vec_insert_n(&v, 10, items + 500, 3));
+	fmts(buf, 4096, "%{IntVec}", v);
+	assert(strcmp(buf, "{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 500, 501, 502, 990, 991, 992, 993, 994, 995, 996, 997, 998, 999}") == 0);
+	assert(int_vec_swap_del(v, 1) == 1);
+	assert(v[1] == 999);
+	assert(vec_len(v) == 22);
+	ERROR_ASSERT(int_vec_resize(&v, 4, 0));
+	ERROR_ASSERT(int_vec_resize(&v, 6, -1));
+	fmts(buf, 4096, "%{IntVec}", v);
+	assert(strcmp(buf, "{0, 999, 2, 3, -1, -1}") == 0);
+	int_vec_term(v);
+
+	// Sorting
+	ThreadPool sort_pools[2];
+	ERROR_ASSERT(thread_pool_init(&sort_pools[0], 4));
+	ERROR_ASSERT(thread_pool_init(&sort_pools[1], 3));
+	for (size_t n = 0; n < 100000; n = n * 3 + 1) {
+		int *ref = malloc(sizeof(int) * (n + 1));
+		IntVec sv = int_vec();
+		for (size_t i = 0; i < n; i++) {
+			int x = i % 7 == 0 ? 42 : rand() - RAND_MAX / 2; /* plenty of duplicates */
+			ERROR_ASSERT(int_vec_push(&sv, x));
+			ref[i] = x;
+		}
+		qsort(ref, n, sizeof(int), cmp_int);
+		IntVec sv2 = int_vec(), sv3 = int_vec();
+		ERROR_ASSERT(int_vec_extend(&sv2, sv, n));
+		ERROR_ASSERT(int_vec_extend(&sv3, sv, n));
+		int_vec_sort(sv);
+		ERROR_ASSERT(int_vec_radix_sort(sv2));
+		ERROR_ASSERT(int_vec_sort_parallel(sv3, &sort_pools[n % 2]));
+		for (size_t i = 0; i < n; i++) {
+			assert(sv[i] == ref[i]);
+			assert(sv2[i] == ref[i]);
+			assert(sv3[i] == ref[i]);
+		}
+		if (n > 0) {
+			assert(*int_vec_binary_search(sv, ref[n / 2]) == ref[n / 2]);
+			assert(int_vec_lower_bound(sv, ref[0]) == 0);
+			assert(int_vec_lower_bound(sv, ref[n - 1] + 1) == n);
+		}
+		free(ref);
+		int_vec_term(sv);
+		int_vec_term(sv2);
+		int_vec_term(sv3);
+	}
+	thread_pool_term(&sort_pools[0]);
+	thread_pool_term(&sort_pools[1]);
+	DoubleVec dv = double_vec();
+	double doubles[] = { 3.5, -0.0, -2.25, 1e300, -1e-300, 0.5, -7.0 };
+	ERROR_ASSERT(double_vec_extend(&dv, doubles, 7));
+	ERROR_ASSERT(double_vec_radix_sort(dv));
+	for (size_t i = 1; i < 7; i++)
+		assert(dv[i - 1] <= dv[i]);
+	assert(double_vec_binary_search(dv, 2.0) == NULL);
+	double_vec_term(dv);
+
+	// Growth policies
+	IntVec15 v15 = int_vec_15();
+	size_t caps[] = { 8, 12, 18, 27, 40, 60, 90 };
+	for (size_t i = 0, c = 0; i < 90; i++) {
+		ERROR_ASSERT(int_vec_15_push(&v15, i));
+		if (vec_cap(v15) != caps[c])
+			assert(vec_cap(v15) == caps[++c]);
+	}
+	int_vec_15_term(v15);
+
+	// mmap()-backed growth across the threshold and back
+	BigVec bv = big_vec();
+	for (long long i = 0; i < 100000; i++)
+		ERROR_ASSERT(big_vec_push(&bv, i * 3));
+	assert(vec_cap(bv) == 1024 + 4096 * 25);
+	for (long long i = 0; i < 100000; i++)
+		assert(bv[i] == i * 3);
+	big_vec_del_range(bv, 100, 100000);
+	ERROR_ASSERT(big_vec_shrink_to_fit(&bv));
+	assert(vec_cap(bv) == 100);
+	for (long long i = 0; i < 100; i++)
+		assert(bv[i] == i * 3);
+	big_vec_del_range(bv, 0, 100);
+	ERROR_ASSERT(big_vec_shrink_to_fit(&bv));
+	assert(bv == NULL);
+	big_vec_term(bv);
+
+	// SIMD wrappers and filtering
+	{
+		IntVec a = int_vec();
+		for (int i = 0; i < 1000; i++)
+			int_vec_push(&a, (i * 37) % 101 - 50);
+		assert(int_vec_find(a, 1000) == 1000);
+		assert(a[int_vec_find(a, 7)] == 7);
+		assert(int_vec_count_eq(a, 7) == 10);
+		assert(int_vec_min(a) == -50);
+		assert(int_vec_max(a) == 50);
+		long long sum = 0;
+		for (size_t i = 0; i < 1000; i++)
+			sum += a[i];
+		assert(int_vec_sum(a) == sum);
+		IntVec even = int_vec();
+		ERROR_ASSERT(int_vec_filter_into(&even, a, is_even, NULL));
+		size_t j = 0;
+		for (size_t i = 0; i < vec_len(a); i++) {
+			if (a[i] % 2 == 0)
+				assert(even[j++] == a[i]);
+		}
+		assert(vec_len(even) == j);
+		int_vec_term(even);
+		int_vec_term(a);
+
+		DoubleVec d = double_vec();
+		double_vec_push(&d, 1.5);
+		double_vec_push(&d, -2.25);
+		assert(double_vec_min(d) == -2.25);
+		assert(double_vec_sum(d) == -0.75);
+		double_vec_term(d);
+	}
+
+	// Parallel for each and reduce
+	{
+		ThreadPool pool;
+		ERROR_ASSERT(thread_pool_init(&pool, 4));
+		IntVec a = int_vec();
+		for (int i = 0; i < 100000; i++)
+			int_vec_push(&a, i);
+		int_vec_par_for_each(a, &pool, double_it, NULL);
+		for (int i = 0; i < 100000; i++)
+			assert(a[i] == 2 * i);
+		long long sum, zero = 0;
+		ERROR_ASSERT(int_vec_par_reduce(a, &pool, sum_map, sum_reduce, &zero, sizeof(sum), &sum, NULL));
+		assert(sum == 99999LL * 100000);
+		for (int i = 0; i < 100000; i++)
+			a[i] = i;
+		Run run, no_run = { .first = -1, .ok = true };
+		ERROR_ASSERT(int_vec_par_reduce(a, &pool, run_map, run_reduce, &no_run, sizeof(run), &run, NULL));
+		assert(run.first == 0 && run.last == 99999 && run.ok);
+		int_vec_term(a);
+		a = int_vec();
+		ERROR_ASSERT(int_vec_par_reduce(a, &pool, sum_map, sum_reduce, &zero, sizeof(sum), &sum, NULL));
+		assert(sum == 0);
+		int_vec_term(a);
+		thread_pool_term(&pool);
+	}
+
+	// File-backed vector
+	{
+		char path[] = "/tmp/ds_vec_XXXXXX";
+		int fd = mkstemp(path);
+		assert(fd >= 0);
+		close(fd);
+		IntVec fv;
+		ERROR_ASSERT(int_vec_create(&fv, path));
+		assert(vec_len(fv) == 0);
+		for (int i = 0; i < 100000; i++)
+			ERROR_ASSERT(int_vec_push(&fv, i));
+		ERROR_ASSERT(int_vec_advise(fv, VecAdviceSequential));
+		ERROR_ASSERT(int_vec_sync(fv));
+		int_vec_term(fv);
+		ERROR_ASSERT(int_vec_open(&fv, path));
+		assert(vec_len(fv) == 100000);
+		for (int i = 0; i < 100000; i++)
+			assert(fv[i] == i);
+		for (int i = 0; i < 50000; i++)
+			int_vec_pop(fv);
+		ERROR_ASSERT(int_vec_shrink_to_fit(&fv));
+		ERROR_ASSERT(int_vec_push(&fv, -1));
+		int_vec_term(fv);
+		ERROR_ASSERT(int_vec_open(&fv, path));
+		assert(vec_len(fv) == 50001 && fv[49999] == 49999 && fv[50000] == -1);
+		int_vec_term(fv);
+		// Mapped twice; each mapping keeps its own file descriptor
+		IntVec fv2;
+		ERROR_ASSERT(int_vec_create(&fv, path));
+		for (int i = 0; i < 100; i++)
+			ERROR_ASSERT(int_vec_push(&fv, i));
+		ERROR_ASSERT(int_vec_open(&fv2, path));
+		assert(vec_len(fv2) == 100 && fv2[99] == 99);
+		int_vec_term(fv2);
+		for (int i = 100; i < 100000; i++)
+			ERROR_ASSERT(int_vec_push(&fv, i));
+		int_vec_term(fv);
+		ERROR_ASSERT(int_vec_open(&fv, path));
+		ERROR_ASSERT(int_vec_open(&fv2, path));
+		assert(vec_len(fv) == 100000 && fv[99999] == 99999);
+		fv[0] = -1;
+		assert(fv2[0] == -1);
+		int_vec_term(fv);
+		int_vec_term(fv2);
+		DoubleVec dfv;
+		assert(error_is(double_vec_open(&dfv, path)));
+		fd = open(path, O_WRONLY | O_TRUNC);
+		assert(write(fd, "not a vector file", 17) == 17);
+		close(fd);
+		assert(error_is(int_vec_open(&fv, path)));
+		unlink(path);
+	}
+
 	// 2D vector
 	IntVec2D v2d = int_vec_2d();
 	int_vec_2d_push(&v2d, int_vec());
@@ -70,6 +342,10 @@ int main() {
 	fmts(buf, 4096, "%{IntVec2D}", v2d);
 	assert(strcmp(buf, "{{1, 2, 3, 4}, {69, 420}}") == 0);
 	int_vec_2d_del(v2d, 0);
+	ERROR_ASSERT(int_vec_2d_resize(&v2d, 3, NULL));
+	int_vec_push(&v2d[2], 1);
+	int_vec_2d_del_range(v2d, 1, 3);
+	assert(vec_len(v2d) == 1);
 	int_vec_2d_term(v2d);
 
 	fmt_term();
@@ -7,6 +7,17 @@
 #define GENERIC_TYPE int
 #define GENERIC_NAME IntVec
 #define GENERIC_PREFIX int_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_RADIX_KEY(_itm) vec_radix_key_i32(_itm)
+#define GENERIC_SIMD i32
+#include <ds/generic/vec.h>
+
+#define GENERIC_TYPE double
+#define GENERIC_NAME DoubleVec
+#define GENERIC_PREFIX double_vec
+#define GENERIC_CMP(_a, _b) (((_a) > (_b)) - ((_a) < (_b)))
+#define GENERIC_RADIX_KEY(_itm) vec_radix_key_f64(_itm)
+#define GENERIC_SIMD f64
 #include <ds/generic/vec.h>
 
 #define GENERIC_TYPE IntVec
@@ -15,4 +26,17 @@
 #define GENERIC_TERM_ITEM(_itm) int_vec_term(_itm)
 #include <ds/generic/vec.h>
 
+#define GENERIC_TYPE int
+#define GENERIC_NAME IntVec15
+#define GENERIC_PREFIX int_vec_15
+#define GENERIC_GROWTH(_cap) VEC_GROWTH_1_5X(_cap)
+#include <ds/generic/vec.h>
+
+#define GENERIC_TYPE long long
+#define GENERIC_NAME BigVec
+#define GENERIC_PREFIX big_vec
+#define GENERIC_GROWTH(_cap) VEC_GROWTH_STEP(_cap, 1024, 4096)
+#define GENERIC_MMAP_THRESHOLD 8192
+#include <ds/generic/vec.h>
+
 #endif
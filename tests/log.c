@@ -0,0 +1,114 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/log.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file.h"
+
+#define N_THREADS 4
+#define N_MESSAGES 20000
+
+typedef struct Writer {
+	pthread_t thread;
+	Logger *l;
+	int id;
+} Writer;
+
+static void *writer_run(void *arg) {
+	Writer *w = arg;
+	for (int i = 0; i < N_MESSAGES; i++)
+		log_fmt(w->l, "%d %d %s\n", w->id, i, "some text to fill up the ring");
+	return NULL;
+}
+
+/* Returns the contents of the file at path and truncates it. */
+static char *take_file(const char *path) {
+	size_t size;
+	char *res = read_file(path, &size);
+	assert(truncate(path, 0) == 0);
+	return res;
+}
+
+int main() {
+	fmt_init();
+
+	char path[] = "/tmp/ds_log_test_XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	Logger l;
+
+	// Several threads with small rings; nothing may be lost
+	ERROR_ASSERT(logger_init(&l, path, LogOverflowBlock, 1024));
+	Writer writers[N_THREADS];
+	for (int i = 0; i < N_THREADS; i++) {
+		writers[i] = (Writer){ .l = &l, .id = i };
+		assert(pthread_create(&writers[i].thread, NULL, writer_run, &writers[i]) == 0);
+	}
+	for (int i = 0; i < N_THREADS; i++)
+		pthread_join(writers[i].thread, NULL);
+	logger_term(&l);
+	char *out = take_file(path);
+	int next[N_THREADS] = {0};
+	size_t n_lines = 0;
+	for (char *line = strtok(out, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		int id, i;
+		char text[64];
+		assert(sscanf(line, "%d %d %63[^\n]", &id, &i, text) == 3);
+		assert(id >= 0 && id < N_THREADS);
+		assert(i == next[id]++); // in order per thread
+		assert(strcmp(text, "some text to fill up the ring") == 0);
+		n_lines++;
+	}
+	assert(n_lines == N_THREADS * N_MESSAGES);
+	free(out);
+
+	// Dropping when full: everything is either written or counted
+	ERROR_ASSERT(logger_init(&l, path, LogOverflowDrop, 256));
+	for (int i = 0; i < N_MESSAGES; i++)
+		log_fmt(&l, "%d\n", i);
+	logger_flush(&l);
+	size_t dropped = logger_dropped(&l);
+	out = take_file(path);
+	n_lines = 0;
+	int last = -1;
+	for (char *line = strtok(out, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		int i = atoi(line);
+		assert(i > last);
+		last = i;
+		n_lines++;
+	}
+	assert(n_lines + dropped == N_MESSAGES);
+	free(out);
+	// Messages which can never fit are dropped
+	char big[512];
+	memset(big, 'x', 511);
+	big[511] = 0;
+	log_fmt(&l, "%s\n", big);
+	assert(logger_dropped(&l) == dropped + 1);
+	logger_term(&l);
+	free(take_file(path));
+
+	// Arguments are copied when logging
+	ERROR_ASSERT(logger_init(&l, path, LogOverflowCount, 0));
+	char name[16] = "before";
+	int n = 1;
+	log_fmt(&l, "%s %d %{Error}\n", name, n, ERROR_STRING("error text"));
+	strcpy(name, "after");
+	n = 100;
+	logger_flush(&l);
+	out = take_file(path);
+	assert(strcmp(out, "before 1 error text\n") == 0);
+	free(out);
+	logger_term(&l);
+
+	unlink(path);
+	fmt_term();
+}
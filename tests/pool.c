@@ -0,0 +1,41 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/pool.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define N_TASKS 1000
+
+typedef struct Counts {
+	_Atomic int runs[N_TASKS];
+	_Atomic size_t total;
+} Counts;
+
+static void count_task(void *ctx, size_t task) {
+	Counts *c = ctx;
+	atomic_fetch_add(&c->runs[task], 1);
+	atomic_fetch_add(&c->total, task);
+}
+
+int main() {
+	static Counts c;
+	for (size_t nthreads = 0; nthreads <= 5; nthreads++) {
+		ThreadPool pool;
+		ERROR_ASSERT(thread_pool_init(&pool, nthreads));
+		/* 0 means one thread per CPU */
+		assert(nthreads == 0 ? thread_pool_size(&pool) >= 1 : thread_pool_size(&pool) == nthreads);
+		/* The pool is reused for many batches of varying size. */
+		for (size_t round = 0; round < 200; round++) {
+			size_t n = round % 7 == 0 ? 0 : round * 5 % N_TASKS;
+			memset(&c, 0, sizeof(c));
+			thread_pool_run(&pool, count_task, &c, n);
+			for (size_t i = 0; i < N_TASKS; i++)
+				assert(atomic_load(&c.runs[i]) == (i < n));
+			assert(atomic_load(&c.total) == (n == 0 ? 0 : n * (n - 1) / 2));
+		}
+		thread_pool_term(&pool);
+	}
+}
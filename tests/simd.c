@@ -0,0 +1,82 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/simd.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+/* Compares every kernel against a plain loop for all lengths up to a few
+ * vectors, starting at every offset within a vector (so unaligned loads and
+ * all tail lengths are covered). */
+#define TEST_TYPE(sfx, type, sum_exact) { \
+	enum { N = 300 }; \
+	type *buf = malloc(sizeof(type) * (N + 64)); \
+	assert(buf != NULL); \
+	for (size_t i = 0; i < N + 64; i++) \
+		buf[i] = (type)(rand() % 23 - (((type)-1 < 0) ? 11 : 0)); \
+	for (size_t off = 0; off < 32; off++) { \
+		type *data = buf + off; \
+		for (size_t n = 0; n <= N; n += n < 80 ? 1 : 37) { \
+			for (int k = 0; k < 3; k++) { \
+				type x = k == 0 ? data[n / 2] : k == 1 ? (type)7 : (type)100; \
+				size_t find = n, count = 0; \
+				for (size_t i = 0; i < n; i++) { \
+					if (data[i] == x) { \
+						if (find == n) \
+							find = i; \
+						count++; \
+					} \
+				} \
+				assert(simd_find_##sfx(data, n, x) == find); \
+				assert(simd_count_eq_##sfx(data, n, x) == count); \
+			} \
+			if (n == 0) \
+				continue; \
+			type min = data[0], max = data[0]; \
+			simd_sum_##sfx##_t sum = 0; \
+			for (size_t i = 0; i < n; i++) { \
+				if (data[i] < min) \
+					min = data[i]; \
+				if (data[i] > max) \
+					max = data[i]; \
+				sum += data[i]; \
+			} \
+			assert(simd_min_##sfx(data, n) == min); \
+			assert(simd_max_##sfx(data, n) == max); \
+			if (sum_exact) \
+				assert(simd_sum_##sfx(data, n) == sum); \
+		} \
+	} \
+	free(buf); \
+}
+
+int main() {
+	TEST_TYPE(i8,  int8_t,   1);
+	TEST_TYPE(u8,  uint8_t,  1);
+	TEST_TYPE(i16, int16_t,  1);
+	TEST_TYPE(u16, uint16_t, 1);
+	TEST_TYPE(i32, int32_t,  1);
+	TEST_TYPE(u32, uint32_t, 1);
+	TEST_TYPE(i64, int64_t,  1);
+	TEST_TYPE(u64, uint64_t, 1);
+	/* Small integers are exactly representable, so the float sums are too. */
+	TEST_TYPE(f32, float,    1);
+	TEST_TYPE(f64, double,   1);
+
+	/* count_eq with more matches than fit in an 8-bit lane counter. */
+	{
+		size_t n = 100000;
+		uint8_t *data = malloc(n);
+		assert(data != NULL);
+		for (size_t i = 0; i < n; i++)
+			data[i] = 0xff;
+		assert(simd_count_eq_u8(data, n, 0xff) == n);
+		assert(simd_sum_u8(data, n) == 0xff * n);
+		assert(simd_min_u8(data, n) == 0xff);
+		data[n - 1] = 0;
+		assert(simd_find_u8(data, n, 0) == n - 1);
+		assert(simd_min_u8(data, n) == 0);
+		free(data);
+	}
+}
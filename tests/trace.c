@@ -0,0 +1,183 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+#include <ds/trace.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file.h"
+
+#define N_THREADS 4
+#define N_EVENTS 10000
+
+static void buf_putc(FmtContext *ctx, char c) {
+	ERROR_ASSERT(fmtb_append(ctx->ctx_data, &c, 1));
+}
+
+static void buf_write(FmtContext *ctx, const char *buf, size_t n) {
+	ERROR_ASSERT(fmtb_append(ctx->ctx_data, buf, n));
+}
+
+typedef struct Writer {
+	pthread_t thread;
+	Trace *t;
+	int id;
+} Writer;
+
+static void *writer_run(void *arg) {
+	Writer *w = arg;
+	for (int i = 0; i < N_EVENTS; i++) {
+		if (i % 2 == 0)
+			trace_fmt(w->t, "even %d %d\n", w->id, i);
+		else
+			trace_fmt(w->t, "odd %d %d", w->id, i);
+	}
+	return NULL;
+}
+
+/* Decodes a trace; returns the text. */
+static char *decode_data(const char *data, size_t size, Error *err) {
+	FmtBuf out = fmt_buf();
+	FmtContext ctx = { .ctx_data = &out, .putc_func = buf_putc, .write_func = buf_write };
+	*err = trace_decode(&ctx, data, size);
+	ERROR_ASSERT(fmtb_append(&out, "", 1));
+	return out.buf;
+}
+
+/* Decodes the trace file at path; returns the text. */
+static char *decode(const char *path, size_t size_limit, Error *err) {
+	size_t size;
+	char *data = read_file(path, &size);
+	char *res = decode_data(data, size < size_limit ? size : size_limit, err);
+	free(data);
+	return res;
+}
+
+/* Appends a record as laid out in src/ds/trace.c: id, size and time, then
+ * n bytes of payload padded to 8, claiming to be size bytes long. */
+static void append_record(FmtBuf *b, uint32_t id, uint32_t size, const char *payload, size_t n) {
+	static const char zeros[8] = {0};
+	uint32_t head[2] = { id, size };
+	uint64_t time = 0;
+	ERROR_ASSERT(fmtb_append(b, (const char *)head, sizeof(head)));
+	ERROR_ASSERT(fmtb_append(b, (const char *)&time, sizeof(time)));
+	ERROR_ASSERT(fmtb_append(b, payload, n));
+	ERROR_ASSERT(fmtb_append(b, zeros, (8 - n % 8) % 8));
+}
+
+/* Decodes a trace of one format definition and one event; returns whether it
+ * was rejected as corrupt. */
+static bool is_corrupt(uint32_t format_id, const char *format, uint32_t event_size, const char *payload, size_t n) {
+	FmtBuf b = fmt_buf();
+	uint32_t header[2] = { 0x01020304, sizeof(void *) };
+	ERROR_ASSERT(fmtb_append(&b, "DSFMTTRC", 8));
+	ERROR_ASSERT(fmtb_append(&b, (const char *)header, sizeof(header)));
+	append_record(&b, format_id | 0x80000000, strlen(format) + 1, format, strlen(format) + 1);
+	append_record(&b, format_id, event_size, payload, n);
+	Error err;
+	// Exactly as large as the trace, so reading past it is caught
+	char *data = malloc(b.len);
+	memcpy(data, b.buf, b.len);
+	char *text = decode_data(data, b.len, &err);
+	bool res = error_is(err) && strstr(err.str, "Corrupt") != NULL;
+	if (error_is(err))
+		error_to_string(NULL, 0, err, true);
+	free(text);
+	free(data);
+	fmtb_term(&b);
+	return res;
+}
+
+/* Skips the "[seconds.nanoseconds] " prefix of a decoded line. */
+static const char *skip_time(const char *line) {
+	assert(line[0] == '[');
+	const char *dot = strchr(line, '.');
+	assert(dot != NULL && dot[10] == ']' && dot[11] == ' ');
+	return dot + 12;
+}
+
+int main() {
+	fmt_init();
+
+	char path[] = "/tmp/ds_trace_test_XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	close(fd);
+
+	// Arguments are copied when tracing
+	Trace t;
+	ERROR_ASSERT(trace_open(&t, path));
+	char name[16] = "before";
+	for (int i = 0; i < 3; i++)
+		trace_fmt(&t, "%d: %s %{int:p=3} %{str:p=4} %{Error}\n", i, name, -2, "x", ERROR_STRING("oops"));
+	strcpy(name, "after");
+	trace_fmt(&t, "%zu %f %c", (size_t)42, 0.5, 'z');
+	ERROR_ASSERT(trace_close(&t));
+	Error err;
+	char *text = decode(path, SIZE_MAX, &err);
+	ERROR_ASSERT(err);
+	const char *expected[] = {
+		"0: before  -2    x oops",
+		"1: before  -2    x oops",
+		"2: before  -2    x oops",
+		"42 0.500000 z",
+	};
+	size_t n_lines = 0;
+	for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		assert(n_lines < 4);
+		assert(strcmp(skip_time(line), expected[n_lines]) == 0);
+		n_lines++;
+	}
+	assert(n_lines == 4);
+	free(text);
+
+	// Truncated files decode up to the cut
+	text = decode(path, 100, &err);
+	assert(error_is(err) && strstr(err.str, "truncated") != NULL);
+	error_to_string(NULL, 0, err, true);
+	free(text);
+	text = decode(path, 4, &err);
+	assert(error_is(err) && strstr(err.str, "Not a trace file") != NULL);
+	free(text);
+
+	// Malformed payloads are rejected, not read past
+	int64_t num = 42;
+	assert(!is_corrupt(0, "%d", 8, (const char *)&num, 8));
+	assert(is_corrupt(0, "%d", 0, "", 0));
+	assert(!is_corrupt(0, "%s", 8, "AAAAAAA", 8));
+	assert(is_corrupt(0, "%s", 8, "AAAAAAAA", 8)); // no terminator
+	assert(is_corrupt(0x7fffffff, "%d", 8, (const char *)&num, 8));
+
+	// Several threads; events of each thread stay in order
+	ERROR_ASSERT(trace_open(&t, path));
+	Writer writers[N_THREADS];
+	for (int i = 0; i < N_THREADS; i++) {
+		writers[i] = (Writer){ .t = &t, .id = i };
+		assert(pthread_create(&writers[i].thread, NULL, writer_run, &writers[i]) == 0);
+	}
+	for (int i = 0; i < N_THREADS; i++)
+		pthread_join(writers[i].thread, NULL);
+	ERROR_ASSERT(trace_close(&t));
+	text = decode(path, SIZE_MAX, &err);
+	ERROR_ASSERT(err);
+	int next[N_THREADS] = {0};
+	n_lines = 0;
+	for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+		char kind[8];
+		int id, i;
+		assert(sscanf(skip_time(line), "%7s %d %d", kind, &id, &i) == 3);
+		assert(id >= 0 && id < N_THREADS);
+		assert(i == next[id]++);
+		assert(strcmp(kind, i % 2 == 0 ? "even" : "odd") == 0);
+		n_lines++;
+	}
+	assert(n_lines == N_THREADS * N_EVENTS);
+	free(text);
+
+	unlink(path);
+	fmt_term();
+}
@@ -0,0 +1,73 @@
+// Copyright 2022 Darwin Schuppan <darwin@nobrain.org>
+// SPDX license identifier: MIT
+
+/* ds-fmtdecode: renders trace files written with trace_fmt() (see
+ * ds/trace.h) to text on stdout. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ds/fmt.h>
+#include <ds/trace.h>
+
+static void stdout_putc(FmtContext *ctx, char c) {
+	putchar(c);
+}
+
+static void stdout_write(FmtContext *ctx, const char *buf, size_t n) {
+	fwrite(buf, 1, n, stdout);
+}
+
+static int decode_file(const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "ds-fmtdecode: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		fprintf(stderr, "ds-fmtdecode: %s: %s\n", path, strerror(errno));
+		close(fd);
+		return 1;
+	}
+	/* An empty file can't be mapped, and isn't a trace file either. */
+	void *data = st.st_size == 0 ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "ds-fmtdecode: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	FmtContext ctx = {
+		.putc_func = stdout_putc,
+		.write_func = stdout_write,
+	};
+	Error err = trace_decode(&ctx, data, st.st_size);
+	if (data != NULL)
+		munmap(data, st.st_size);
+	if (error_is(err)) {
+		char buf[512];
+		error_to_string(buf, sizeof(buf), err, true);
+		fflush(stdout);
+		fprintf(stderr, "ds-fmtdecode: %s: %s\n", path, buf);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <trace file>...\n", argv[0]);
+		return 1;
+	}
+	fmt_init();
+	int res = 0;
+	for (int i = 1; i < argc; i++)
+		res |= decode_file(argv[i]);
+	fmt_term();
+	return res;
+}